@@ -3,17 +3,47 @@
 #include <sstream>
 #include <vector>
 #include <cstring>
+#include <cerrno>
 #include <sys/wait.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <signal.h>
+#include <pthread.h>
 #include <ctype.h>
 
 #define MAX_ARGS 64
+#define MAX_BACKGROUND 64
+
+// Background commands started with &, 0 for a free slot. Only these are
+// reaped here: a waitpid(-1) would also take the children of system() on the
+// VM's worker threads (the AOT tier's C compiler), failing it with -1.
+static volatile sig_atomic_t background_pids[MAX_BACKGROUND];
+
+static void reap_background() {
+    for (int i = 0; i < MAX_BACKGROUND; i++) {
+        pid_t pid = background_pids[i];
+        if (pid > 0 && waitpid(pid, NULL, WNOHANG) == pid) background_pids[i] = 0;
+    }
+}
 
 static void sigchld_handler(int sig) {
     (void)sig;
-    while (waitpid(-1, NULL, WNOHANG) > 0);
+    int saved = errno;
+    reap_background();
+    errno = saved;
+}
+
+// Called with SIGCHLD blocked in this thread. The signal can still land on a
+// VM worker thread before the pid is here, so the caller reaps once more
+// after unblocking.
+static bool track_background(pid_t pid) {
+    for (int i = 0; i < MAX_BACKGROUND; i++) {
+        if (background_pids[i] == 0) {
+            background_pids[i] = pid;
+            return true;
+        }
+    }
+    return false;
 }
 
 class Shell {
@@ -160,12 +190,18 @@ private:
         
         if (argv[0] == nullptr) return;
 
+        sigset_t chld, saved;
+        sigemptyset(&chld);
+        sigaddset(&chld, SIGCHLD);
+        pthread_sigmask(SIG_BLOCK, &chld, &saved);
         pid_t val = fork();
         if (val < 0) {
             perror("fork");
+            pthread_sigmask(SIG_SETMASK, &saved, NULL);
         } else if (val == 0) {
             signal(SIGINT, SIG_DFL);
             signal(SIGCHLD, SIG_DFL); 
+            pthread_sigmask(SIG_SETMASK, &saved, NULL);
 
             if (file_out != NULL) {
                 int fd = open(file_out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
@@ -185,9 +221,13 @@ private:
             perror("execvp");
             exit(EXIT_FAILURE);
         } else {
-            if (background) {
+            bool tracked = background && track_background(val);
+            pthread_sigmask(SIG_SETMASK, &saved, NULL);
+            if (tracked) {
                 printf("[bg] started pid %d\n", val);
+                reap_background();
             } else {
+                if (background) printf("[bg] too many background commands, waiting for pid %d\n", val);
                 int status;
                 waitpid(val, &status, 0);
             }
@@ -221,23 +261,157 @@ private:
     }
    
     void handleSubmit(const std::vector<std::string>& args) {
-         if (args.size() < 2) { std::cerr << "Usage: submit <filename>" << std::endl; return; }
-         ProgramID pid = programManager.submitProgram(args[1]);
-         std::cout << "PID = " << pid << std::endl;
-         if (programManager.getProgramState(pid) == "ERROR") {
-             std::cout << "Error: " << programManager.getProgramOutput(pid) << std::endl; 
+         std::vector<std::string> filenames;
+         ExecutionTier tier = ExecutionTier::STACK;
+         bool lineOutput = false;
+         size_t jobs = 0;
+         for (size_t i = 1; i < args.size(); i++) {
+             if (args[i] == "--reg") tier = ExecutionTier::REGISTER;
+             else if (args[i] == "--trace") tier = ExecutionTier::TRACE;
+             else if (args[i] == "--aot") tier = ExecutionTier::AOT;
+             else if (args[i] == "--line") lineOutput = true;
+             else if (args[i] == "-j" && i + 1 < args.size()) jobs = std::stoul(args[++i]);
+             else filenames.push_back(args[i]);
+         }
+         if (filenames.empty()) {
+             std::cerr << "Usage: submit <filename>... [--reg|--trace|--aot] [--line] [-j N]" << std::endl;
+             return;
+         }
+         // Several files are parsed and compiled in parallel
+         std::vector<ProgramID> pids;
+         if (filenames.size() == 1) pids.push_back(programManager.submitProgram(filenames[0], tier, lineOutput));
+         else pids = programManager.submitPrograms(filenames, tier, lineOutput, jobs);
+         for (ProgramID pid : pids) {
+             std::cout << "PID = " << pid;
+             if (pids.size() > 1) std::cout << " (" << programManager.getProgramFile(pid) << ")";
+             std::cout << std::endl;
+             if (programManager.getProgramState(pid) == "ERROR") {
+                 std::cout << "Error: " << programManager.getProgramOutput(pid) << std::endl;
+             }
          }
     }
     
     void handleRun(const std::vector<std::string>& args) {
         if (args.size() < 2) return;
         ProgramID pid = std::stoi(args[1]);
+        if (args.back() == "&") {
+            if (!programManager.startProgram(pid, ProgramManager::DEFAULT_PRIORITY)) {
+                std::cout << "Error: Could not start PID " << pid << " (needs a compiled program)\n";
+                return;
+            }
+            std::cout << "[" << pid << "] running in the background\n";
+            return;
+        }
         if (programManager.runProgram(pid)) {
              std::string out = programManager.getProgramOutput(pid);
              if(!out.empty()) std::cout << out;
         }
     }
 
+    void handleRunAll(const std::vector<std::string>& args) {
+        size_t jobs = 0;
+        if (args.size() == 3 && args[1] == "-j") jobs = std::stoul(args[2]);
+        else if (args.size() == 2 && args[1].rfind("-j", 0) == 0) jobs = std::stoul(args[1].substr(2));
+        else if (args.size() != 1) { std::cout << "Usage: runall [-j N]\n"; return; }
+        programManager.runAll(jobs);
+    }
+
+    void handleStart(const std::vector<std::string>& args) {
+        if (args.size() < 2) { std::cout << "Usage: start <pid> [priority]\n"; return; }
+        ProgramID pid = std::stoi(args[1]);
+        int priority = args.size() > 2 ? std::stoi(args[2]) : ProgramManager::DEFAULT_PRIORITY;
+        if (!programManager.startProgram(pid, priority)) {
+            std::cout << "Error: Could not start PID " << pid << " (needs a compiled program, priority 1-"
+                      << ProgramManager::MAX_PRIORITY << ")\n";
+            return;
+        }
+        std::cout << "PID " << pid << " started, priority " << priority << "\n";
+    }
+
+    void handlePause(const std::vector<std::string>& args) {
+        if (args.size() < 2) return;
+        ProgramID pid = std::stoi(args[1]);
+        if (!programManager.pauseProgram(pid)) std::cout << "Error: PID " << pid << " is not running\n";
+    }
+
+    void handleResume(const std::vector<std::string>& args) {
+        if (args.size() < 2) return;
+        ProgramID pid = std::stoi(args[1]);
+        if (!programManager.resumeProgram(pid)) std::cout << "Error: PID " << pid << " is not paused\n";
+    }
+
+    void handleNice(const std::vector<std::string>& args) {
+        if (args.size() < 3) { std::cout << "Usage: nice <pid> <priority>\n"; return; }
+        ProgramID pid = std::stoi(args[1]);
+        if (!programManager.setPriority(pid, std::stoi(args[2]))) {
+            std::cout << "Error: priority must be 1-" << ProgramManager::MAX_PRIORITY << "\n";
+        }
+    }
+
+    void handleQuantum(const std::vector<std::string>& args) {
+        if (args.size() > 1) programManager.setQuantum(std::stoll(args[1]));
+        std::cout << "Quantum: " << programManager.getQuantum() << " instructions\n";
+    }
+
+    void handleTop(const std::vector<std::string>&) {
+        programManager.printSchedule();
+    }
+
+    void handleJobs(const std::vector<std::string>&) {
+        programManager.listJobs();
+    }
+
+    void handleWait(const std::vector<std::string>& args) {
+        if (args.size() < 2) { programManager.waitAll(); return; }
+        ProgramID pid = std::stoi(args[1]);
+        if (!programManager.waitProgram(pid)) std::cout << "Error: PID " << pid << " is not a running job\n";
+    }
+
+    void handleForeground(const std::vector<std::string>& args) {
+        if (args.size() < 2) { std::cout << "Usage: fg <pid>\n"; return; }
+        ProgramID pid = std::stoi(args[1]);
+        if (!programManager.foregroundProgram(pid)) std::cout << "Error: PID " << pid << " is not a job\n";
+    }
+
+    // Background programs that finished while the user was typing
+    void reportFinishedJobs() {
+        for (ProgramID pid : programManager.collectFinished()) {
+            std::cout << "[" << pid << "] Done    " << programManager.getProgramFile(pid) << "\n";
+        }
+    }
+
+    void handleOutput(const std::vector<std::string>& args) {
+        if (args.size() < 2) return;
+        std::cout << programManager.getProgramOutput(std::stoi(args[1]));
+    }
+
+    void handleProfile(const std::vector<std::string>& args) {
+        if (args.size() < 2) { std::cout << "Usage: profile <pid>\n"; return; }
+        ProgramID pid = std::stoi(args[1]);
+        if (!programManager.profileProgram(pid)) {
+            std::cout << "Error: Could not profile PID " << pid << "\n";
+        }
+    }
+
+    void handleSample(const std::vector<std::string>& args) {
+        if (args.size() < 2) { std::cout << "Usage: sample <pid> [folded-file]\n"; return; }
+        ProgramID pid = std::stoi(args[1]);
+        if (!programManager.sampleProgram(pid, args.size() > 2 ? args[2] : "")) {
+            std::cout << "Error: Could not sample PID " << pid << "\n";
+        }
+    }
+
+    void handleSave(const std::vector<std::string>& args) {
+        if (args.size() < 3) { std::cout << "Usage: save <pid> <file.byc>\n"; return; }
+        ProgramID pid = std::stoi(args[1]);
+        if (!programManager.saveProgram(pid, args[2])) std::cout << "Error: Could not save PID " << pid << "\n";
+    }
+
+    void handleCache(const std::vector<std::string>& args) {
+        if (args.size() == 2 && args[1] == "clear") programManager.clearCache();
+        else programManager.printCacheStats();
+    }
+
     void handleDebug(const std::vector<std::string>& args) {
          if (args.size() < 2) return;
          ProgramID pid = std::stoi(args[1]);
@@ -274,8 +448,28 @@ private:
     
     void handleHelp(const std::vector<std::string>&) {
         std::cout << "Available commands:\n"
-                  << "  submit <program>   - Submit a program for execution\n"
-                  << "  run <pid>          - Run a submitted program\n"
+                  << "  submit <file>...   - Submit programs (source, or .byc files)\n"
+                  << "    --reg            - Run it on the register-based tier\n"
+                  << "    --trace          - Compile its hot loops with the tracing JIT\n"
+                  << "    --aot            - Compile it to a native shared object (cached)\n"
+                  << "    --line           - Write its output line by line instead of batched\n"
+                  << "    -j N             - Compile several files in parallel on N threads\n"
+                  << "  run <pid> [&]      - Run a submitted program, in the background with &\n"
+                  << "  runall [-j N]      - Run every compiled program concurrently on N threads\n"
+                  << "  start <pid> [pri]  - Run it time-sliced in the background (priority 1-10)\n"
+                  << "  pause <pid>        - Stop giving a started program time slices\n"
+                  << "  resume <pid>       - Give a paused program time slices again\n"
+                  << "  nice <pid> <pri>   - Change a program's priority (quanta per round)\n"
+                  << "  quantum [N]        - Show or set the instructions per time slice\n"
+                  << "  top                - Show slices, CPU time and CPU share of started programs\n"
+                  << "  output <pid>       - Show what a program has printed so far\n"
+                  << "  jobs               - List background programs and their state\n"
+                  << "  wait [pid]         - Wait for a background program (or all) and show its output\n"
+                  << "  fg <pid>           - Bring a background program to the foreground\n"
+                  << "  profile <pid>      - Run it with per-instruction cycle counts\n"
+                  << "  sample <pid> [out] - Run it under the SIGPROF sampler, folded stacks to out\n"
+                  << "  save <pid> <file>  - Write the compiled program as a .byc container\n"
+                  << "  cache [clear]      - Show or empty the compiled-bytecode cache\n"
                   << "  debug <pid>        - Enter debug mode for a program\n"
                   << "  kill <pid>         - Terminate a program\n"
                   << "  memstat <pid>      - Show memory statistics\n"
@@ -297,6 +491,7 @@ public:
         std::cout << "=== Integrated System Shell (Lab 6) ===\n";
         
         while (running) {
+            reportFinishedJobs();
             char cwd[1024];
             if (getcwd(cwd, sizeof(cwd))) std::cout << "mini-shell:" << cwd << " $ ";
             else std::cout << "$ ";
@@ -312,6 +507,21 @@ public:
             
             if (command == "submit") handleSubmit(tokens);
             else if (command == "run") handleRun(tokens);
+            else if (command == "runall") handleRunAll(tokens);
+            else if (command == "start") handleStart(tokens);
+            else if (command == "pause") handlePause(tokens);
+            else if (command == "resume") handleResume(tokens);
+            else if (command == "nice") handleNice(tokens);
+            else if (command == "quantum") handleQuantum(tokens);
+            else if (command == "top") handleTop(tokens);
+            else if (command == "jobs") handleJobs(tokens);
+            else if (command == "wait") handleWait(tokens);
+            else if (command == "fg") handleForeground(tokens);
+            else if (command == "output") handleOutput(tokens);
+            else if (command == "profile") handleProfile(tokens);
+            else if (command == "sample") handleSample(tokens);
+            else if (command == "save") handleSave(tokens);
+            else if (command == "cache") handleCache(tokens);
             else if (command == "debug") handleDebug(tokens);
             else if (command == "kill") {
                 if (tokens.size() < 2) {
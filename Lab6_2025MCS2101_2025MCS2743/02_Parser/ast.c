@@ -11,6 +11,12 @@ ASTNode* create_node(NodeType type) {
     node->name = node->op = node->val_str = NULL;
     node->value = 0;
     node->val_int = 0;
+    node->line = 0;
+    return node;
+}
+
+ASTNode* set_node_line(ASTNode* node, int line) {
+    if (node) node->line = line;
     return node;
 }
 
@@ -63,6 +69,8 @@ ASTNode* create_if(ASTNode* cond, ASTNode* body, ASTNode* else_body) {
         node->condition = cond;
         node->body = body;
         node->else_body = else_body;
+        /* reduced at the closing brace; the condition holds the if's line */
+        if (cond) node->line = cond->line;
     }
     return node;
 }
@@ -72,6 +80,7 @@ ASTNode* create_while(ASTNode* cond, ASTNode* body) {
     if (node) {
         node->condition = cond;
         node->body = body;
+        if (cond) node->line = cond->line;
     }
     return node;
 }
@@ -30,6 +30,7 @@ typedef struct ASTNode {
     struct ASTNode *body;       
     struct ASTNode *else_body;  
     struct ASTNode *next;       
+    int line;                   /* source line the node was parsed on */
 } ASTNode;
 
 ASTNode* create_int_node(int val);
@@ -41,12 +42,12 @@ ASTNode* create_if(ASTNode* cond, ASTNode* body, ASTNode* else_body);
 ASTNode* create_while(ASTNode* cond, ASTNode* body);
 ASTNode* create_node_list(ASTNode* list, ASTNode* stmt);
 ASTNode* create_unary(char* op, struct ASTNode* child);
+/* The parser stamps each node with its source line; returns node */
+ASTNode* set_node_line(ASTNode* node, int line);
 void print_ast(ASTNode* node, int level);
 void print_output(ASTNode* root);
 void free_ast(ASTNode* node);
 
-extern ASTNode* root;
-
 #ifdef __cplusplus
 }
 #endif
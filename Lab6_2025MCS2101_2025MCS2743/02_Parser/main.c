@@ -1,17 +1,33 @@
 #include <stdio.h>
-#include "ast.h"
-
-extern int yyparse();
-extern ASTNode* root;
+#include <stdlib.h>
+#include <string.h>
+#include "parse.h"
 
 int main() {
+    char* text = NULL;
+    size_t len = 0, cap = 0, n;
+    char chunk[4096];
+    while ((n = fread(chunk, 1, sizeof(chunk), stdin)) > 0) {
+        if (len + n > cap) {
+            cap = (len + n) * 2;
+            text = (char*)realloc(text, cap);
+        }
+        memcpy(text + len, chunk, n);
+        len += n;
+    }
+
+    ASTNode* root;
+    char error[256];
     printf("Parsing input...\n");
-    if (yyparse() != 0) {
-        printf("Parse Failed.\n");
+    if (parse_source(text, (int)len, &root, error, sizeof(error)) != 0) {
+        printf("Parse Failed: %s\n", error);
+        free(text);
         return 0;
     }
     printf("Parse Successful! Printing AST:\n");
     print_ast(root, 0);
     print_output(root);
+    free_ast(root);
+    free(text);
     return 0;
 }
\ No newline at end of file
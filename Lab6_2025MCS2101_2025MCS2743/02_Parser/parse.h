@@ -0,0 +1,21 @@
+#ifndef PARSE_H
+#define PARSE_H
+
+#include <stddef.h>
+#include "ast.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Parses the len bytes at text (not NUL-terminated). Each call has its own
+   scanner, parser stack and symbol table, so threads may parse at once.
+   Returns 0 with the AST in *ast (NULL for an empty program), or nonzero
+   with the first error ("... at line N") in error. */
+int parse_source(const char* text, int len, ASTNode** ast, char* error, size_t errorSize);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
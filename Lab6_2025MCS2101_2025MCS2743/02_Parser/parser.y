@@ -1,67 +1,92 @@
+%code requires {
+#include <stddef.h>
+#include "ast.h"
+
+#define MAX_VARS 1000
+
+#ifndef YY_TYPEDEF_YY_SCANNER_T
+#define YY_TYPEDEF_YY_SCANNER_T
+typedef void* yyscan_t;
+#endif
+
+/* Everything one parse needs: no globals, so threads can parse at once */
+typedef struct ParseContext {
+    ASTNode* root;
+    char* symbol_table[MAX_VARS];
+    int count;
+    int parsing_failed;
+    char error[256];            /* the first error, "" if none */
+} ParseContext;
+}
+
+%code provides {
+/* Fails the parse; the first error is kept as "<message> at line N" */
+void parse_error(ParseContext* ctx, int line, const char* fmt, ...);
+}
+
 %{
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include "ast.h"  
+#include <stdarg.h>
+#include "parse.h"
+%}
 
-#define MAX_VARS 1000
-int parsing_failed = 0;
-extern int yylex();
-extern int line_num; 
-void yyerror(const char *s);
-
-ASTNode* root;
-  
-char* symbol_table[MAX_VARS]; 
-int count = 0;
-
-void clear_parser_symbols() {
-    for (int i = 0; i < count; i++) {
-        if (symbol_table[i]) {
-            free(symbol_table[i]);
-            symbol_table[i] = NULL;
-        }
-    }
-    count = 0;
-    parsing_failed = 0;
-    root = NULL;
-}
+%code {
+#ifndef YY_TYPEDEF_YY_BUFFER_STATE
+#define YY_TYPEDEF_YY_BUFFER_STATE
+typedef struct yy_buffer_state* YY_BUFFER_STATE;
+#endif
+
+/* The reentrant scanner, from lexer.l */
+int yylex(YYSTYPE* lvalp, yyscan_t scanner);
+int yylex_init_extra(ParseContext* ctx, yyscan_t* scanner);
+int yylex_destroy(yyscan_t scanner);
+YY_BUFFER_STATE yy_scan_bytes(const char* bytes, int len, yyscan_t scanner);
+int yyget_lineno(yyscan_t scanner);
 
-void add_symbol(char* name) {
-    if (count >= MAX_VARS) {
-        parsing_failed = 1;
+void yyerror(yyscan_t scanner, ParseContext* ctx, const char* s);
+
+/* Nodes are stamped with the line the scanner has reached */
+#define AT(node) set_node_line((node), yyget_lineno(scanner))
+
+static void add_symbol(yyscan_t scanner, ParseContext* ctx, char* name) {
+    if (ctx->count >= MAX_VARS) {
+        parse_error(ctx, yyget_lineno(scanner), "more than %d variables", MAX_VARS);
         return;
     }
-    for(int i=0; i<count; i++) {
-        if(strcmp(symbol_table[i], name) == 0) {
-            fprintf(stderr, "Error: Variable '%s' already declared at line %d\n", name, line_num);
-            parsing_failed = 1;
+    for(int i=0; i<ctx->count; i++) {
+        if(strcmp(ctx->symbol_table[i], name) == 0) {
+            parse_error(ctx, yyget_lineno(scanner), "Variable '%s' already declared", name);
             return;
         }
     }
-    symbol_table[count] = strdup(name);
-    count++;
+    ctx->symbol_table[ctx->count] = strdup(name);
+    ctx->count++;
 }
 
-void check_symbol(char* name) {
+static void check_symbol(yyscan_t scanner, ParseContext* ctx, char* name) {
     int found = 0;
-    for(int i=0; i<count; i++) {
-        if(strcmp(symbol_table[i], name) == 0) {
+    for(int i=0; i<ctx->count; i++) {
+        if(strcmp(ctx->symbol_table[i], name) == 0) {
             found = 1;
             break;
         }
     }
     if(!found) {
-        fprintf(stderr, "Error: Undeclared variable '%s' used at line %d\n", name, line_num);
-        parsing_failed = 1; 
+        parse_error(ctx, yyget_lineno(scanner), "Undeclared variable '%s' used", name);
     }
 }
-%}
+}
+
+%define api.pure full
+%param {yyscan_t scanner}
+%parse-param {ParseContext* ctx}
 
 %union {
-    int ival;           
-    char* sval;         
-    struct ASTNode* nval; 
+    int ival;
+    char* sval;
+    struct ASTNode* nval;
 }
 
 %token <sval> IDENTIFIER
@@ -88,40 +113,40 @@ void check_symbol(char* name) {
 %%
 
 program:
-    statement_list { root = $1; }
+    statement_list { ctx->root = $1; }
     ;
 
 statement_list:
-    statement_list statement { 
-        $$ = create_node_list($1, $2); 
+    statement_list statement {
+        $$ = AT(create_node_list($1, $2));
     }
     | { $$ = NULL; }
     ;
 
 statement:
-    VAR IDENTIFIER SEMI { 
-        add_symbol($2);           
-        $$ = create_var_decl($2, NULL); 
+    VAR IDENTIFIER SEMI {
+        add_symbol(scanner, ctx, $2);
+        $$ = AT(create_var_decl($2, NULL));
     }
-    | VAR IDENTIFIER ASSIGN expression SEMI { 
-        add_symbol($2);          
-        $$ = create_var_decl($2, $4); 
+    | VAR IDENTIFIER ASSIGN expression SEMI {
+        add_symbol(scanner, ctx, $2);
+        $$ = AT(create_var_decl($2, $4));
     }
-    | IDENTIFIER ASSIGN expression SEMI { 
-        check_symbol($1);         
-        $$ = create_assign($1, $3); 
+    | IDENTIFIER ASSIGN expression SEMI {
+        check_symbol(scanner, ctx, $1);
+        $$ = AT(create_assign($1, $3));
     }
     | PRINT expression SEMI {
-        $$ = create_unary("print", $2);
+        $$ = AT(create_unary("print", $2));
     }
-    | IF LPAREN expression RPAREN statement %prec LOWER_THAN_ELSE { 
-        $$ = create_if($3, $5, NULL); 
+    | IF LPAREN expression RPAREN statement %prec LOWER_THAN_ELSE {
+        $$ = create_if($3, $5, NULL);
     }
-    | IF LPAREN expression RPAREN statement ELSE statement { 
-        $$ = create_if($3, $5, $7); 
+    | IF LPAREN expression RPAREN statement ELSE statement {
+        $$ = create_if($3, $5, $7);
     }
-    | WHILE LPAREN expression RPAREN statement { 
-        $$ = create_while($3, $5); 
+    | WHILE LPAREN expression RPAREN statement {
+        $$ = create_while($3, $5);
     }
     | block { $$ = $1; }
     ;
@@ -136,47 +161,84 @@ expression:
 
 equality:
     comparison { $$ = $1; }
-    | equality EQ comparison { $$ = create_binop("==", $1, $3); }
-    | equality NEQ comparison { $$ = create_binop("!=", $1, $3); }
+    | equality EQ comparison { $$ = AT(create_binop("==", $1, $3)); }
+    | equality NEQ comparison { $$ = AT(create_binop("!=", $1, $3)); }
     ;
 
 comparison:
     term { $$ = $1; }
-    | comparison LT term { $$ = create_binop("<", $1, $3); }
-    | comparison GT term { $$ = create_binop(">", $1, $3); }
-    | comparison LE term { $$ = create_binop("<=", $1, $3); }
-    | comparison GE term { $$ = create_binop(">=", $1, $3); }
+    | comparison LT term { $$ = AT(create_binop("<", $1, $3)); }
+    | comparison GT term { $$ = AT(create_binop(">", $1, $3)); }
+    | comparison LE term { $$ = AT(create_binop("<=", $1, $3)); }
+    | comparison GE term { $$ = AT(create_binop(">=", $1, $3)); }
     ;
 
 term:
     factor { $$ = $1; }
-    | term PLUS factor { $$ = create_binop("+", $1, $3); }
-    | term MINUS factor { $$ = create_binop("-", $1, $3); }
+    | term PLUS factor { $$ = AT(create_binop("+", $1, $3)); }
+    | term MINUS factor { $$ = AT(create_binop("-", $1, $3)); }
     ;
 
 factor:
     unary { $$ = $1; }
-    | factor MULT unary { $$ = create_binop("*", $1, $3); }
-    | factor DIV unary  { $$ = create_binop("/", $1, $3); }
+    | factor MULT unary { $$ = AT(create_binop("*", $1, $3)); }
+    | factor DIV unary  { $$ = AT(create_binop("/", $1, $3)); }
     ;
 
 unary:
-    PLUS unary %prec NEG { $$ = create_unary("+", $2); }
-    | MINUS unary %prec NEG { $$ = create_unary("-", $2); }
+    PLUS unary %prec NEG { $$ = AT(create_unary("+", $2)); }
+    | MINUS unary %prec NEG { $$ = AT(create_unary("-", $2)); }
     | primary { $$ = $1; }
     ;
 
 primary:
-    INTEGER { $$ = create_int_node($1); }
-    | IDENTIFIER { 
-        check_symbol($1);          
-        $$ = create_id_node($1); 
+    INTEGER { $$ = AT(create_int_node($1)); }
+    | IDENTIFIER {
+        check_symbol(scanner, ctx, $1);
+        $$ = AT(create_id_node($1));
     }
     | LPAREN expression RPAREN { $$ = $2; }
     ;
 
 %%
 
-void yyerror(const char *s) {
-    fprintf(stderr, "Syntax Error at line %d: %s\n", line_num, s);
+void parse_error(ParseContext* ctx, int line, const char* fmt, ...) {
+    ctx->parsing_failed = 1;
+    if (ctx->error[0]) return;
+    char msg[200];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(msg, sizeof(msg), fmt, args);
+    va_end(args);
+    snprintf(ctx->error, sizeof(ctx->error), "%s at line %d", msg, line);
+}
+
+void yyerror(yyscan_t scanner, ParseContext* ctx, const char* s) {
+    parse_error(ctx, yyget_lineno(scanner), "%s", s);
+}
+
+int parse_source(const char* text, int len, ASTNode** ast, char* error, size_t errorSize) {
+    ParseContext ctx;
+    yyscan_t scanner;
+    int status;
+
+    memset(&ctx, 0, sizeof(ctx));
+    *ast = NULL;
+    if (yylex_init_extra(&ctx, &scanner) != 0) {
+        snprintf(error, errorSize, "out of memory");
+        return 1;
+    }
+    yy_scan_bytes(text, len, scanner);
+    status = yyparse(scanner, &ctx) != 0 || ctx.parsing_failed;
+    /* Also frees the scan buffer */
+    yylex_destroy(scanner);
+
+    for (int i = 0; i < ctx.count; i++) free(ctx.symbol_table[i]);
+    snprintf(error, errorSize, "%s", ctx.error);
+    if (status) {
+        free_ast(ctx.root);
+        return 1;
+    }
+    *ast = ctx.root;
+    return 0;
 }
\ No newline at end of file
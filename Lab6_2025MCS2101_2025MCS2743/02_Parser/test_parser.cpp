@@ -0,0 +1,175 @@
+#include <iostream>
+#include <cassert>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <atomic>
+#include <thread>
+#include "parse.h"
+
+using namespace std;
+
+void runTest(const string& name, void (*testFunc)()) {
+    cout << "\n==================================================" << endl;
+    cout << "PARSER TEST: " << name << endl;
+    cout << "==================================================" << endl;
+
+    try {
+        testFunc();
+        cout << ">>> RESULT: PASSED" << endl;
+    } catch (...) {
+        cout << ">>> RESULT: FAILED" << endl;
+        exit(1);
+    }
+}
+
+// The tree with every field the compiler reads, lines included
+string describe(const ASTNode* node) {
+    if (!node) return "-";
+    string s = "(" + to_string(node->type) + "@" + to_string(node->line);
+    if (node->name) s += " " + string(node->name);
+    if (node->op) s += " " + string(node->op);
+    if (node->type == NODE_INT) s += " " + to_string(node->value);
+    for (const ASTNode* child : {node->left, node->right, node->condition, node->body, node->else_body}) {
+        s += " " + describe(child);
+    }
+    return s + ")";
+}
+
+// The tree's description, or "error: <message>"
+string parse(const string& source) {
+    ASTNode* ast;
+    char error[256];
+    if (parse_source(source.data(), (int)source.size(), &ast, error, sizeof(error)) != 0) {
+        assert(ast == nullptr && error[0]);
+        return string("error: ") + error;
+    }
+    assert(error[0] == '\0');
+    string tree = describe(ast);
+    free_ast(ast);
+    return tree;
+}
+
+void testErrorLines() {
+    const struct {
+        const char* source;
+        const char* error;
+    } cases[] = {
+        {"var a = 1;\nvar b = 2;\nprint a + b;\nprint c;\n", "Undeclared variable 'c' used at line 4"},
+        {"var x = 1;\nvar x = 2;\n", "Variable 'x' already declared at line 2"},
+        {"var a = 1;\n/* a comment\n   over three\n   lines */\nvar b = a @ 2;\n", "Unknown char '@' at line 5"},
+        {"// a note\nvar a = 1 $ 2;\n", "Unknown char '$' at line 2"},
+        {"var i = 0;\ni++;\n", "Increment (++) not supported at line 2"},
+        {"var i = 0;\n\ni--;\n", "Decrement (--) not supported at line 3"},
+        {"var a = ;\n", "syntax error at line 1"},
+        // Only the first error is kept
+        {"print c;\nprint d;\n", "Undeclared variable 'c' used at line 1"},
+    };
+    for (const auto& c : cases) {
+        string result = parse(c.source);
+        assert(result == string("error: ") + c.error);
+        cout << "   [Check] " << c.error << endl;
+    }
+}
+
+void testErrorsDoNotExit() {
+    // A bad character used to exit the process; now each parse fails alone
+    // and leaves nothing behind for the next one
+    for (int i = 0; i < 3; i++) {
+        ASTNode* ast;
+        char error[256];
+        const string bad = "var a = 1;\nprint a # 2;\n";
+        assert(parse_source(bad.data(), (int)bad.size(), &ast, error, sizeof(error)) != 0);
+        assert(ast == nullptr);
+        assert(string(error) == "Unknown char '#' at line 2");
+        const string good = "var a = 1;\nprint a;\n";
+        assert(parse_source(good.data(), (int)good.size(), &ast, error, sizeof(error)) == 0);
+        assert(ast != nullptr && error[0] == '\0');
+        free_ast(ast);
+    }
+    cout << "   [Check] A bad character returns nonzero; the next parse succeeds." << endl;
+
+    // Declarations do not carry over from one parse to the next
+    assert(parse("var a = 1;\n").rfind("error", 0) != 0);
+    assert(parse("var a = 2;\n").rfind("error", 0) != 0);
+    assert(parse("print a;\n") == "error: Undeclared variable 'a' used at line 1");
+    cout << "   [Check] Every parse starts with an empty symbol table." << endl;
+}
+
+void testTreeAndLines() {
+    ASTNode* ast;
+    char error[256];
+    // Not NUL-terminated: only len bytes are scanned
+    const string source = "var a = 1;\n/* skipped */\nprint a * 2;\nXYZ";
+    assert(parse_source(source.data(), (int)source.size() - 3, &ast, error, sizeof(error)) == 0);
+    // Statement lists grow to the left; the last statement is on the right
+    const ASTNode* print = ast->right;
+    assert(print->type == NODE_UNARY && string(print->op) == "print" && print->line == 3);
+    const ASTNode* product = print->left;
+    assert(product->type == NODE_BINOP && string(product->op) == "*" && product->line == 3);
+    assert(product->left->type == NODE_ID && string(product->left->name) == "a");
+    assert(product->right->type == NODE_INT && product->right->value == 2);
+    const ASTNode* decl = ast->left->right;
+    assert(decl->type == NODE_VAR_DECL && string(decl->name) == "a" && decl->line == 1);
+    free_ast(ast);
+    cout << "   [Check] print a * 2 parsed on line 3 after a block comment." << endl;
+
+    assert(parse_source("", 0, &ast, error, sizeof(error)) == 0 && ast == nullptr);
+    const string comments = "// nothing\n/* here */\n";
+    assert(parse_source(comments.data(), (int)comments.size(), &ast, error, sizeof(error)) == 0 && ast == nullptr);
+    cout << "   [Check] An empty program parses to no tree." << endl;
+}
+
+void testParallelParse() {
+    vector<string> sources = {
+        "var i = 0;\nwhile (i < 10) {\n    i = i + 1;\n    if (i == 5) { print i; } else { print 0 - i; }\n}\n",
+        "var a = 3;\nvar b = 4;\n/* block\n comment */\nprint (a * a + b * b) / 5;\n",
+        "var x = 100;\nif (x > 50) {\n    x = 1;\n} else {\n    x = 0;\n}\nprint x;\n",
+        "var a = 1;\n/* a comment\n   over three\n   lines */\nvar b = a @ 2;\n",
+        "var n = 0;\nwhile (n < 3) { n = n + 1; }\nprint m;\n",
+        "var i = 0;\ni++;\n",
+    };
+    // A longer program, so threads are mid-parse at the same time
+    string big;
+    for (int v = 0; v < 200; v++) big += "var v" + to_string(v) + " = " + to_string(v) + " * 2 - 1;\n";
+    for (int v = 1; v < 200; v++) big += "v" + to_string(v) + " = v" + to_string(v - 1) + " + v" + to_string(v) + ";\n";
+    big += "print v199;\n";
+    sources.push_back(big);
+
+    vector<string> expected;
+    for (const string& s : sources) expected.push_back(parse(s));
+
+    const int THREADS = 8;
+    const int ROUNDS = 40;
+    atomic<int> mismatches(0);
+    vector<thread> workers;
+    for (int t = 0; t < THREADS; t++) {
+        workers.emplace_back([&, t] {
+            for (int r = 0; r < ROUNDS; r++) {
+                for (size_t i = 0; i < sources.size(); i++) {
+                    // Each thread walks the sources from a different start
+                    size_t k = (i + t) % sources.size();
+                    if (parse(sources[k]) != expected[k]) mismatches++;
+                }
+            }
+        });
+    }
+    for (thread& w : workers) w.join();
+    assert(mismatches == 0);
+    cout << "   [Check] " << THREADS << " threads parsed " << sources.size() << " sources " << ROUNDS
+         << " times each; every tree and error matched the serial parse." << endl;
+}
+
+int main() {
+    cout << "Starting Parser Test Suite..." << endl;
+
+    runTest("Error Lines", testErrorLines);
+    runTest("Errors Do Not Exit", testErrorsDoNotExit);
+    runTest("Tree And Lines", testTreeAndLines);
+    runTest("Parallel Parse", testParallelParse);
+
+    cout << "\n--------------------------------------------------" << endl;
+    cout << "SUMMARY: All Parser Tests Passed." << endl;
+    cout << "--------------------------------------------------" << endl;
+    return 0;
+}
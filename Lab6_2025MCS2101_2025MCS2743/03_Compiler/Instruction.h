@@ -25,7 +25,35 @@ enum Opcode : int32_t {
     OP_RET   = 0x41,
 
     OP_PRINT = 0x42,
+
+    // Superinstructions produced by the VM fusion pass, never by the assembler
+    OP_LOAD_LOAD_ADD    = 0x50,
+    OP_INC_VAR          = 0x51,
+    OP_CMP_JZ           = 0x52,
+    OP_LOAD_LOAD_CMP_JZ = 0x53,
+    OP_LOAD_PUSH_CMP_JZ = 0x54,
+
+    // Back-edge JMP that counts loop iterations for the tracing JIT, never emitted
+    OP_LOOP  = 0xFD,
+
+    // Debugger trap patched over a breakpoint address, never emitted
+    OP_BREAK = 0xFE,
+
     OP_HALT  = 0xFF
 };
 
+// Operand words following a bytecode opcode, or -1 for an unknown opcode.
+inline int operandCount(int32_t opcode) {
+    switch (opcode) {
+        case OP_PUSH: case OP_JMP: case OP_JZ: case OP_JNZ:
+        case OP_STORE: case OP_LOAD: case OP_CALL:
+            return 1;
+        case OP_POP: case OP_DUP: case OP_ADD: case OP_SUB: case OP_MUL:
+        case OP_DIV: case OP_CMP: case OP_RET: case OP_PRINT: case OP_HALT:
+            return 0;
+        default:
+            return -1;
+    }
+}
+
 #endif
\ No newline at end of file
@@ -1,26 +1,37 @@
 #include <iostream>
 #include "Assembler.h"
+#include "Bytecode.h"
 #include <vector>
 #include <cstdint>
-#include <fstream>
+#include <string>
 
 using namespace std;
 
 int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        cerr << "Usage: ./assemble program.asm\n";
+    string asmFile;
+    bool raw = false;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--raw") raw = true;
+        else asmFile = arg;
+    }
+    if (asmFile.empty()) {
+        cerr << "Usage: ./assemble program.asm [--raw]\n";
         return 1;
     }
 
-    string asmFile = argv[1];
-    auto bytecode = assemble(asmFile);
+    // --raw writes the legacy headerless format
+    BytecodeFile file;
+    file.code = assemble(asmFile);
+    file.legacy = raw;
 
     string outFile = asmFile.substr(0, asmFile.find_last_of('.')) + ".byc";
 
-    ofstream out(outFile, ios::binary);
-    out.write(reinterpret_cast<const char*>(bytecode.data()),
-              bytecode.size() * sizeof(int32_t));
-    out.close();
+    string error;
+    if (!writeBytecodeFile(outFile, file, error)) {
+        cerr << error << endl;
+        return 1;
+    }
 
     cout << "Assembled " << asmFile << " → " << outFile << endl;
     return 0;
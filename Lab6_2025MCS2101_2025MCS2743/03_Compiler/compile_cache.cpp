@@ -0,0 +1,171 @@
+#include "compile_cache.h"
+#include "CacheDir.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+namespace {
+
+// A writer that died mid-write leaves its temporary file; it is removed
+// once it is this old
+const time_t STALE_TEMP_SECONDS = 600;
+
+struct Entry {
+    std::string path;
+    struct timespec used;
+    uint64_t bytes;
+};
+
+bool endsWith(const std::string& s, const char* suffix) {
+    const size_t n = std::strlen(suffix);
+    return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+bool olderThan(const struct timespec& a, const struct timespec& b) {
+    return a.tv_sec != b.tv_sec ? a.tv_sec < b.tv_sec : a.tv_nsec < b.tv_nsec;
+}
+
+// The .byc entries of dir, oldest use first; stale temporaries are removed
+std::vector<Entry> listEntries(const std::string& dir) {
+    std::vector<Entry> entries;
+    DIR* d = opendir(dir.c_str());
+    if (!d) return entries;
+    const time_t now = time(nullptr);
+    while (struct dirent* e = readdir(d)) {
+        const std::string name = e->d_name;
+        const std::string path = dir + "/" + name;
+        struct stat st;
+        if (lstat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) continue;
+        if (endsWith(name, ".byc")) {
+            entries.push_back({path, st.st_mtim, (uint64_t)st.st_size});
+        } else if (name.find(".byc.tmp.") != std::string::npos && now - st.st_mtime > STALE_TEMP_SECONDS) {
+            unlink(path.c_str());
+        }
+    }
+    closedir(d);
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry& a, const Entry& b) { return olderThan(a.used, b.used); });
+    return entries;
+}
+
+// Serializes eviction and clearing between shells; lookups and stores need
+// no lock. Released when the descriptor is closed. A symlink in its place is
+// not followed.
+class DirLock {
+public:
+    explicit DirLock(const std::string& dir)
+        : fd(::open((dir + "/.lock").c_str(), O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0600)) {
+        if (fd >= 0) flock(fd, LOCK_EX);
+    }
+    ~DirLock() {
+        if (fd >= 0) close(fd);
+    }
+
+private:
+    int fd;
+};
+
+} // namespace
+
+CompileCache::CompileCache(uint32_t compilerVersion)
+    : usable(false), version(compilerVersion), limit(DEFAULT_LIMIT), hits(0), misses(0), evictions(0) {
+    const char* d = std::getenv("LAB6_BYTECODE_CACHE");
+    dir = (d && *d) ? d : userCacheDir("bytecode");
+    const char* mb = std::getenv("LAB6_BYTECODE_CACHE_MB");
+    if (mb && *mb) limit = std::strtoull(mb, nullptr, 10) << 20;
+    usable = openPrivateDir(dir, dirError);
+}
+
+CompileCache::CompileCache(const std::string& dir, uint32_t compilerVersion, uint64_t limitBytes)
+    : dir(dir), usable(false), version(compilerVersion), limit(limitBytes), hits(0), misses(0), evictions(0) {
+    usable = openPrivateDir(dir, dirError);
+}
+
+// 64-bit FNV-1a of the compiler and container versions, then the source
+std::string CompileCache::pathFor(const std::string& source) const {
+    uint64_t h = 14695981039346656037ull;
+    auto mix = [&h](const void* data, size_t size) {
+        const unsigned char* p = (const unsigned char*)data;
+        for (size_t i = 0; i < size; i++) {
+            h ^= p[i];
+            h *= 1099511628211ull;
+        }
+    };
+    const uint32_t versions[2] = {version, BYTECODE_VERSION};
+    mix(versions, sizeof(versions));
+    mix(source.data(), source.size());
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.byc", (unsigned long long)h);
+    return dir + "/" + name;
+}
+
+bool CompileCache::lookup(const std::string& source, BytecodeFile& file) {
+    const std::string path = pathFor(source);
+    if (!usable || access(path.c_str(), F_OK) != 0) {
+        misses++;
+        return false;
+    }
+    std::string error;
+    // Evicted since, damaged, or another source with the same hash: dropped,
+    // and replaced by the caller's store
+    if (!readBytecodeFile(path, file, error) || file.legacy || file.code.empty() || file.source != source) {
+        unlink(path.c_str());
+        misses++;
+        return false;
+    }
+    // The modification time orders entries for eviction
+    utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+    hits++;
+    return true;
+}
+
+void CompileCache::store(const std::string& source, const BytecodeFile& file) {
+    if (!usable) return;
+    BytecodeFile entry = file;
+    entry.source = source;
+    std::string error;
+    if (!writeBytecodeFile(pathFor(source), entry, error)) return;
+    evict();
+}
+
+// Oldest first until the rest fit. Two shells evicting at once would each
+// see the other's victims still counted and delete too much, hence the lock.
+void CompileCache::evict() {
+    DirLock hold(dir);
+    std::vector<Entry> entries = listEntries(dir);
+    uint64_t total = 0;
+    for (const Entry& e : entries) total += e.bytes;
+    for (const Entry& e : entries) {
+        if (total <= limit) break;
+        if (unlink(e.path.c_str()) == 0) evictions++;
+        total -= e.bytes;
+    }
+}
+
+int CompileCache::clear() {
+    if (!usable) return 0;
+    DirLock hold(dir);
+    int removed = 0;
+    for (const Entry& e : listEntries(dir)) {
+        if (unlink(e.path.c_str()) == 0) removed++;
+    }
+    return removed;
+}
+
+CompileCache::Usage CompileCache::usage() const {
+    Usage u = {0, 0};
+    if (!usable) return u;
+    for (const Entry& e : listEntries(dir)) {
+        u.entries++;
+        u.bytes += e.bytes;
+    }
+    return u;
+}
@@ -0,0 +1,63 @@
+#ifndef COMPILE_CACHE_H
+#define COMPILE_CACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include "Bytecode.h"
+
+// On-disk cache of compiled programs, shared by all of one user's shells.
+// An entry is a .byc container (code, lines, variable names and the source)
+// named after a hash of the source text and the compiler version, so an
+// unchanged source is compiled once; the stored source is compared on
+// lookup, so a hash collision is a miss. Entries are written under a new
+// temporary name and renamed, and checksummed, so a reader never sees a
+// partial or corrupt one. Once the entries pass the size limit the least
+// recently used are deleted. The directory must be private to the user
+// (see CacheDir.h), since its entries are run; otherwise every lookup misses.
+class CompileCache {
+public:
+    static const uint64_t DEFAULT_LIMIT = 64ull << 20;
+
+    // Directory from $LAB6_BYTECODE_CACHE (default ~/.cache/lab6/bytecode),
+    // limit from $LAB6_BYTECODE_CACHE_MB
+    explicit CompileCache(uint32_t compilerVersion);
+    CompileCache(const std::string& dir, uint32_t compilerVersion, uint64_t limitBytes);
+
+    // Fills file on a hit and marks the entry as recently used
+    bool lookup(const std::string& source, BytecodeFile& file);
+    // Adds the compiled source, then evicts down to the limit
+    void store(const std::string& source, const BytecodeFile& file);
+    // Deletes every entry; returns how many
+    int clear();
+
+    struct Usage {
+        int entries;
+        uint64_t bytes;
+    };
+    Usage usage() const;
+
+    const std::string& getDir() const { return dir; }
+    // False, with the reason, when the directory was refused
+    bool isUsable() const { return usable; }
+    const std::string& getError() const { return dirError; }
+    uint64_t getLimit() const { return limit; }
+    long long getHits() const { return hits; }
+    long long getMisses() const { return misses; }
+    long long getEvictions() const { return evictions; }
+
+private:
+    std::string dir;
+    bool usable;
+    std::string dirError;
+    uint32_t version;
+    uint64_t limit;
+    std::atomic<long long> hits;
+    std::atomic<long long> misses;
+    std::atomic<long long> evictions;
+
+    std::string pathFor(const std::string& source) const;
+    void evict();
+};
+
+#endif
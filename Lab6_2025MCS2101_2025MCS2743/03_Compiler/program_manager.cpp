@@ -1,19 +1,18 @@
 #include "program_manager.h"
 #include "Instruction.h"
+#include "thread_pool.h"
 #include <iostream>
+#include <iomanip>
 #include <fstream>
 #include <sstream>
 #include <cstring>
+#include <chrono>
+#include <thread>
+#include <algorithm>
 
-extern "C" {
-    extern FILE* yyin;
-    extern int yyparse();
-    extern int parsing_failed;
-    extern ASTNode* root;
-    extern void clear_parser_symbols();
-}
+#include "parse.h"
 
-IRGenerator::IRGenerator() : nextVarIndex(0), labelCounter(0) {}
+IRGenerator::IRGenerator() : currentLine(0), nextVarIndex(0), labelCounter(0) {}
 
 int IRGenerator::allocateVar(const std::string& name) {
     if (variables.find(name) == variables.end()) {
@@ -22,6 +21,12 @@ int IRGenerator::allocateVar(const std::string& name) {
     return variables[name];
 }
 
+std::vector<std::string> IRGenerator::getSymbols() const {
+    std::vector<std::string> names(nextVarIndex);
+    for (const auto& [name, index] : variables) names[index] = name;
+    return names;
+}
+
 int IRGenerator::getVar(const std::string& name) {
     auto it = variables.find(name);
     return (it == variables.end()) ? -1 : it->second;
@@ -29,6 +34,7 @@ int IRGenerator::getVar(const std::string& name) {
 
 void IRGenerator::emit(int32_t instruction) {
     bytecode.push_back(instruction);
+    lines.push_back(currentLine);
 }
 
 void IRGenerator::emitPush(int32_t value) {
@@ -115,6 +121,7 @@ void IRGenerator::generateExpr(ASTNode* node) {
 
 void IRGenerator::generateStmt(ASTNode* node) {
     if (!node) return;
+    if (node->type != NODE_STMT_LIST) currentLine = node->line;
     switch (node->type) {
         case NODE_STMT_LIST:
             if (node->left) generateStmt(node->left);
@@ -142,6 +149,7 @@ void IRGenerator::generateStmt(ASTNode* node) {
             emitJump(OP_JZ, elseLabel);
             generateStmt(node->body);
             if (node->else_body) {
+                currentLine = node->line;
                 emitJump(OP_JMP, endLabel);
                 placeLabel(elseLabel);
                 generateStmt(node->else_body);
@@ -158,6 +166,7 @@ void IRGenerator::generateStmt(ASTNode* node) {
             generateExpr(node->condition);
             emitJump(OP_JZ, endLabel);
             generateStmt(node->body);
+            currentLine = node->line;
             emitJump(OP_JMP, startLabel);
             placeLabel(endLabel);
             break;
@@ -169,6 +178,8 @@ void IRGenerator::generateStmt(ASTNode* node) {
 
 std::vector<int32_t> IRGenerator::generate(ASTNode* root) {
     bytecode.clear();
+    lines.clear();
+    currentLine = 0;
     variables.clear();
     nextVarIndex = 0;
     labelCounter = 0;
@@ -180,76 +191,183 @@ std::vector<int32_t> IRGenerator::generate(ASTNode* root) {
 }
 
 Program::Program(ProgramID id, const std::string& file)
-    : pid(id), sourceFile(file), state(ProgramState::SUBMITTED), ast(nullptr) {}
+    : pid(id), sourceFile(file), state(ProgramState::SUBMITTED), ast(nullptr), tier(ExecutionTier::STACK), profiling(false), sampling(false), lineOutput(false),
+      scheduled(false), inSlice(false), reaped(false), announced(false),
+      priority(1), credits(0), slices(0), cpuNanos(0) {}
 
 Program::~Program() {
+    // output goes before vm, which may still point at it
+    if (vm) vm->setOutputCapture(nullptr);
     if (ast) free_ast(ast);
 }
 
-bool Program::loadAndParse() {
-    clear_parser_symbols();
+bool Program::loadSource() {
     std::ifstream file(sourceFile);
     if (!file) {
         errorMessage = "Cannot open file: " + sourceFile;
+        output = errorMessage;
         state = ProgramState::ERROR;
         return false;
     }
     std::stringstream ss;
     ss << file.rdbuf();
     sourceCode = ss.str();
-    file.close();
-    FILE* temp = fopen("/tmp/parse_input.txt", "w");
-    if (temp) {
-        fprintf(temp, "%s", sourceCode.c_str());
-        fclose(temp);
-    }
-    yyin = fopen("/tmp/parse_input.txt", "r");
-    if (!yyin) return false;
-    root = nullptr;
-    parsing_failed = 0;
-    if (yyparse() != 0 || parsing_failed) {
-        errorMessage = "Parse failed";
+    return true;
+}
+
+// Reentrant: any thread, alongside other parses
+bool Program::parse() {
+    char error[256];
+    if (parse_source(sourceCode.data(), (int)sourceCode.size(), &ast, error, sizeof(error)) != 0) {
+        errorMessage = error;
+    } else if (!ast) {
+        errorMessage = "Empty program";
+    } else {
+        state = ProgramState::PARSED;
+        return true;
+    }
+    // Shown by submit
+    output = errorMessage;
+    state = ProgramState::ERROR;
+    return false;
+}
+
+bool Program::loadBytecode() {
+    BytecodeFile file;
+    if (!readBytecodeFile(sourceFile, file, errorMessage,
+                          sectionBit(Section::CODE) | sectionBit(Section::LINES) | sectionBit(Section::SYMBOLS))) {
+        // Shown by submit
+        output = errorMessage;
         state = ProgramState::ERROR;
-        fclose(yyin);
         return false;
     }
-    fclose(yyin);
-    ast = root;
-    state = (ast) ? ProgramState::PARSED : ProgramState::ERROR;
-    return ast != nullptr;
+    setCompiled(file);
+    return true;
+}
+
+void Program::setCompiled(BytecodeFile& file) {
+    bytecode = std::move(file.code);
+    lines = std::move(file.lines);
+    // A table for other code would label the wrong instructions
+    if (lines.size() != bytecode.size()) lines.clear();
+    symbols = std::move(file.symbols);
+    state = ProgramState::COMPILED;
 }
 
 bool Program::compile() {
     if (state != ProgramState::PARSED) return false;
     IRGenerator irGen;
     bytecode = irGen.generate(ast);
+    lines = irGen.getLines();
+    symbols = irGen.getSymbols();
     state = ProgramState::COMPILED;
     return true;
 }
 
-bool Program::execute() {
-    if (state != ProgramState::COMPILED) return false;
+bool Program::execute(bool capture) {
+    // Claimed atomically, so a program never runs on two threads at once
+    ProgramState expected = ProgramState::COMPILED;
+    if (!state.compare_exchange_strong(expected, ProgramState::RUNNING)) return false;
     vm = std::make_unique<VM>(bytecode);
-    state = ProgramState::RUNNING;
+    std::ostringstream notes;
+    std::ostream& log = capture ? notes : std::cout;
+    std::string printed;
+    if (capture) vm->setOutputCapture(&printed);
+    vm->setLineBuffered(lineOutput);
+    if (tier == ExecutionTier::REGISTER) {
+        std::string reason;
+        if (!vm->enableRegisterTier(reason)) {
+            log << "Register tier unavailable (" << reason << "), using stack VM\n";
+        }
+    } else if (tier == ExecutionTier::TRACE && !vm->enableTracing()) {
+        log << "Tracing JIT unavailable on this platform, using stack VM\n";
+    }
+    if (tier == ExecutionTier::CLOSURE) vm->enableClosureTier();
+    if (tier == ExecutionTier::AOT) {
+        std::string reason;
+        if (!vm->enableAot(reason)) {
+            log << "AOT backend unavailable (" << reason << "), using stack VM\n";
+        }
+    }
+    if (profiling) vm->enableProfiling();
+    if (sampling) {
+        vm->enableSampling();
+        vm->setSourceLines(lines);
+    }
     vm->run();
+    if (capture) vm->setOutputCapture(nullptr);
+    output = notes.str() + printed + "Program completed execution.\n";
     state = ProgramState::TERMINATED;
-    output = "Program completed execution.\n";
     return true;
 }
 
-ProgramManager::ProgramManager() : nextPid(1) {}
+ProgramManager::ProgramManager()
+    : nextPid(1), cache(COMPILER_VERSION), cursor(0), quantum(DEFAULT_QUANTUM), stopping(false) {}
+
+// Programs still scheduled are abandoned mid-run
+ProgramManager::~ProgramManager() {
+    {
+        std::lock_guard<std::mutex> guard(schedLock);
+        stopping = true;
+    }
+    schedWake.notify_all();
+    for (std::thread& t : schedulers) t.join();
+}
 
-ProgramID ProgramManager::submitProgram(const std::string& filename) {
+ProgramID ProgramManager::submitProgram(const std::string& filename, ExecutionTier tier, bool lineOutput) {
     ProgramID pid = nextPid++;
     auto prog = std::make_unique<Program>(pid, filename);
-    if (!prog->loadAndParse() || !prog->compile()) {
-        programs[pid] = std::move(prog);
-        return pid;
-    }
+    prog->tier = tier;
+    prog->lineOutput = lineOutput;
+    build(prog.get());
     programs[pid] = std::move(prog);
     return pid;
 }
 
+std::vector<ProgramID> ProgramManager::submitPrograms(const std::vector<std::string>& filenames, ExecutionTier tier,
+                                                      bool lineOutput, size_t jobs) {
+    std::vector<ProgramID> pids;
+    std::vector<Program*> batch;
+    for (const std::string& filename : filenames) {
+        ProgramID pid = nextPid++;
+        auto prog = std::make_unique<Program>(pid, filename);
+        prog->tier = tier;
+        prog->lineOutput = lineOutput;
+        batch.push_back(prog.get());
+        programs[pid] = std::move(prog);
+        pids.push_back(pid);
+    }
+    if (jobs == 0) jobs = std::max(1u, std::thread::hardware_concurrency());
+    jobs = std::min(jobs, std::max<size_t>(batch.size(), 1));
+
+    // Each task touches only its own Program and the cache; the shell thread waits
+    ThreadPool pool(jobs);
+    for (Program* prog : batch) pool.submit([this, prog] { build(prog); });
+    pool.wait();
+    return pids;
+}
+
+// Loads a .byc file, or reads the source and takes it from the cache or
+// parses and compiles it. Safe to run for several programs at once.
+void ProgramManager::build(Program* prog) {
+    const std::string& filename = prog->sourceFile;
+    const bool compiled = filename.size() > 4 && filename.compare(filename.size() - 4, 4, ".byc") == 0;
+    if (compiled) {
+        prog->loadBytecode();
+    } else if (prog->loadSource()) {
+        BytecodeFile file;
+        if (cache.lookup(prog->sourceCode, file)) {
+            // Unchanged since some shell compiled it: no parse, no codegen
+            prog->setCompiled(file);
+        } else if (prog->parse() && prog->compile()) {
+            file.code = prog->bytecode;
+            file.lines = prog->lines;
+            file.symbols = prog->symbols;
+            cache.store(prog->sourceCode, file);
+        }
+    }
+}
+
 bool ProgramManager::runProgram(ProgramID pid) {
     Program* prog = getProgram(pid);
     if (!prog || prog->state != ProgramState::COMPILED) return false;
@@ -260,11 +378,134 @@ bool ProgramManager::runProgram(ProgramID pid) {
     return success;
 }
 
+int ProgramManager::runAll(size_t jobs) {
+    std::vector<Program*> batch;
+    for (const auto& [pid, prog] : programs) {
+        if (prog->state == ProgramState::COMPILED) batch.push_back(prog.get());
+    }
+    if (batch.empty()) {
+        std::cout << "No compiled programs to run\n";
+        return 0;
+    }
+    if (jobs == 0) jobs = std::max(1u, std::thread::hardware_concurrency());
+    jobs = std::min(jobs, batch.size());
+
+    // Each task touches only its own Program; the shell thread waits
+    std::vector<double> elapsed(batch.size());
+    long long steals = 0;
+    auto start = std::chrono::steady_clock::now();
+    {
+        ThreadPool pool(jobs);
+        for (size_t i = 0; i < batch.size(); i++) {
+            pool.submit([&batch, &elapsed, i] {
+                auto begin = std::chrono::steady_clock::now();
+                batch[i]->execute(true);
+                elapsed[i] = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - begin).count();
+            });
+        }
+        pool.wait();
+        steals = pool.getStealCount();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::ios::fmtflags flags = std::cout.flags();
+    std::streamsize precision = std::cout.precision();
+    long long instructions = 0;
+    for (size_t i = 0; i < batch.size(); i++) {
+        Program* prog = batch[i];
+        std::cout << "--- PID " << prog->pid << ": " << prog->sourceFile << " ---\n" << prog->output;
+        if (!prog->vm) continue;
+        instructions += prog->vm->getInstructionCount();
+        std::cout << prog->vm->getInstructionCount() << " instructions in " << std::fixed
+                  << std::setprecision(2) << elapsed[i] << " ms";
+        if (prog->vm->getTrap() != VMTrap::NONE) std::cout << " (" << VM::getTrapName(prog->vm->getTrap()) << ")";
+        std::cout << "\n";
+    }
+    std::cout << "\n=== runall: " << batch.size() << " programs on " << jobs << " threads ("
+              << steals << " stolen) in " << std::setprecision(2) << seconds * 1000 << " ms ===\n"
+              << "Throughput: " << std::setprecision(1) << batch.size() / seconds << " programs/s, "
+              << std::setprecision(0) << instructions / seconds << " instructions/s\n";
+    std::cout.flags(flags);
+    std::cout.precision(precision);
+    return (int)batch.size();
+}
+
+// Runs a compiled program with the profiler on, then reports its hottest
+// opcodes and instructions. A program already run without it cannot be
+// profiled after the fact.
+bool ProgramManager::profileProgram(ProgramID pid) {
+    Program* prog = getProgram(pid);
+    if (!prog) return false;
+    if (prog->state == ProgramState::COMPILED) {
+        prog->profiling = true;
+        if (!prog->execute()) return false;
+        prog->vm->printStats();
+    }
+    if (!prog->vm || !prog->vm->isProfiling()) {
+        std::cout << "Program " << pid << " has already run without profiling\n";
+        return false;
+    }
+    prog->vm->printProfile();
+    return true;
+}
+
+// Runs a compiled program under the SIGPROF sampler and writes its folded
+// stacks (flamegraph.pl input) to foldedFile, or to stdout when it is empty.
+bool ProgramManager::sampleProgram(ProgramID pid, const std::string& foldedFile) {
+    Program* prog = getProgram(pid);
+    if (!prog) return false;
+    if (prog->state == ProgramState::COMPILED) {
+        prog->sampling = true;
+        if (!prog->execute()) return false;
+        prog->vm->printStats();
+    }
+    if (!prog->vm || !prog->vm->isSampling()) {
+        std::cout << "Program " << pid << " has already run without sampling\n";
+        return false;
+    }
+    if (foldedFile.empty()) {
+        prog->vm->writeFoldedStacks(std::cout);
+        return true;
+    }
+    std::ofstream out(foldedFile);
+    if (!out) {
+        std::cout << "Cannot write " << foldedFile << "\n";
+        return false;
+    }
+    prog->vm->writeFoldedStacks(out);
+    std::cout << prog->vm->getSampleCount() << " samples written to " << foldedFile << "\n";
+    return true;
+}
+
+// The bytecode never changes once compiled, so a running program can be saved
+bool ProgramManager::saveProgram(ProgramID pid, const std::string& path) {
+    Program* prog = getProgram(pid);
+    if (!prog || prog->bytecode.empty()) return false;
+    BytecodeFile file;
+    file.code = prog->bytecode;
+    file.lines = prog->lines;
+    file.symbols = prog->symbols;
+    std::string error;
+    if (!writeBytecodeFile(path, file, error)) {
+        std::cout << error << "\n";
+        return false;
+    }
+    std::cout << "PID " << pid << " saved to " << path << " (" << file.code.size() << " words)\n";
+    return true;
+}
+
 bool ProgramManager::debugProgram(ProgramID pid, const std::string& command, const std::vector<std::string>& args) {
     (void)args;
     Program* prog = getProgram(pid);
     if (!prog) return false;
+    if (prog->state == ProgramState::RUNNING || prog->state == ProgramState::PAUSED) {
+        std::cout << "PID " << pid << " is running under the scheduler; kill it first\n";
+        return false;
+    }
     if (!prog->vm) prog->vm = std::make_unique<VM>(prog->bytecode);
+    // Stepping shows each line as it is printed
+    prog->vm->setLineBuffered(true);
 
     if (command == "step") {
         prog->vm->executeNext();
@@ -300,6 +541,20 @@ bool ProgramManager::debugProgram(ProgramID pid, const std::string& command, con
         }
     }else if (command == "info") {
         prog->vm->printStats();
+    } else if (command == "checkpoint") {
+        prog->checkpoint = prog->vm->fork();
+        std::cout << "Checkpoint at PC " << prog->checkpoint->getPC() << " ("
+                  << prog->checkpoint->getInstructionCount() << " instructions, "
+                  << prog->checkpoint->getSharedObjectCount() << " heap objects shared)\n";
+    } else if (command == "restore") {
+        if (!prog->checkpoint) {
+            std::cout << "No checkpoint; take one with 'checkpoint'\n";
+            return false;
+        }
+        // Forked again, so the same checkpoint can be restored repeatedly
+        prog->vm = prog->checkpoint->fork();
+        std::cout << "Restored to PC " << prog->vm->getPC() << " ("
+                  << prog->vm->getInstructionCount() << " instructions)\n";
     }
     else if (command == "continue") {
         prog->vm->run();
@@ -317,46 +572,336 @@ bool ProgramManager::debugProgram(ProgramID pid, const std::string& command, con
             }
             printf("\n");
         }
+        const Verification& v = prog->vm->getVerification();
+        if (v.maxDepth >= 0) {
+            printf("Stack bound: %d values, %d nested calls (%s, %zu slots allocated)\n", v.maxDepth,
+                   v.maxCallDepth, prog->vm->isChecked() ? "checked" : "unchecked",
+                   prog->vm->getStackCapacity());
+        } else {
+            printf("Stack bound: unknown (checked, %zu slots allocated, growable)\n",
+                   prog->vm->getStackCapacity());
+        }
+    } else if (command == "regcode") {
+        std::string reason;
+        if (!prog->vm->hasRegisterTier() && !prog->vm->enableRegisterTier(reason)) {
+            std::cout << "Register tier unavailable (" << reason << ")\n";
+        } else {
+            prog->vm->printRegisterCode();
+        }
     } else if (command == "ast") {
         if (prog->ast) print_ast(prog->ast, 0);
+        else std::cout << "No AST: PID " << pid << " was loaded as compiled bytecode\n";
     }
     return true;
 }
 
 void ProgramManager::memstat(ProgramID pid) {
     Program* prog = getProgram(pid);
-    if (prog && prog->vm) prog->vm->printHeapStatus();
+    if (!prog) return;
+    std::lock_guard<std::mutex> hold(prog->lock);
+    if (prog->vm) prog->vm->printHeapStatus();
 }
 
 void ProgramManager::gc(ProgramID pid) {
     Program* prog = getProgram(pid);
-    if (prog && prog->vm) prog->vm->gc();
+    if (!prog) return;
+    std::lock_guard<std::mutex> hold(prog->lock);
+    if (prog->vm) prog->vm->gc();
 }
 
 void ProgramManager::leaks(ProgramID pid) {
     Program* prog = getProgram(pid);
-    if (prog && prog->vm) {
+    if (!prog) return;
+    std::lock_guard<std::mutex> hold(prog->lock);
+    if (prog->vm) {
         std::cout << "Active Objects: " << prog->vm->getObjectCount() << "\n";
     }
 }
 
+void ProgramManager::printCacheStats() const {
+    CompileCache::Usage u = cache.usage();
+    std::ios::fmtflags flags = std::cout.flags();
+    std::streamsize precision = std::cout.precision();
+    std::cout << "Bytecode cache: " << cache.getDir()
+              << (cache.isUsable() ? "" : " (disabled: " + cache.getError() + ")") << "\n"
+              << "  Entries: " << u.entries << " (" << std::fixed << std::setprecision(1)
+              << u.bytes / 1024.0 << " KB of " << (cache.getLimit() >> 20) << " MB)\n"
+              << "  Hits: " << cache.getHits() << ", misses: " << cache.getMisses()
+              << ", evictions: " << cache.getEvictions() << "\n";
+    std::cout.flags(flags);
+    std::cout.precision(precision);
+}
+
+void ProgramManager::clearCache() {
+    std::cout << cache.clear() << " cached programs removed\n";
+}
+
 void ProgramManager::listPrograms() const {
     for (const auto& [pid, prog] : programs) {
-        std::cout << "PID " << pid << " [" << getProgramState(pid) << "]: " << prog->sourceFile << "\n";
+        std::cout << "PID " << pid << " [" << getProgramState(pid) << "]: " << prog->sourceFile
+                  << (prog->tier == ExecutionTier::REGISTER ? " (register tier)"
+                      : prog->tier == ExecutionTier::TRACE ? " (tracing JIT)"
+                      : prog->tier == ExecutionTier::CLOSURE ? " (closures)"
+                      : prog->tier == ExecutionTier::AOT ? " (AOT)" : "") << "\n";
     }
 }
+// A scheduled program is stopped between two slices: at most one quantum
 bool ProgramManager::killProgram(ProgramID pid) {
     Program* prog = getProgram(pid);
     if (!prog) return false;
 
-    if (prog->vm) {
-        prog->vm->stop();
+    {
+        std::lock_guard<std::mutex> hold(prog->lock);
+        if (prog->vm) {
+            prog->vm->stop();
+            prog->vm->setOutputCapture(nullptr);
+        }
+        prog->state = ProgramState::TERMINATED;
     }
-    
-    prog->state = ProgramState::TERMINATED;
+    // The shell reports the kill itself; it is no longer a job
+    prog->reaped = true;
+    prog->announced = true;
+    {
+        std::lock_guard<std::mutex> guard(schedLock);
+        jobDone.notify_all();
+    }
+    schedWake.notify_one();
     std::cout << "PID " << pid << " terminated by user.\n";
     return true;
 }
+
+bool ProgramManager::startProgram(ProgramID pid, int priority) {
+    Program* prog = getProgram(pid);
+    if (!prog || priority < 1 || priority > MAX_PRIORITY) return false;
+    ProgramState expected = ProgramState::COMPILED;
+    if (!prog->state.compare_exchange_strong(expected, ProgramState::RUNNING)) return false;
+    {
+        std::lock_guard<std::mutex> hold(prog->lock);
+        prog->vm = std::make_unique<VM>(prog->bytecode);
+        prog->vm->setOutputCapture(&prog->output);
+        prog->vm->setLineBuffered(prog->lineOutput);
+        prog->output.clear();
+        prog->scheduled = true;
+        prog->reaped = false;
+        prog->announced = false;
+        prog->priority = priority;
+        prog->credits = priority;
+        prog->slices = 0;
+        prog->cpuNanos = 0;
+    }
+    {
+        std::lock_guard<std::mutex> guard(schedLock);
+        runQueue.push_back(prog);
+        if (schedulers.empty()) {
+            unsigned workers = std::max(1u, std::thread::hardware_concurrency());
+            for (unsigned i = 0; i < workers; i++) schedulers.emplace_back(&ProgramManager::schedulerLoop, this);
+        }
+    }
+    schedWake.notify_one();
+    return true;
+}
+
+bool ProgramManager::pauseProgram(ProgramID pid) {
+    Program* prog = getProgram(pid);
+    if (!prog || !prog->scheduled) return false;
+    ProgramState expected = ProgramState::RUNNING;
+    return prog->state.compare_exchange_strong(expected, ProgramState::PAUSED);
+}
+
+bool ProgramManager::resumeProgram(ProgramID pid) {
+    Program* prog = getProgram(pid);
+    if (!prog || !prog->scheduled) return false;
+    ProgramState expected = ProgramState::PAUSED;
+    if (!prog->state.compare_exchange_strong(expected, ProgramState::RUNNING)) return false;
+    schedWake.notify_one();
+    return true;
+}
+
+bool ProgramManager::setPriority(ProgramID pid, int priority) {
+    Program* prog = getProgram(pid);
+    if (!prog || priority < 1 || priority > MAX_PRIORITY) return false;
+    std::lock_guard<std::mutex> guard(schedLock);
+    std::lock_guard<std::mutex> hold(prog->lock);
+    prog->priority = priority;
+    prog->credits = std::min(prog->credits, priority);
+    return true;
+}
+
+void ProgramManager::setQuantum(long long instructions) {
+    std::lock_guard<std::mutex> guard(schedLock);
+    quantum = std::max(1LL, instructions);
+}
+
+long long ProgramManager::getQuantum() {
+    std::lock_guard<std::mutex> guard(schedLock);
+    return quantum;
+}
+
+// Next RUNNING program with credits left that no other worker is running,
+// round-robin from cursor. When all have spent theirs a new round starts;
+// finished and killed programs leave the queue. Called with schedLock held.
+Program* ProgramManager::pickNext() {
+    runQueue.erase(std::remove_if(runQueue.begin(), runQueue.end(), [](Program* p) {
+        return p->state != ProgramState::RUNNING && p->state != ProgramState::PAUSED;
+    }), runQueue.end());
+    for (int round = 0; round < 2; round++) {
+        for (size_t i = 0; i < runQueue.size(); i++) {
+            Program* p = runQueue[(cursor + i) % runQueue.size()];
+            if (p->state != ProgramState::RUNNING || p->inSlice || p->credits == 0) continue;
+            p->credits--;
+            // Stay on p until its credits are spent, then move past it
+            cursor = (cursor + i + (p->credits == 0 ? 1 : 0)) % runQueue.size();
+            return p;
+        }
+        for (Program* p : runQueue) p->credits = p->priority;
+    }
+    return nullptr;
+}
+
+void ProgramManager::schedulerLoop() {
+    std::unique_lock<std::mutex> guard(schedLock);
+    while (!stopping) {
+        Program* prog = pickNext();
+        if (!prog) {
+            schedWake.wait(guard);
+            continue;
+        }
+        const long long budget = quantum;
+        prog->inSlice = true;
+        guard.unlock();
+        {
+            std::lock_guard<std::mutex> hold(prog->lock);
+            // Paused or killed since it was picked
+            if (prog->state == ProgramState::RUNNING) {
+                auto begin = std::chrono::steady_clock::now();
+                bool more = prog->vm->runSlice(budget);
+                prog->cpuNanos += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - begin).count();
+                prog->slices++;
+                if (!more) {
+                    prog->vm->setOutputCapture(nullptr);
+                    prog->output += "Program completed execution.\n";
+                    prog->state = ProgramState::TERMINATED;
+                }
+            }
+        }
+        guard.lock();
+        prog->inSlice = false;
+        // Finished, or killed while in the slice: waiters may go on
+        if (prog->state != ProgramState::RUNNING) jobDone.notify_all();
+    }
+}
+
+void ProgramManager::listJobs() {
+    bool any = false;
+    for (const auto& [pid, prog] : programs) {
+        if (!prog->scheduled || prog->reaped) continue;
+        std::string state = getProgramState(pid);
+        long long instructions;
+        {
+            std::lock_guard<std::mutex> hold(prog->lock);
+            instructions = prog->vm->getInstructionCount();
+        }
+        std::cout << "[" << pid << "] " << std::left << std::setw(11)
+                  << (state == "TERMINATED" ? "DONE" : state) << std::right << prog->sourceFile
+                  << " (" << instructions << " instructions)\n";
+        any = true;
+    }
+    if (!any) std::cout << "No jobs\n";
+}
+
+// Until the worker running it has seen it leave RUNNING
+void ProgramManager::awaitJob(Program* prog) {
+    std::unique_lock<std::mutex> guard(schedLock);
+    jobDone.wait(guard, [prog] { return prog->state != ProgramState::RUNNING && !prog->inSlice; });
+}
+
+bool ProgramManager::waitProgram(ProgramID pid) {
+    Program* prog = getProgram(pid);
+    if (!prog || !prog->scheduled || prog->reaped) return false;
+    if (prog->state == ProgramState::PAUSED) {
+        std::cout << "PID " << pid << " is paused\n";
+        return false;
+    }
+    awaitJob(prog);
+    std::cout << getProgramOutput(pid);
+    prog->reaped = true;
+    prog->announced = true;
+    return true;
+}
+
+void ProgramManager::waitAll() {
+    for (const auto& [pid, prog] : programs) {
+        if (prog->scheduled && !prog->reaped && prog->state != ProgramState::PAUSED) waitProgram(pid);
+    }
+}
+
+bool ProgramManager::foregroundProgram(ProgramID pid) {
+    Program* prog = getProgram(pid);
+    if (!prog || !prog->scheduled || prog->reaped) return false;
+    size_t shown;
+    {
+        std::lock_guard<std::mutex> hold(prog->lock);
+        std::cout << prog->output << std::flush;
+        shown = prog->output.size();
+        if (prog->state == ProgramState::RUNNING || prog->state == ProgramState::PAUSED) {
+            prog->vm->setOutputCapture(nullptr);
+        }
+    }
+    resumeProgram(pid);
+    awaitJob(prog);
+    std::cout << getProgramOutput(pid).substr(shown);
+    prog->reaped = true;
+    prog->announced = true;
+    return true;
+}
+
+std::vector<ProgramID> ProgramManager::collectFinished() {
+    std::vector<ProgramID> done;
+    for (const auto& [pid, prog] : programs) {
+        if (!prog->scheduled || prog->announced || prog->state != ProgramState::TERMINATED) continue;
+        // Announced once, then no longer a job, as shells drop a "Done" job
+        prog->reaped = true;
+        prog->announced = true;
+        done.push_back(pid);
+    }
+    return done;
+}
+
+void ProgramManager::printSchedule() {
+    std::vector<Program*> shown;
+    for (const auto& [pid, prog] : programs) {
+        if (prog->scheduled) shown.push_back(prog.get());
+    }
+    if (shown.empty()) {
+        std::cout << "No scheduled programs\n";
+        return;
+    }
+    struct Row { ProgramID pid; std::string state; int priority; long long slices, instructions, nanos; };
+    std::vector<Row> rows;
+    long long total = 0;
+    for (Program* prog : shown) {
+        std::string state = getProgramState(prog->pid);
+        std::lock_guard<std::mutex> hold(prog->lock);
+        rows.push_back({prog->pid, state, prog->priority, prog->slices,
+                        prog->vm->getInstructionCount(), prog->cpuNanos});
+        total += prog->cpuNanos;
+    }
+    std::ios::fmtflags flags = std::cout.flags();
+    std::streamsize precision = std::cout.precision();
+    std::cout << "Quantum: " << getQuantum() << " instructions\n"
+              << std::left << std::setw(6) << "PID" << std::setw(12) << "STATE" << std::right
+              << std::setw(5) << "PRI" << std::setw(10) << "SLICES" << std::setw(14) << "INSTRUCTIONS"
+              << std::setw(10) << "CPU ms" << std::setw(8) << "SHARE" << "\n";
+    for (const Row& r : rows) {
+        std::cout << std::left << std::setw(6) << r.pid << std::setw(12) << r.state << std::right
+                  << std::setw(5) << r.priority << std::setw(10) << r.slices << std::setw(14) << r.instructions
+                  << std::setw(10) << std::fixed << std::setprecision(1) << r.nanos / 1e6
+                  << std::setw(7) << (total ? 100.0 * r.nanos / total : 0.0) << "%\n";
+    }
+    std::cout.flags(flags);
+    std::cout.precision(precision);
+}
 std::string ProgramManager::getProgramState(ProgramID pid) const {
     auto it = programs.find(pid);
     if (it == programs.end()) return "NONE";
@@ -365,6 +910,7 @@ std::string ProgramManager::getProgramState(ProgramID pid) const {
         case ProgramState::PARSED: return "PARSED";
         case ProgramState::COMPILED: return "COMPILED";
         case ProgramState::RUNNING: return "RUNNING";
+        case ProgramState::PAUSED: return "PAUSED";
         case ProgramState::TERMINATED: return "TERMINATED";
         case ProgramState::ERROR: return "ERROR";
         default: return "UNKNOWN";
@@ -373,7 +919,21 @@ std::string ProgramManager::getProgramState(ProgramID pid) const {
 
 std::string ProgramManager::getProgramOutput(ProgramID pid) const {
     auto it = programs.find(pid);
-    return (it != programs.end()) ? it->second->output : "";
+    if (it == programs.end()) return "";
+    std::lock_guard<std::mutex> hold(it->second->lock);
+    return it->second->output;
+}
+
+std::string ProgramManager::getProgramFile(ProgramID pid) const {
+    auto it = programs.find(pid);
+    return (it != programs.end()) ? it->second->sourceFile : "";
+}
+
+long long ProgramManager::getInstructionCount(ProgramID pid) const {
+    auto it = programs.find(pid);
+    if (it == programs.end()) return 0;
+    std::lock_guard<std::mutex> hold(it->second->lock);
+    return it->second->vm ? it->second->vm->getInstructionCount() : 0;
 }
 
 Program* ProgramManager::getProgram(ProgramID pid) {
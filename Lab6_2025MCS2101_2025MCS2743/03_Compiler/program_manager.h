@@ -2,9 +2,13 @@
 #define PROGRAM_MANAGER_H
 
 #include <string>
+#include <atomic>
 #include <map>
 #include <memory>
 #include <vector>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
 #include <fstream>
 #include <sstream>
 
@@ -13,6 +17,7 @@ extern "C" {
     #include "ast.h"
 }
 #include "VirtualMachine.h"
+#include "compile_cache.h"
 
 typedef int ProgramID;
 
@@ -26,10 +31,25 @@ enum class ProgramState {
     ERROR
 };
 
+// How Program::execute runs the bytecode; the stack VM is always the fallback
+enum class ExecutionTier {
+    STACK,
+    REGISTER,
+    TRACE,
+    CLOSURE,
+    AOT
+};
+
+// Bump whenever IRGenerator's output or the opcode numbering changes, so
+// programs compiled by an older build miss the bytecode cache
+const uint32_t COMPILER_VERSION = 1;
+
 // IR Generator - Lab 3
 class IRGenerator {
 private:
     std::vector<int32_t> bytecode;
+    std::vector<int32_t> lines;     // source line per bytecode word, 0 if unknown
+    int currentLine;
     std::map<std::string, int> variables;
     int nextVarIndex;
     int labelCounter;
@@ -51,6 +71,9 @@ private:
 public:
     IRGenerator();
     std::vector<int32_t> generate(ASTNode* root);
+    const std::vector<int32_t>& getLines() const { return lines; }
+    // Variable names by memory slot
+    std::vector<std::string> getSymbols() const;
 };
 
 // Program representation
@@ -59,35 +82,122 @@ public:
     ProgramID pid;
     std::string sourceFile;
     std::string sourceCode;
-    ProgramState state;
+    // Atomic: runall workers and the scheduler move programs through
+    // RUNNING (and PAUSED) while the shell reads it
+    std::atomic<ProgramState> state;
     ASTNode* ast;
 
     std::vector<int32_t> bytecode;
+    std::vector<int32_t> lines;
+    std::vector<std::string> symbols;
     
     std::unique_ptr<VM> vm;
+    std::unique_ptr<VM> checkpoint;     // debugger snapshot, forked from vm
     
     std::string errorMessage;
     std::string output;
+    ExecutionTier tier;
+    bool profiling;
+    bool sampling;
+    bool lineOutput;    // write PRINT output line by line instead of batched
+
+    // Time-sliced runs. A scheduler worker holds lock while a slice runs;
+    // the shell takes it before touching vm or output of a scheduled program.
+    std::mutex lock;
+    bool scheduled;     // started in the background: a job until reaped
+    bool inSlice;       // a worker is running it (guarded by schedLock)
+    bool reaped;        // waited for, brought to the foreground, killed or announced
+    bool announced;     // its "Done" notice was shown
+    int priority;       // slices per scheduling round
+    int credits;        // slices left in the current round
+    long long slices;
+    long long cpuNanos;
     
     Program(ProgramID id, const std::string& file);
     ~Program();
     
-    bool loadAndParse();
+    // Reads sourceFile into sourceCode
+    bool loadSource();
+    // sourceCode to ast; thread-safe
+    bool parse();
+    // A .byc file (container or raw) instead of source: COMPILED on success
+    bool loadBytecode();
+    // Takes compiled code, read from a .byc file or the cache: COMPILED
+    void setCompiled(BytecodeFile& file);
     bool compile();
-    bool execute();
+    // capture keeps everything the run prints in output instead of stdout
+    bool execute(bool capture = false);
 };
 
 class ProgramManager {
 private:
     std::map<ProgramID, std::unique_ptr<Program>> programs;
     ProgramID nextPid;
+    CompileCache cache;     // compiled sources, shared with other shells
+
+    // Time-sliced scheduler: worker threads (one per core) run the RUNNING
+    // programs of runQueue a quantum at a time, weighted round-robin
+    std::vector<std::thread> schedulers;
+    std::mutex schedLock;               // guards runQueue, cursor, quantum, stopping
+    std::condition_variable schedWake;
+    std::condition_variable jobDone;    // a started program left RUNNING
+    std::vector<Program*> runQueue;
+    size_t cursor;
+    long long quantum;
+    bool stopping;
     
 public:
+    static const long long DEFAULT_QUANTUM = 50000;
+    static const int DEFAULT_PRIORITY = 1;
+    static const int MAX_PRIORITY = 10;
+
     ProgramManager();
+    ~ProgramManager();
    
-    ProgramID submitProgram(const std::string& filename);
+    ProgramID submitProgram(const std::string& filename, ExecutionTier tier = ExecutionTier::STACK,
+                            bool lineOutput = false);
+    // Submits every file, PIDs in order, parsing and compiling them in
+    // parallel on `jobs` threads (0: one per core)
+    std::vector<ProgramID> submitPrograms(const std::vector<std::string>& filenames,
+                                          ExecutionTier tier = ExecutionTier::STACK,
+                                          bool lineOutput = false, size_t jobs = 0);
     bool runProgram(ProgramID pid);
+    // Runs every COMPILED program concurrently on `jobs` threads (0: one per
+    // core); returns how many ran
+    int runAll(size_t jobs = 0);
+    bool profileProgram(ProgramID pid);
+    bool sampleProgram(ProgramID pid, const std::string& foldedFile);
+    // Writes the compiled program as a .byc container with its line table
+    // and variable names; submit loads it back without parsing
+    bool saveProgram(ProgramID pid, const std::string& path);
     bool killProgram(ProgramID pid);
+    // Location, size, hits and misses of the compiled-bytecode cache
+    void printCacheStats() const;
+    void clearCache();
+
+    // Starts a COMPILED program under the scheduler and returns at once. Its
+    // output is kept in the program. A program of priority p gets p quanta
+    // per round; PAUSED programs get none until resumed.
+    bool startProgram(ProgramID pid, int priority = DEFAULT_PRIORITY);
+    bool pauseProgram(ProgramID pid);
+    bool resumeProgram(ProgramID pid);
+    bool setPriority(ProgramID pid, int priority);
+    void setQuantum(long long instructions);
+    long long getQuantum();
+    // Slices, instructions, CPU time and CPU share of scheduled programs
+    void printSchedule();
+
+    // Job control over started programs (start, or run <pid> &)
+    void listJobs();
+    // Blocks until the program is no longer RUNNING, then prints its output
+    bool waitProgram(ProgramID pid);
+    void waitAll();
+    // Prints its output so far, resumes it if paused and lets it print
+    // straight to the terminal until it finishes
+    bool foregroundProgram(ProgramID pid);
+    // Started programs that finished since the last call; they leave the
+    // job list, though their output stays readable
+    std::vector<ProgramID> collectFinished();
 
     bool debugProgram(ProgramID pid, const std::string& command, 
                      const std::vector<std::string>& args);
@@ -100,9 +210,16 @@ public:
     void listPrograms() const;
     std::string getProgramState(ProgramID pid) const;
     std::string getProgramOutput(ProgramID pid) const;
+    std::string getProgramFile(ProgramID pid) const;
+    // Instructions its VM has executed so far, 0 before it first runs
+    long long getInstructionCount(ProgramID pid) const;
     
 private:
     Program* getProgram(ProgramID pid);
+    void build(Program* prog);
+    void schedulerLoop();
+    Program* pickNext();
+    void awaitJob(Program* prog);
 };
 
 #endif
@@ -0,0 +1,322 @@
+#include <iostream>
+#include <cassert>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <thread>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "thread_pool.h"
+#include "program_manager.h"
+#include "compile_cache.h"
+
+using namespace std;
+
+// Sources and caches of the run live here; removed at exit
+static string workDir;
+
+void runTest(const string& name, void (*testFunc)()) {
+    cout << "\n==================================================" << endl;
+    cout << "COMPILER TEST: " << name << endl;
+    cout << "==================================================" << endl;
+
+    try {
+        testFunc();
+        cout << ">>> RESULT: PASSED" << endl;
+    } catch (...) {
+        cout << ">>> RESULT: FAILED" << endl;
+        exit(1);
+    }
+}
+
+void testThreadPoolStress() {
+    const int TASKS = 5000;
+    vector<atomic<int>> runs(TASKS);
+    for (atomic<int>& r : runs) r = 0;
+    ThreadPool pool(4);
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < TASKS; i++) {
+            // Mostly tiny tasks with a few long ones, so workers go idle and steal
+            pool.submit([&runs, i] {
+                if (i % 500 == 0) this_thread::sleep_for(chrono::milliseconds(2));
+                else if (i % 7 == 0) this_thread::yield();
+                runs[i]++;
+            });
+        }
+        pool.wait();
+        for (int i = 0; i < TASKS; i++) assert(runs[i] == round + 1);
+    }
+    cout << "   [Check] " << 3 * TASKS << " uneven tasks on " << pool.size() << " workers each ran exactly once ("
+         << pool.getStealCount() << " steals)." << endl;
+
+    // Tasks may still be queued when the pool is destroyed; all of them run
+    atomic<int> done(0);
+    {
+        ThreadPool shortLived(4);
+        for (int i = 0; i < 1000; i++) shortLived.submit([&done] { done++; });
+    }
+    assert(done == 1000);
+    cout << "   [Check] Destroying the pool finishes the queued tasks." << endl;
+}
+
+string writeSource(const string& name, const string& text) {
+    string path = workDir + "/" + name;
+    ofstream(path) << text;
+    return path;
+}
+
+void waitFor(const function<bool()>& done) {
+    auto deadline = chrono::steady_clock::now() + chrono::seconds(10);
+    while (!done()) {
+        assert(chrono::steady_clock::now() < deadline);
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+}
+
+// What fn writes to fd 1, where the VM prints once it is not capturing
+string captureStdout(const function<void()>& fn) {
+    string path = workDir + "/stdout.txt";
+    cout.flush();
+    int saved = dup(1);
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    assert(saved >= 0 && fd >= 0);
+    dup2(fd, 1);
+    close(fd);
+    fn();
+    cout.flush();
+    dup2(saved, 1);
+    close(saved);
+    stringstream text;
+    text << ifstream(path).rdbuf();
+    return text.str();
+}
+
+// IRGenerator compiles only < of the comparisons, so the condition uses it
+const char* INFINITE_LOOP = "var i = 0;\nwhile (0 < 1) {\n    i = i + 1;\n}\n";
+
+void testKillJob() {
+    ProgramManager pm;
+    ProgramID pid = pm.submitProgram(writeSource("forever.lang", INFINITE_LOOP));
+    assert(pm.getProgramState(pid) == "COMPILED");
+    assert(pm.startProgram(pid));
+    waitFor([&] { return pm.getInstructionCount(pid) > 1000; });
+    assert(pm.getProgramState(pid) == "RUNNING");
+    assert(pm.killProgram(pid));
+    assert(pm.getProgramState(pid) == "TERMINATED");
+    long long stopped = pm.getInstructionCount(pid);
+    this_thread::sleep_for(chrono::milliseconds(50));
+    assert(pm.getInstructionCount(pid) == stopped);
+    // The kill is reported by the shell, not as a finished job
+    assert(pm.collectFinished().empty());
+    cout << "   [Check] Killed an infinite loop after " << stopped << " instructions; it stays TERMINATED." << endl;
+}
+
+void testWaitJob() {
+    ProgramManager pm;
+    ProgramID pid = pm.submitProgram(writeSource("count.lang",
+        "var i = 0;\nwhile (i < 3) {\n    i = i + 1;\n    print i;\n}\n"));
+    assert(pm.startProgram(pid));
+    string shown = captureStdout([&] { assert(pm.waitProgram(pid)); });
+    const string expected = "Output : 1\nOutput : 2\nOutput : 3\nProgram completed execution.\n";
+    assert(pm.getProgramState(pid) == "TERMINATED");
+    assert(pm.getProgramOutput(pid) == expected);
+    assert(shown == expected);
+    // Waited for, so never announced as Done
+    assert(pm.collectFinished().empty());
+    cout << "   [Check] wait returned the captured output: 1 2 3." << endl;
+}
+
+void testDoneAnnouncedOnce() {
+    ProgramManager pm;
+    ProgramID pid = pm.submitProgram(writeSource("done.lang", "var x = 6;\nprint x * 7;\n"));
+    assert(pm.startProgram(pid));
+    waitFor([&] { return pm.getProgramState(pid) == "TERMINATED"; });
+    vector<ProgramID> done = pm.collectFinished();
+    assert(done.size() == 1 && done[0] == pid);
+    assert(pm.collectFinished().empty());
+    assert(pm.getProgramOutput(pid) == "Output : 42\nProgram completed execution.\n");
+    // Announced jobs leave the job table
+    string jobs = captureStdout([&] { pm.listJobs(); });
+    assert(jobs == "No jobs\n");
+    assert(!pm.waitProgram(pid));
+    assert(!pm.foregroundProgram(pid));
+    cout << "   [Check] A finished job is reported Done exactly once, then leaves the job list." << endl;
+}
+
+void testWaitPausedJob() {
+    ProgramManager pm;
+    ProgramID pid = pm.submitProgram(writeSource("paused.lang", INFINITE_LOOP));
+    assert(pm.startProgram(pid));
+    assert(pm.pauseProgram(pid));
+    // Returns at once instead of blocking on a job that cannot finish
+    assert(!pm.waitProgram(pid));
+    assert(pm.getProgramState(pid) == "PAUSED");
+    long long paused = pm.getInstructionCount(pid);
+    this_thread::sleep_for(chrono::milliseconds(20));
+    assert(pm.getInstructionCount(pid) == paused);
+    assert(pm.resumeProgram(pid));
+    waitFor([&] { return pm.getInstructionCount(pid) > paused; });
+    assert(pm.killProgram(pid));
+    cout << "   [Check] wait refuses a paused job; it resumes where it stopped." << endl;
+}
+
+void testForegroundJob() {
+    ProgramManager pm;
+    pm.setQuantum(20);
+    ProgramID pid = pm.submitProgram(writeSource("fg.lang",
+        "var i = 0;\nwhile (i < 20000) {\n    i = i + 1;\n}\nprint i;\n"));
+    assert(pm.startProgram(pid));
+    assert(pm.pauseProgram(pid));
+    assert(pm.getProgramOutput(pid).empty());
+    // Resumed by fg; what it prints from then on goes to the terminal
+    string shown = captureStdout([&] { assert(pm.foregroundProgram(pid)); });
+    assert(pm.getProgramState(pid) == "TERMINATED");
+    assert(shown == "Output : 20000\nProgram completed execution.\n");
+    assert(pm.getProgramOutput(pid) == "Program completed execution.\n");
+    assert(pm.collectFinished().empty());
+    assert(!pm.foregroundProgram(pid));
+    cout << "   [Check] fg resumed a paused job and switched its output to the terminal." << endl;
+}
+
+// Every source the same length, so every entry is the same size
+BytecodeFile compiledFor(char tag) {
+    BytecodeFile file;
+    file.code.assign(64, tag);
+    file.lines.assign(64, 1);
+    file.symbols = {string(1, tag)};
+    return file;
+}
+
+string sourceFor(char tag) {
+    return string("var ") + tag + " = 1;\nprint " + tag + ";\n";
+}
+
+// The .byc entries in dir
+vector<string> cacheEntries(const string& dir) {
+    vector<string> paths;
+    DIR* d = opendir(dir.c_str());
+    assert(d);
+    while (struct dirent* e = readdir(d)) {
+        string name = e->d_name;
+        if (name.size() > 4 && name.compare(name.size() - 4, 4, ".byc") == 0) paths.push_back(dir + "/" + name);
+    }
+    closedir(d);
+    return paths;
+}
+
+void testCacheEviction() {
+    // One entry's size, to set a limit that holds two
+    uint64_t entryBytes;
+    {
+        CompileCache probe(workDir + "/probe", 1, 1 << 20);
+        probe.store(sourceFor('a'), compiledFor('a'));
+        entryBytes = probe.usage().bytes;
+        assert(probe.usage().entries == 1 && entryBytes > 0);
+    }
+    CompileCache cache(workDir + "/lru", 1, 2 * entryBytes + entryBytes / 2);
+    assert(cache.isUsable());
+    BytecodeFile file;
+    for (char tag : {'a', 'b', 'c'}) {
+        cache.store(sourceFor(tag), compiledFor(tag));
+        // Entries are ordered by modification time
+        this_thread::sleep_for(chrono::milliseconds(10));
+    }
+    assert(cache.getEvictions() == 1);
+    assert(cache.usage().entries == 2);
+    assert(!cache.lookup(sourceFor('a'), file));
+    assert(cache.lookup(sourceFor('b'), file));
+    assert(file.code == compiledFor('b').code && file.symbols == compiledFor('b').symbols);
+    cout << "   [Check] Three entries over a two-entry limit: the oldest was evicted." << endl;
+
+    // The hit made b recently used, so c goes next
+    this_thread::sleep_for(chrono::milliseconds(10));
+    cache.store(sourceFor('d'), compiledFor('d'));
+    assert(cache.getEvictions() == 2);
+    assert(cache.lookup(sourceFor('b'), file) && cache.lookup(sourceFor('d'), file));
+    assert(!cache.lookup(sourceFor('c'), file));
+    assert(cache.getHits() == 3 && cache.getMisses() == 2);
+    cout << "   [Check] A hit refreshes an entry: the least recently used went next." << endl;
+}
+
+void testCacheDamagedEntry() {
+    CompileCache cache(workDir + "/damaged", 1, 1 << 20);
+    cache.store(sourceFor('a'), compiledFor('a'));
+    vector<string> entries = cacheEntries(cache.getDir());
+    assert(entries.size() == 1);
+    // Flip a byte of the code section, which follows the 32-byte header and
+    // four 16-byte table entries (code, lines, symbols, source)
+    {
+        fstream f(entries[0], ios::in | ios::out | ios::binary);
+        f.seekp(32 + 4 * 16);
+        f.put('\x7f');
+    }
+    BytecodeFile file;
+    assert(!cache.lookup(sourceFor('a'), file));
+    assert(cache.usage().entries == 0);
+    assert(cache.getMisses() == 1);
+    cout << "   [Check] A corrupted entry misses and is removed." << endl;
+
+    // An entry of another source under this source's name misses too
+    cache.store(sourceFor('b'), compiledFor('b'));
+    string other = cacheEntries(cache.getDir())[0];
+    cache.store(sourceFor('a'), compiledFor('a'));
+    for (const string& path : cacheEntries(cache.getDir())) {
+        if (path != other) assert(rename(path.c_str(), other.c_str()) == 0);
+    }
+    assert(!cache.lookup(sourceFor('b'), file));
+    assert(cache.usage().entries == 0);
+    cout << "   [Check] An entry whose stored source differs is a miss." << endl;
+}
+
+void testCacheVersion() {
+    const string dir = workDir + "/versions";
+    CompileCache first(dir, 1, 1 << 20);
+    first.store(sourceFor('a'), compiledFor('a'));
+    BytecodeFile file;
+    CompileCache bumped(dir, 2, 1 << 20);
+    assert(!bumped.lookup(sourceFor('a'), file));
+    assert(first.lookup(sourceFor('a'), file));
+    cout << "   [Check] A new compiler version misses the old entries." << endl;
+
+    // Anyone could have written a shared directory: it is not used
+    const string shared = workDir + "/shared";
+    assert(mkdir(shared.c_str(), 0777) == 0 && chmod(shared.c_str(), 0777) == 0);
+    CompileCache refused(shared, 1, 1 << 20);
+    assert(!refused.isUsable());
+    refused.store(sourceFor('a'), compiledFor('a'));
+    assert(cacheEntries(shared).empty());
+    assert(!refused.lookup(sourceFor('a'), file));
+    cout << "   [Check] A group/other-writable directory is refused: " << refused.getError() << "." << endl;
+}
+
+int main() {
+    cout << "Starting Compiler Test Suite..." << endl;
+
+    char dir[] = "/tmp/test_compiler.XXXXXX";
+    assert(mkdtemp(dir));
+    workDir = dir;
+    setenv("LAB6_BYTECODE_CACHE", (workDir + "/cache").c_str(), 1);
+
+    runTest("Thread Pool Stress", testThreadPoolStress);
+    runTest("Kill Job", testKillJob);
+    runTest("Wait Job", testWaitJob);
+    runTest("Done Announced Once", testDoneAnnouncedOnce);
+    runTest("Wait Paused Job", testWaitPausedJob);
+    runTest("Foreground Job", testForegroundJob);
+    runTest("Cache Eviction", testCacheEviction);
+    runTest("Cache Damaged Entry", testCacheDamagedEntry);
+    runTest("Cache Version", testCacheVersion);
+    system(("rm -rf " + workDir).c_str());
+
+    cout << "\n--------------------------------------------------" << endl;
+    cout << "SUMMARY: All Compiler Tests Passed." << endl;
+    cout << "--------------------------------------------------" << endl;
+    return 0;
+}
@@ -0,0 +1,76 @@
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(size_t count)
+    : queued(0), pending(0), nextWorker(0), stopping(false), steals(0) {
+    if (count == 0) count = 1;
+    for (size_t i = 0; i < count; i++) workers.push_back(std::make_unique<Worker>());
+    for (size_t i = 0; i < count; i++) threads.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> guard(idleLock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& t : threads) t.join();
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    // Counted before the task is visible: a worker may take it as soon as it
+    // is pushed, and take() decrements queued. Under idleLock, so a worker
+    // checking for work cannot miss it.
+    {
+        std::lock_guard<std::mutex> guard(idleLock);
+        queued++;
+        pending++;
+    }
+    Worker& w = *workers[nextWorker++ % workers.size()];
+    {
+        std::lock_guard<std::mutex> guard(w.lock);
+        w.tasks.push_back(std::move(task));
+    }
+    wake.notify_one();
+}
+
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> guard(idleLock);
+    idle.wait(guard, [this] { return pending == 0; });
+}
+
+// Own deque from the back, then the other deques from the front
+bool ThreadPool::take(size_t self, std::function<void()>& task) {
+    const size_t n = workers.size();
+    for (size_t i = 0; i < n; i++) {
+        Worker& w = *workers[(self + i) % n];
+        std::lock_guard<std::mutex> guard(w.lock);
+        if (w.tasks.empty()) continue;
+        if (i == 0) {
+            task = std::move(w.tasks.back());
+            w.tasks.pop_back();
+        } else {
+            task = std::move(w.tasks.front());
+            w.tasks.pop_front();
+            steals++;
+        }
+        queued--;
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::workerLoop(size_t self) {
+    std::function<void()> task;
+    while (true) {
+        if (take(self, task)) {
+            task();
+            task = nullptr;
+            std::lock_guard<std::mutex> guard(idleLock);
+            if (--pending == 0) idle.notify_all();
+            continue;
+        }
+        std::unique_lock<std::mutex> guard(idleLock);
+        wake.wait(guard, [this] { return stopping || queued > 0; });
+        if (stopping && queued == 0) return;
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool. Each worker owns a deque: it runs its own tasks
+// newest first and, once that is empty, steals the oldest task of another
+// worker, so a few long tasks do not leave the rest of the pool idle.
+// Tasks submitted from outside are dealt to the workers round-robin.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t count);
+    // Finishes the queued tasks, then joins the workers
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void submit(std::function<void()> task);
+    // Blocks until every submitted task has run
+    void wait();
+
+    size_t size() const { return workers.size(); }
+    long long getStealCount() const { return steals; }
+
+private:
+    struct Worker {
+        std::mutex lock;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+    std::mutex idleLock;            // guards pending, stopping and the waits below
+    std::condition_variable wake;   // a task was queued, or the pool is stopping
+    std::condition_variable idle;   // pending dropped to 0
+    std::atomic<size_t> queued;     // tasks sitting in a deque
+    size_t pending;                 // tasks submitted and not yet finished
+    size_t nextWorker;
+    bool stopping;
+    std::atomic<long long> steals;
+
+    void workerLoop(size_t self);
+    bool take(size_t self, std::function<void()>& task);
+};
+
+#endif
@@ -0,0 +1,431 @@
+#include "Aot.h"
+#include "Instruction.h"
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+
+#if VM_AOT_AVAILABLE
+#include "CacheDir.h"
+#include <dlfcn.h>
+#include <unistd.h>
+#endif
+
+static const int MEMORY_SLOTS = 1024;
+// Bump whenever the generated code or AotState changes, so old cache entries miss
+static const int AOT_ABI_VERSION = 4;
+
+namespace {
+
+// Host layout, compared with the one the cached object was compiled against
+const int hostLayout[4] = {AOT_ABI_VERSION, (int)sizeof(Value), VM_TAGGED_VALUES, (int)sizeof(AotState)};
+
+// Declarations the generated C shares with the host; Values keep the
+// interpreter's layout, read and built through INT_OF and INT
+#if VM_TAGGED_VALUES
+const char* const VALUE_PRELUDE = R"(#include <stdint.h>
+#include <stddef.h>
+
+typedef struct { uint64_t bits; } Value;
+#define VALUE_TAGGED 1
+#define INT(x) ((Value){(uint64_t)(uint32_t)(x) << 32})
+#define INT_OF(v) ((int32_t)((v).bits >> 32))
+)";
+#else
+const char* const VALUE_PRELUDE = R"(#include <stdint.h>
+#include <stddef.h>
+
+typedef struct { int32_t type; union { int32_t i; void* p; } u; } Value;
+#define VALUE_TAGGED 0
+#define INT(x) ((Value){0, {.i = (x)}})
+#define INT_OF(v) ((v).u.i)
+)";
+#endif
+
+const char* const PRELUDE = R"(
+typedef struct {
+    Value* sp;
+    Value* high;
+    Value* base;
+    Value* limit;
+    Value* memory;
+    long long count;
+    void (*print)(void* output, int32_t value);
+    void* output;
+    const volatile long* tick;
+    int32_t pc;
+} AotState;
+
+#define EXIT(a) do { pc = (a); goto out; } while (0)
+)";
+
+bool validSlot(int32_t idx) {
+    return idx >= 0 && idx < MEMORY_SLOTS;
+}
+
+bool isBranch(int32_t opcode) {
+    return opcode == OP_JMP || opcode == OP_JZ || opcode == OP_JNZ || opcode == OP_CALL;
+}
+
+// Same rule as VM::decodeAt: out-of-range targets run off the end
+int jumpTarget(BytecodeView program, int addr) {
+    int32_t target = program[addr + 1];
+    return (target < 0 || (size_t)target >= program.size()) ? (int)program.size() : target;
+}
+
+// Instructions that end a block: branches, and those left to the interpreter
+bool endsBlock(BytecodeView program, int addr) {
+    int32_t opcode = program[addr];
+    if (opcode == OP_LOAD || opcode == OP_STORE) return !validSlot(program[addr + 1]);
+    return isBranch(opcode) || opcode == OP_RET || opcode == OP_HALT;
+}
+
+// Instruction starts reached by decoding from address 0, with the
+// decoder's rules for invalid instructions
+std::vector<bool> instructionStarts(BytecodeView program) {
+    const int size = (int)program.size();
+    std::vector<bool> starts(size + 1, false);
+    for (int addr = 0; addr < size; ) {
+        int operands = operandCount(program[addr]);
+        if (operands < 0 || addr + operands >= size) break;
+        starts[addr] = true;
+        addr += 1 + operands;
+    }
+    return starts;
+}
+
+// Entry points of the compiled code: address 0, jump and call targets, and
+// the instruction after one that ends a block
+std::vector<bool> blockLeaders(BytecodeView program) {
+    const int size = (int)program.size();
+    std::vector<bool> starts = instructionStarts(program);
+    std::vector<bool> leaders(size + 1, false);
+    leaders[0] = starts[0];
+    for (int addr = 0; starts[addr]; ) {
+        int next = addr + 1 + operandCount(program[addr]);
+        if (isBranch(program[addr]) && starts[jumpTarget(program, addr)]) {
+            leaders[jumpTarget(program, addr)] = true;
+        }
+        if (endsBlock(program, addr)) leaders[next] = starts[next];
+        addr = next;
+    }
+    return leaders;
+}
+
+std::string shellQuote(const std::string& s) {
+    std::string quoted = "'";
+    for (char c : s) {
+        if (c == '\'') quoted += "'\\''";
+        else quoted += c;
+    }
+    return quoted + "'";
+}
+
+// Emits the body of one basic block. Values pushed inside the block live in
+// C temporaries, so the C compiler keeps them in registers; only what the
+// block leaves on the stack is written back, when control leaves it.
+struct BlockWriter {
+    std::ostringstream& out;
+    std::vector<std::string> stack;  // values above the part of the VM stack still in memory
+    int popped = 0;                  // entries consumed from the VM stack below entry
+    int rise = 0;                    // highest depth above entry so far
+    int done = 0;                    // instructions completed
+    int temps = 0;
+
+    explicit BlockWriter(std::ostringstream& body) : out(body) {}
+
+    std::string temp(const std::string& init) {
+        std::string name = "t" + std::to_string(temps++);
+        out << "        Value " << name << " = " << init << ";\n";
+        return name;
+    }
+    std::string pop() {
+        if (stack.empty()) return temp("sp[" + std::to_string(-popped++) + "]");
+        std::string value = stack.back();
+        stack.pop_back();
+        return value;
+    }
+    void push(const std::string& value) {
+        stack.push_back(value);
+        rise = std::max(rise, (int)stack.size() - popped);
+    }
+
+    // Brings count, high and the stack up to date before control leaves
+    void sync(const std::string& indent) const {
+        if (done) out << indent << "count += " << done << ";\n";
+        if (rise) out << indent << "if (sp + " << rise << " > high) high = sp + " << rise << ";\n";
+        for (size_t i = 0; i < stack.size(); i++) {
+            out << indent << "sp[" << (int)i + 1 - popped << "] = " << stack[i] << ";\n";
+        }
+        int delta = (int)stack.size() - popped;
+        if (delta) out << indent << "sp += " << delta << ";\n";
+    }
+};
+
+}  // namespace
+
+uint64_t AotCode::hash(BytecodeView program) {
+    // FNV-1a over the ABI version and the bytecode words
+    uint64_t h = 1469598103934665603ULL;
+    auto mix = [&h](uint32_t word) {
+        for (int i = 0; i < 4; i++) {
+            h ^= (word >> (8 * i)) & 0xff;
+            h *= 1099511628211ULL;
+        }
+    };
+    mix(AOT_ABI_VERSION);
+    mix((uint32_t)sizeof(Value));
+    for (int32_t word : program) mix((uint32_t)word);
+    return h;
+}
+
+std::string AotCode::cacheDir() {
+    const char* dir = std::getenv("LAB6_AOT_CACHE");
+    return (dir && *dir) ? dir : userCacheDir("aot");
+}
+
+// One labelled C block per basic block. The block first checks that the
+// stack can supply and hold everything it pops and pushes; if not, it leaves
+// the whole block to the interpreter, which raises the trap at the exact
+// instruction. Jumps to leaders become gotos; anything else leaves through
+// EXIT with the address the interpreter resumes at.
+std::string AotCode::generateSource(BytecodeView program) {
+    const int size = (int)program.size();
+    std::vector<bool> starts = instructionStarts(program);
+    std::vector<bool> leaders = blockLeaders(program);
+    std::ostringstream out;
+
+    out << VALUE_PRELUDE << PRELUDE << "\n";
+    out << "const int lab6_aot_layout[4] = {" << AOT_ABI_VERSION
+        << ", sizeof(Value), VALUE_TAGGED, sizeof(AotState)};\n";
+    out << "const int lab6_aot_program_size = " << size << ";\n";
+    out << "const int32_t lab6_aot_program[] = {";
+    for (int i = 0; i < size; i++) out << (i % 16 ? " " : "\n    ") << program[i] << ",";
+    out << "\n    0\n};\n\n";
+
+    out << "void lab6_aot_enter(AotState* s) {\n"
+        << "    Value* sp = s->sp;\n"
+        << "    Value* high = s->high;\n"
+        << "    Value* const base = s->base;\n"
+        << "    Value* const limit = s->limit;\n"
+        << "    Value* const mem = s->memory;\n"
+        << "    const volatile long* const tick = s->tick;\n"
+        << "    long long count = 0;\n"
+        << "    int32_t pc = s->pc;\n"
+        << "    (void)base;\n"
+        << "    (void)limit;\n"
+        << "    switch (pc) {\n";
+    for (int addr = 0; addr < size; addr++) {
+        if (leaders[addr]) out << "    case " << addr << ": goto L" << addr << ";\n";
+    }
+    out << "    default: goto out;\n    }\n";
+
+    // A backward jump leaves instead while a sample is due
+    auto jump = [&](int addr) {
+        int target = jumpTarget(program, addr);
+        const std::string to = std::to_string(target);
+        if (!leaders[target]) return "EXIT(" + to + ");";
+        if (target <= addr) return "{ if (*tick) EXIT(" + to + "); goto L" + to + "; }";
+        return "goto L" + to + ";";
+    };
+
+    for (int start = 0; start < size; start++) {
+        if (!leaders[start]) continue;
+        std::ostringstream body;
+        BlockWriter w(body);
+        int addr = start;
+        for (;;) {
+            if (!starts[addr] || (addr != start && leaders[addr])) {
+                // Falls through into the next block, or leaves at code the
+                // translation does not cover
+                w.sync("        ");
+                if (!leaders[addr]) body << "        EXIT(" << addr << ");\n";
+                break;
+            }
+            int32_t opcode = program[addr];
+            int32_t operand = operandCount(opcode) == 1 ? program[addr + 1] : 0;
+            int next = addr + 1 + operandCount(opcode);
+            if (endsBlock(program, addr) && opcode != OP_JMP && opcode != OP_JZ && opcode != OP_JNZ) {
+                // CALL, RET, HALT and invalid memory slots run in the interpreter
+                w.sync("        ");
+                body << "        EXIT(" << addr << ");\n";
+                break;
+            }
+
+            std::string a, b;
+            switch (opcode) {
+                case OP_PUSH: w.push("INT(" + std::to_string(operand) + ")"); break;
+                case OP_POP:  w.pop(); break;
+                case OP_DUP:  a = w.pop(); w.push(a); w.push(a); break;
+                case OP_ADD:  b = w.pop(); a = w.pop(); w.push(w.temp("INT(INT_OF(" + a + ") + INT_OF(" + b + "))")); break;
+                case OP_SUB:  b = w.pop(); a = w.pop(); w.push(w.temp("INT(INT_OF(" + a + ") - INT_OF(" + b + "))")); break;
+                case OP_MUL:  b = w.pop(); a = w.pop(); w.push(w.temp("INT(INT_OF(" + a + ") * INT_OF(" + b + "))")); break;
+                case OP_CMP:  b = w.pop(); a = w.pop(); w.push(w.temp("INT(INT_OF(" + a + ") < INT_OF(" + b + "))")); break;
+                case OP_DIV: {
+                    BlockWriter before = w;
+                    b = w.pop();
+                    a = w.pop();
+                    body << "        if (INT_OF(" << b << ") == 0) {\n";
+                    before.sync("            ");
+                    body << "            EXIT(" << addr << ");\n        }\n";
+                    w.push(w.temp("INT(INT_OF(" + a + ") / INT_OF(" + b + "))"));
+                    break;
+                }
+                case OP_STORE: a = w.pop(); body << "        mem[" << operand << "] = " << a << ";\n"; break;
+                case OP_LOAD:  w.push(w.temp("mem[" + std::to_string(operand) + "]")); break;
+                case OP_PRINT: a = w.pop(); body << "        s->print(s->output, INT_OF(" << a << "));\n"; break;
+                case OP_JZ:
+                case OP_JNZ:   a = w.pop(); break;
+                default: break;
+            }
+            w.done++;
+            if (opcode == OP_JMP) {
+                w.sync("        ");
+                body << "        " << jump(addr) << "\n";
+                break;
+            }
+            if (opcode == OP_JZ || opcode == OP_JNZ) {
+                w.sync("        ");
+                body << "        if (INT_OF(" << a << ") " << (opcode == OP_JZ ? "==" : "!=") << " 0) "
+                     << jump(addr) << "\n";
+                if (!leaders[next]) body << "        EXIT(" << next << ");\n";
+                break;
+            }
+            addr = next;
+        }
+
+        out << "L" << start << ":\n";
+        std::string need = w.popped ? "sp < base + " + std::to_string(w.popped - 1) : "";
+        std::string room = w.rise ? "sp + " + std::to_string(w.rise) + " > limit" : "";
+        if (!need.empty() || !room.empty()) {
+            out << "    if (" << need << (need.empty() || room.empty() ? "" : " || ") << room
+                << ") EXIT(" << start << ");\n";
+        }
+        out << "    {\n" << body.str() << "    }\n";
+    }
+    out << "    EXIT(" << size << ");\n"
+        << "out:\n"
+        << "    s->sp = sp;\n"
+        << "    s->high = high;\n"
+        << "    s->count += count;\n"
+        << "    s->pc = pc;\n"
+        << "}\n";
+    return out.str();
+}
+
+bool AotCode::canEnter(int pc) const {
+    return entry && pc >= 0 && (size_t)pc < isLeader.size() && isLeader[pc];
+}
+
+#if VM_AOT_AVAILABLE
+
+AotCode::AotCode(BytecodeView program)
+    : handle(nullptr), entry(nullptr), isLeader(blockLeaders(program)), cached(false) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx", (unsigned long long)hash(program));
+    // Nothing is loaded from a directory another user could have written
+    const std::string dir = cacheDir();
+    if (!openPrivateDir(dir, error)) return;
+    path = dir + "/" + name + ".so";
+
+    if (load(program)) {
+        cached = true;
+        return;
+    }
+    if (build(program)) load(program);
+}
+
+AotCode::~AotCode() {
+    if (handle) dlclose(handle);
+}
+
+// Opens the cached object; a missing, foreign or stale one is not an error
+// yet, build() replaces it
+bool AotCode::load(BytecodeView program) {
+    error.clear();
+    handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+        error = dlerror();
+        return false;
+    }
+    auto layout = static_cast<const int*>(dlsym(handle, "lab6_aot_layout"));
+    auto size = static_cast<const int*>(dlsym(handle, "lab6_aot_program_size"));
+    auto words = static_cast<const int32_t*>(dlsym(handle, "lab6_aot_program"));
+    void* fn = dlsym(handle, "lab6_aot_enter");
+    bool matches = layout && size && words && fn &&
+                   std::memcmp(layout, hostLayout, sizeof(hostLayout)) == 0 &&
+                   *size == (int)program.size() &&
+                   std::equal(program.begin(), program.end(), words);
+    if (!matches) {
+        dlclose(handle);
+        handle = nullptr;
+        error = "stale cache entry " + path;
+        return false;
+    }
+    entry = reinterpret_cast<void (*)(AotState*)>(fn);
+    return true;
+}
+
+// Writes the C source and compiles it. The source, object and log are new
+// files of this process (mkstemp, in the private cache directory); the
+// compiler reads the same source that was written, and the object and the
+// source are renamed into place, so concurrent builds of one program never
+// expose a partial file.
+bool AotCode::build(BytecodeView program) {
+    const std::string dir = cacheDir();
+    const std::string stem = path.substr(0, path.size() - 3);
+    const std::string base = stem.substr(dir.size() + 1);
+
+    std::string source, object, log;
+    int fd = createTempFile(dir, base, ".c", source);
+    if (fd < 0) {
+        error = "cannot create a source file in " + dir;
+        return false;
+    }
+    const std::string text = generateSource(program);
+    const bool written = writeAll(fd, text.data(), text.size());
+    close(fd);
+    int objectFd = written ? createTempFile(dir, base, ".so.tmp", object) : -1;
+    int logFd = objectFd >= 0 ? createTempFile(dir, base, ".log", log) : -1;
+    if (objectFd >= 0) close(objectFd);
+    if (logFd >= 0) close(logFd);
+    if (logFd < 0) {
+        std::remove(source.c_str());
+        if (objectFd >= 0) std::remove(object.c_str());
+        error = "cannot write the C source in " + dir;
+        return false;
+    }
+
+    const char* cc = std::getenv("CC");
+    std::string command = std::string(cc && *cc ? cc : "cc") +
+                          " -O2 -fwrapv -shared -fPIC -o " + shellQuote(object) +
+                          " " + shellQuote(source) + " 2> " + shellQuote(log);
+    const bool compiled = std::system(command.c_str()) == 0;
+    // Kept beside the object for reading
+    std::rename(source.c_str(), (stem + ".c").c_str());
+    if (!compiled) {
+        std::remove(object.c_str());
+        error = "C compiler failed, see " + log;
+        return false;
+    }
+    std::remove(log.c_str());
+    if (std::rename(object.c_str(), path.c_str()) != 0) {
+        std::remove(object.c_str());
+        error = "cannot install " + path;
+        return false;
+    }
+    return true;
+}
+
+#else
+
+AotCode::AotCode(BytecodeView program)
+    : handle(nullptr), entry(nullptr), isLeader(blockLeaders(program)),
+      error("AOT compilation is not supported on this platform"), cached(false) {}
+AotCode::~AotCode() {}
+bool AotCode::load(BytecodeView) { return false; }
+bool AotCode::build(BytecodeView) { return false; }
+
+#endif
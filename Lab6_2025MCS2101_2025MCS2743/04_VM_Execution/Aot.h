@@ -0,0 +1,74 @@
+#ifndef AOT_H
+#define AOT_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include "Value.h"
+#include "Bytecode.h"
+
+// The AOT backend needs a system C compiler and dlopen. Other targets (or
+// -DVM_NO_AOT) build without it and report it as unavailable.
+#if (defined(__linux__) || defined(__APPLE__)) && !defined(VM_NO_AOT)
+#define VM_AOT_AVAILABLE 1
+#else
+#define VM_AOT_AVAILABLE 0
+#endif
+
+// Machine state shared with the compiled program; same conventions as
+// JitState. PRINT calls back into the host so output goes through the VM's buffer.
+struct AotState {
+    Value* sp;
+    Value* high;
+    Value* base;
+    Value* limit;
+    Value* memory;
+    long long count;
+    void (*print)(void* output, int32_t value);
+    void* output;
+    const volatile long* tick;  // nonzero stops the code at its next loop head
+    int32_t pc;
+};
+
+// Ahead-of-time compiler: translates the bytecode to C, builds it into a
+// shared object with the system C compiler and dlopens it. Artifacts are
+// cached on disk under cacheDir(), keyed by a hash of the bytecode, so a
+// program that is run again skips the C compiler.
+//
+// Each basic block becomes one C block whose intermediate stack values are C
+// locals. Block leaders are the entry points; the compiled code returns with
+// state.pc at the first instruction it leaves to the interpreter (CALL/RET,
+// HALT, invalid code, a block whose stack check or division would trap).
+class AotCode {
+public:
+    explicit AotCode(BytecodeView program);
+    ~AotCode();
+    AotCode(const AotCode&) = delete;
+    AotCode& operator=(const AotCode&) = delete;
+
+    bool valid() const { return entry != nullptr; }
+    const std::string& getError() const { return error; }
+    const std::string& getPath() const { return path; }
+    bool loadedFromCache() const { return cached; }
+    bool canEnter(int pc) const;
+    void enter(AotState& state) const { entry(&state); }
+
+    // $LAB6_AOT_CACHE, or the per-user ~/.cache/lab6/aot; either must be
+    // private to this user (see CacheDir.h) or nothing is loaded
+    static std::string cacheDir();
+    static uint64_t hash(BytecodeView program);
+    static std::string generateSource(BytecodeView program);
+
+private:
+    void* handle;
+    void (*entry)(AotState*);
+    std::vector<bool> isLeader;
+    std::string path;
+    std::string error;
+    bool cached;
+
+    bool load(BytecodeView program);
+    bool build(BytecodeView program);
+};
+
+#endif
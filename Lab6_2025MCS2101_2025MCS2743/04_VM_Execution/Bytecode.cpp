@@ -0,0 +1,354 @@
+#include "Bytecode.h"
+#include "CacheDir.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifndef MAP_POPULATE
+#define MAP_POPULATE 0
+#endif
+
+namespace {
+
+const char MAGIC[4] = {'L', 'B', 'Y', 'C'};
+const uint32_t BYTE_ORDER_MARK = 0x01020304;
+const uint16_t MAX_SECTIONS = 16;
+
+struct FileHeader {
+    char magic[4];
+    uint32_t byteOrder;
+    uint16_t version;
+    uint16_t sectionCount;
+    uint32_t entry;
+    uint32_t flags;         // none defined; 0
+    uint32_t checksum;      // header with this field 0, then the table
+    uint64_t reserved;
+};
+
+struct SectionEntry {
+    uint32_t kind;
+    uint32_t offset;
+    uint32_t size;
+    uint32_t checksum;
+};
+
+static_assert(sizeof(FileHeader) == 32, "the header is 32 bytes on disk");
+static_assert(sizeof(SectionEntry) == 16, "table entries are 16 bytes on disk");
+
+uint32_t fnv1a(const void* data, size_t size, uint32_t h = 2166136261u) {
+    const unsigned char* p = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++) {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+uint32_t tableChecksum(FileHeader header, const SectionEntry* table) {
+    header.checksum = 0;
+    uint32_t h = fnv1a(&header, sizeof(header));
+    return fnv1a(table, header.sectionCount * sizeof(SectionEntry), h);
+}
+
+size_t alignUp(size_t n) {
+    return (n + SECTION_ALIGN - 1) / SECTION_ALIGN * SECTION_ALIGN;
+}
+
+bool isContainer(const char* data, size_t size) {
+    return size >= sizeof(MAGIC) && std::memcmp(data, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+const char* sectionName(Section kind) {
+    switch (kind) {
+        case Section::CODE:      return "code";
+        case Section::CONSTANTS: return "constants";
+        case Section::LINES:     return "lines";
+        case Section::SYMBOLS:   return "symbols";
+        case Section::SOURCE:    return "source";
+    }
+    return "unknown";
+}
+
+void copyWords(const char* data, size_t size, std::vector<int32_t>& out) {
+    out.resize(size / sizeof(int32_t));
+    if (!out.empty()) std::memcpy(out.data(), data, out.size() * sizeof(int32_t));
+}
+
+} // namespace
+
+bool BytecodeImage::parse(const char* data, size_t size, std::string& error) {
+    base = data;
+    length = size;
+    sections.clear();
+    entry = 0;
+    legacy = !isContainer(data, size);
+    if (legacy) {
+        codeWords = BytecodeView((const int32_t*)data, size / sizeof(int32_t));
+        return true;
+    }
+    codeWords = BytecodeView();
+
+    FileHeader header;
+    if (size < sizeof(header)) {
+        error = "truncated header";
+        return false;
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if (header.byteOrder != BYTE_ORDER_MARK) {
+        error = "written on a host of the other byte order";
+        return false;
+    }
+    if (header.version != BYTECODE_VERSION) {
+        error = "unsupported version " + std::to_string(header.version);
+        return false;
+    }
+    if (header.sectionCount > MAX_SECTIONS ||
+        sizeof(header) + header.sectionCount * sizeof(SectionEntry) > size) {
+        error = "truncated section table";
+        return false;
+    }
+    std::vector<SectionEntry> table(header.sectionCount);
+    std::memcpy(table.data(), data + sizeof(header), table.size() * sizeof(SectionEntry));
+    if (tableChecksum(header, table.data()) != header.checksum) {
+        error = "header checksum mismatch";
+        return false;
+    }
+    for (const SectionEntry& s : table) {
+        if (s.offset % SECTION_ALIGN != 0 || s.offset > size || s.size > size - s.offset) {
+            error = std::string(sectionName((Section)s.kind)) + " section outside the file";
+            return false;
+        }
+        sections.push_back({s.kind, s.offset, s.size, s.checksum});
+    }
+
+    const char* words;
+    size_t bytes;
+    if (!section(Section::CODE, words, bytes, error)) return false;
+    if (bytes % sizeof(int32_t) != 0) {
+        error = "code section is not whole words";
+        return false;
+    }
+    codeWords = BytecodeView((const int32_t*)words, bytes / sizeof(int32_t));
+    // The VM starts at 0; other entry points are reserved for later versions
+    entry = header.entry;
+    if (entry != 0) {
+        error = "entry point " + std::to_string(entry) + " is not supported (the VM starts at 0)";
+        return false;
+    }
+    return true;
+}
+
+bool BytecodeImage::hasSection(Section kind) const {
+    if (legacy) return kind == Section::CODE;
+    for (const Entry& s : sections) {
+        if (s.kind == (uint32_t)kind) return true;
+    }
+    return false;
+}
+
+bool BytecodeImage::section(Section kind, const char*& data, size_t& size, std::string& error) const {
+    if (legacy) {
+        if (kind != Section::CODE) {
+            error = std::string("raw bytecode has no ") + sectionName(kind) + " section";
+            return false;
+        }
+        data = (const char*)codeWords.data();
+        size = codeWords.size() * sizeof(int32_t);
+        return true;
+    }
+    for (const Entry& s : sections) {
+        if (s.kind != (uint32_t)kind) continue;
+        if (fnv1a(base + s.offset, s.size) != s.checksum) {
+            error = std::string(sectionName(kind)) + " section checksum mismatch";
+            return false;
+        }
+        data = base + s.offset;
+        size = s.size;
+        return true;
+    }
+    error = std::string("no ") + sectionName(kind) + " section";
+    return false;
+}
+
+bool writeBytecodeFile(const std::string& path, const BytecodeFile& file, std::string& error) {
+    std::string bytes;
+    if (file.legacy) {
+        bytes.assign((const char*)file.code.data(), file.code.size() * sizeof(int32_t));
+    } else {
+        std::string symbols;
+        for (const std::string& name : file.symbols) symbols.append(name.c_str(), name.size() + 1);
+        struct Payload {
+            Section kind;
+            const void* data;
+            size_t size;
+        };
+        // Code always, the rest when present
+        std::vector<Payload> payloads = {{Section::CODE, file.code.data(), file.code.size() * sizeof(int32_t)}};
+        if (!file.constants.empty()) {
+            payloads.push_back({Section::CONSTANTS, file.constants.data(), file.constants.size() * sizeof(int32_t)});
+        }
+        if (!file.lines.empty()) {
+            payloads.push_back({Section::LINES, file.lines.data(), file.lines.size() * sizeof(int32_t)});
+        }
+        if (!symbols.empty()) payloads.push_back({Section::SYMBOLS, symbols.data(), symbols.size()});
+        if (!file.source.empty()) payloads.push_back({Section::SOURCE, file.source.data(), file.source.size()});
+
+        FileHeader header = {};
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.byteOrder = BYTE_ORDER_MARK;
+        header.version = BYTECODE_VERSION;
+        header.sectionCount = (uint16_t)payloads.size();
+        header.entry = file.entry;
+        std::vector<SectionEntry> table;
+        size_t offset = alignUp(sizeof(header) + payloads.size() * sizeof(SectionEntry));
+        for (const Payload& p : payloads) {
+            table.push_back({(uint32_t)p.kind, (uint32_t)offset, (uint32_t)p.size, fnv1a(p.data, p.size)});
+            offset = alignUp(offset + p.size);
+        }
+        header.checksum = tableChecksum(header, table.data());
+
+        bytes.assign(offset, '\0');
+        std::memcpy(&bytes[0], &header, sizeof(header));
+        std::memcpy(&bytes[sizeof(header)], table.data(), table.size() * sizeof(SectionEntry));
+        for (size_t i = 0; i < payloads.size(); i++) {
+            if (payloads[i].size) std::memcpy(&bytes[table[i].offset], payloads[i].data, payloads[i].size);
+        }
+    }
+
+    // Readers never see a half-written file. The temporary file is created
+    // new, so concurrent writers of one path never share it.
+    const size_t slash = path.rfind('/');
+    const std::string dir = slash == std::string::npos ? "." : path.substr(0, slash);
+    std::string temp;
+    int fd = createTempFile(dir, path.substr(slash + 1) + ".tmp", "", temp);
+    if (fd < 0) {
+        error = "cannot create a file beside " + path + ": " + std::strerror(errno);
+        return false;
+    }
+    // mkstemp makes it private; a saved program is readable as before
+    fchmod(fd, 0644);
+    const bool written = writeAll(fd, bytes.data(), bytes.size());
+    if (close(fd) != 0 || !written) {
+        error = "cannot write " + temp;
+        std::remove(temp.c_str());
+        return false;
+    }
+    if (std::rename(temp.c_str(), path.c_str()) != 0) {
+        error = path + ": " + std::strerror(errno);
+        std::remove(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool readBytecodeFile(const std::string& path, BytecodeFile& file, std::string& error, unsigned mask) {
+    file = BytecodeFile();
+    // Mapped where possible, so unselected sections are never read in
+    MappedBytecode mapped;
+    std::vector<char> buffer;
+    BytecodeImage parsed;
+    const BytecodeImage* image = &mapped.getImage();
+    if (!mapped.open(path, error)) {
+        // Mapped but not a valid container
+        if (mapped.isMapped()) return false;
+        std::ifstream in(path, std::ios::binary);
+        if (!in) return false;
+        buffer.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        if (!parsed.parse(buffer.data(), buffer.size(), error)) {
+            error = path + ": " + error;
+            return false;
+        }
+        image = &parsed;
+    }
+
+    file.legacy = image->isLegacy();
+    file.entry = image->getEntry();
+    BytecodeView code = image->code();
+    if (mask & sectionBit(Section::CODE)) file.code.assign(code.begin(), code.end());
+    // Optional sections may be absent, but not corrupt
+    for (Section kind : {Section::CONSTANTS, Section::LINES, Section::SYMBOLS, Section::SOURCE}) {
+        if (!(mask & sectionBit(kind)) || !image->hasSection(kind)) continue;
+        const char* data;
+        size_t size;
+        if (!image->section(kind, data, size, error)) {
+            error = path + ": " + error;
+            return false;
+        }
+        if (kind == Section::CONSTANTS) copyWords(data, size, file.constants);
+        if (kind == Section::LINES) copyWords(data, size, file.lines);
+        if (kind == Section::SOURCE) file.source.assign(data, size);
+        if (kind == Section::SYMBOLS) {
+            for (size_t i = 0; i < size;) {
+                size_t n = strnlen(data + i, size - i);
+                file.symbols.emplace_back(data + i, n);
+                i += n + 1;
+            }
+        }
+    }
+    return true;
+}
+
+MappedBytecode::~MappedBytecode() {
+    unmap();
+}
+
+void MappedBytecode::unmap() {
+    if (base) munmap(base, length);
+    base = nullptr;
+    length = 0;
+    image = BytecodeImage();
+}
+
+bool MappedBytecode::open(const std::string& path, std::string& error) {
+    unmap();
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        error = path + ": " + std::strerror(errno);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        error = path + ": not a regular file";
+        close(fd);
+        return false;
+    }
+    // An empty program needs no mapping
+    if (st.st_size == 0) {
+        close(fd);
+        return image.parse(nullptr, 0, error);
+    }
+    // A raw file is all code and is populated whole; of a container only
+    // the code section is read in, below
+    char magic[sizeof(MAGIC)] = {};
+    const bool container = pread(fd, magic, sizeof(magic), 0) == (ssize_t)sizeof(magic) &&
+                           isContainer(magic, sizeof(magic));
+    void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED | (container ? 0 : MAP_POPULATE), fd, 0);
+    if (p == MAP_FAILED) {
+        error = path + ": " + std::strerror(errno);
+        close(fd);
+        return false;
+    }
+    // The mapping stays valid without the descriptor
+    close(fd);
+    base = p;
+    length = (size_t)st.st_size;
+    if (!image.parse((const char*)base, length, error)) {
+        error = path + ": " + error;
+        return false;
+    }
+    // Read front to back once by the decoder
+    const uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    const uintptr_t first = (uintptr_t)view().data() & ~(page - 1);
+    const uintptr_t last = (uintptr_t)view().end();
+    if (last > first) {
+        madvise((void*)first, last - first, MADV_SEQUENTIAL);
+        madvise((void*)first, last - first, MADV_WILLNEED);
+    }
+    return true;
+}
@@ -0,0 +1,132 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+// Read-only view of bytecode words owned elsewhere: a vector, or a file
+// mapped by MappedBytecode. The VM and its tiers read the program through it.
+class BytecodeView {
+public:
+    BytecodeView() : words(nullptr), count(0) {}
+    BytecodeView(const std::vector<int32_t>& program) : words(program.data()), count(program.size()) {}
+    BytecodeView(const int32_t* words, size_t count) : words(words), count(count) {}
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    const int32_t* data() const { return words; }
+    const int32_t* begin() const { return words; }
+    const int32_t* end() const { return words + count; }
+    int32_t operator[](size_t i) const { return words[i]; }
+
+private:
+    const int32_t* words;
+    size_t count;
+};
+
+// .byc container, version 1, in host byte order (a file written on a host
+// of the other order is rejected):
+//
+//   header    32 bytes: magic "LBYC", byte-order mark, version, section
+//             count, entry pc, checksum of the header and section table
+//   table     16 bytes per section: kind, offset, size in bytes, checksum
+//   sections  each at a multiple of SECTION_ALIGN
+//
+// Checksums are 32-bit FNV-1a. A section's checksum is verified when it is
+// read, so a tool that needs only the code never touches the rest. A file
+// without the magic is legacy raw bytecode: all of it is code.
+enum class Section : uint32_t {
+    CODE = 1,
+    CONSTANTS = 2,      // int32 pool; the current instruction set has none
+    LINES = 3,          // source line per code word, 0 if unknown
+    SYMBOLS = 4,        // NUL-terminated variable names, by memory slot
+    SOURCE = 5          // the source text the code was compiled from
+};
+
+const uint16_t BYTECODE_VERSION = 1;
+const size_t SECTION_ALIGN = 16;
+
+inline unsigned sectionBit(Section kind) { return 1u << (unsigned)kind; }
+const unsigned ALL_SECTIONS = ~0u;
+
+// Everything a .byc file can hold
+struct BytecodeFile {
+    std::vector<int32_t> code;
+    std::vector<int32_t> constants;
+    std::vector<int32_t> lines;
+    std::vector<std::string> symbols;
+    std::string source;
+    uint32_t entry = 0;
+    bool legacy = false;    // read from a raw file
+};
+
+// Writes a container, or a raw file of the code alone with legacy set.
+// The file is written beside path under a new name (mkstemp, so nothing
+// already there is followed or reused) and renamed into place.
+bool writeBytecodeFile(const std::string& path, const BytecodeFile& file, std::string& error);
+// Reads the sections selected by mask (sectionBit(...) | ...); the others
+// are left empty. Raw files yield their code.
+bool readBytecodeFile(const std::string& path, BytecodeFile& file, std::string& error,
+                      unsigned mask = ALL_SECTIONS);
+
+// A .byc image in memory, container or raw, parsed in place
+class BytecodeImage {
+public:
+    BytecodeImage() : base(nullptr), length(0), legacy(true), entry(0) {}
+
+    // Checks the header, the section table and the code checksum
+    bool parse(const char* data, size_t size, std::string& error);
+    BytecodeView code() const { return codeWords; }
+    bool hasSection(Section kind) const;
+    // Bytes of a section, checksum verified; false if absent or corrupt
+    bool section(Section kind, const char*& data, size_t& size, std::string& error) const;
+    bool isLegacy() const { return legacy; }
+    uint32_t getEntry() const { return entry; }
+
+private:
+    struct Entry {
+        uint32_t kind;
+        uint32_t offset;
+        uint32_t size;
+        uint32_t checksum;
+    };
+
+    const char* base;
+    size_t length;
+    bool legacy;
+    uint32_t entry;
+    std::vector<Entry> sections;
+    BytecodeView codeWords;
+};
+
+// A .byc file mapped read-only and shared: every process running the same
+// file reads the one copy in the page cache, and nothing is copied at load.
+// The code is read in up front and advised as read sequentially once;
+// other sections of a container are faulted in only if read.
+class MappedBytecode {
+public:
+    MappedBytecode() : base(nullptr), length(0) {}
+    ~MappedBytecode();
+    MappedBytecode(const MappedBytecode&) = delete;
+    MappedBytecode& operator=(const MappedBytecode&) = delete;
+
+    // False with error set when the file cannot be mapped (missing, not a
+    // regular file) or is a corrupt container; the caller may fall back to
+    // reading a file that cannot be mapped
+    bool open(const std::string& path, std::string& error);
+    // The code section, whole int32 words only
+    BytecodeView view() const { return image.code(); }
+    const BytecodeImage& getImage() const { return image; }
+    bool isMapped() const { return base != nullptr; }
+
+private:
+    void* base;
+    size_t length;
+    BytecodeImage image;
+
+    void unmap();
+};
+
+#endif
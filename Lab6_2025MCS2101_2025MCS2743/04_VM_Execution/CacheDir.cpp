@@ -0,0 +1,78 @@
+#include "CacheDir.h"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <pwd.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+std::string userCacheDir(const std::string& name) {
+    const char* xdg = std::getenv("XDG_CACHE_HOME");
+    if (xdg && *xdg == '/') return std::string(xdg) + "/lab6/" + name;
+    const char* home = std::getenv("HOME");
+    if (!home || !*home) {
+        struct passwd* pw = getpwuid(getuid());
+        home = pw ? pw->pw_dir : nullptr;
+    }
+    if (home && *home) return std::string(home) + "/.cache/lab6/" + name;
+    return "/tmp/lab6-" + std::to_string(getuid()) + "/" + name;
+}
+
+bool openPrivateDir(const std::string& dir, std::string& error) {
+    if (dir.empty()) {
+        error = "empty cache directory";
+        return false;
+    }
+    // Parents first; existing ones are left as they are
+    for (size_t slash = dir.find('/', 1); slash != std::string::npos; slash = dir.find('/', slash + 1)) {
+        mkdir(dir.substr(0, slash).c_str(), 0700);
+    }
+    if (mkdir(dir.c_str(), 0700) != 0 && errno != EEXIST) {
+        error = "cannot create " + dir + ": " + std::strerror(errno);
+        return false;
+    }
+    struct stat st;
+    if (lstat(dir.c_str(), &st) != 0) {
+        error = dir + ": " + std::strerror(errno);
+        return false;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        error = dir + " is not a directory";
+        return false;
+    }
+    if (st.st_uid != getuid()) {
+        error = dir + " is owned by another user";
+        return false;
+    }
+    if (st.st_mode & (S_IWGRP | S_IWOTH)) {
+        error = dir + " is writable by other users";
+        return false;
+    }
+    return true;
+}
+
+int createTempFile(const std::string& dir, const std::string& stem, const std::string& suffix,
+                   std::string& path) {
+    std::string name = dir + "/" + stem + ".XXXXXX" + suffix;
+    std::vector<char> buffer(name.begin(), name.end());
+    buffer.push_back('\0');
+    int fd = mkstemps(buffer.data(), (int)suffix.size());
+    if (fd < 0) return -1;
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    path = buffer.data();
+    return fd;
+}
+
+bool writeAll(int fd, const void* data, size_t size) {
+    const char* p = (const char*)data;
+    while (size > 0) {
+        ssize_t n = write(fd, p, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        size -= (size_t)n;
+    }
+    return true;
+}
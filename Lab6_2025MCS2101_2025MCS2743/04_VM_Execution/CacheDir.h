@@ -0,0 +1,28 @@
+#ifndef CACHE_DIR_H
+#define CACHE_DIR_H
+
+#include <string>
+
+// Directories for the on-disk caches. Whatever is found in a cache is loaded
+// and run (the AOT cache dlopens it), so a cache must be a directory no
+// other user can write: a shared one such as /tmp/lab6_aot could be created
+// or filled by anyone on the host.
+
+// $XDG_CACHE_HOME/lab6/<name>, else ~/.cache/lab6/<name>
+std::string userCacheDir(const std::string& name);
+
+// Creates dir and any missing parents with mode 0700, then checks that dir
+// is a directory (not a symlink) owned by this user and not writable by
+// group or others. False with error set otherwise.
+bool openPrivateDir(const std::string& dir, std::string& error);
+
+// Creates a new file dir/<stem>.XXXXXX<suffix>, mode 0600, that did not
+// exist before (O_EXCL, so a planted file or symlink is never opened).
+// Returns the open descriptor and sets path, or -1.
+int createTempFile(const std::string& dir, const std::string& stem, const std::string& suffix,
+                   std::string& path);
+
+// Writes all of data to fd; false on a short write
+bool writeAll(int fd, const void* data, size_t size);
+
+#endif
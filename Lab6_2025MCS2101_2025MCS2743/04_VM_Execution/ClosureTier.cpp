@@ -0,0 +1,362 @@
+#include "ClosureTier.h"
+#include "Instruction.h"
+#include <algorithm>
+#include <initializer_list>
+
+// A loop runs as one unbroken chain of tail calls, so each must reuse the
+// caller's frame in every build: clang is told so per call, GCC keeps
+// sibling-call optimization on for this file
+#if defined(__clang__)
+#define TAIL_CALL __attribute__((musttail)) return
+#else
+#define TAIL_CALL return
+#if defined(__GNUC__)
+#pragma GCC optimize("O2")
+#endif
+#endif
+
+static const int MEMORY_SLOTS = 1024;
+
+namespace {
+
+// Handlers. Stack bounds were checked for the whole block on entry. The top
+// value travels in tos rather than in *sp, like the interpreter's cached top
+// of stack, and each closure tail-calls the next one, so every handler has
+// its own indirect branch as in a threaded interpreter.
+
+#define MEM_INT(f, idx) AS_INT((f).memory[idx])
+#define NEXT(sp, tos) TAIL_CALL op[1].fn((sp), (tos), op + 1, f)
+
+void opPush(Value* sp, Value tos, const ClosureOp* op, ClosureFrame& f) { *sp = tos; NEXT(sp + 1, INT_VAL(op->a)); }
+void opPop(Value* sp, Value, const ClosureOp* op, ClosureFrame& f) { NEXT(sp - 1, sp[-1]); }
+void opDup(Value* sp, Value tos, const ClosureOp* op, ClosureFrame& f) { *sp = tos; NEXT(sp + 1, tos); }
+void opStore(Value* sp, Value tos, const ClosureOp* op, ClosureFrame& f) { f.memory[op->a] = tos; NEXT(sp - 1, sp[-1]); }
+void opLoad(Value* sp, Value tos, const ClosureOp* op, ClosureFrame& f) { *sp = tos; NEXT(sp + 1, f.memory[op->a]); }
+
+void opExit(Value* sp, Value tos, const ClosureOp* op, ClosureFrame& f) {
+    *sp = tos;
+    f.sp = sp;
+    f.next = -1;
+    f.exit = op;
+}
+
+// Binary operators on the two top values, on the top value and an immediate
+// (PUSH k; op), and on the top value and a variable (LOAD x; op)
+#define BINARY(name, expr)                                                          \
+    void op##name(Value* sp, Value tos, const ClosureOp* op, ClosureFrame& f) {      \
+        int32_t x = AS_INT(sp[-1]), y = AS_INT(tos);                                \
+        NEXT(sp - 1, INT_VAL(expr));                                                \
+    }                                                                               \
+    void op##name##Imm(Value* sp, Value tos, const ClosureOp* op, ClosureFrame& f) { \
+        int32_t x = AS_INT(tos), y = op->a;                                         \
+        NEXT(sp, INT_VAL(expr));                                                    \
+    }                                                                               \
+    void op##name##Var(Value* sp, Value tos, const ClosureOp* op, ClosureFrame& f) { \
+        int32_t x = AS_INT(tos), y = MEM_INT(f, op->a);                             \
+        NEXT(sp, INT_VAL(expr));                                                    \
+    }
+
+BINARY(Add, x + y)
+BINARY(Sub, x - y)
+BINARY(Mul, x * y)
+BINARY(Cmp, x < y ? 1 : 0)
+#undef BINARY
+
+void opDiv(Value* sp, Value tos, const ClosureOp* op, ClosureFrame& f) {
+    if (AS_INT(tos) == 0) return opExit(sp, tos, op, f);
+    NEXT(sp - 1, INT_VAL(AS_INT(sp[-1]) / AS_INT(tos)));
+}
+
+// Only built for a nonzero immediate
+void opDivImm(Value* sp, Value tos, const ClosureOp* op, ClosureFrame& f) {
+    NEXT(sp, INT_VAL(AS_INT(tos) / op->a));
+}
+
+void opDivVar(Value* sp, Value tos, const ClosureOp* op, ClosureFrame& f) {
+    if (MEM_INT(f, op->a) == 0) return opExit(sp, tos, op, f);
+    NEXT(sp, INT_VAL(AS_INT(tos) / MEM_INT(f, op->a)));
+}
+
+// LOAD x; PUSH k; ADD; STORE y
+void opAddStore(Value* sp, Value tos, const ClosureOp* op, ClosureFrame& f) {
+    f.memory[op->target] = INT_VAL(MEM_INT(f, op->a) + op->b);
+    NEXT(sp, tos);
+}
+
+void opPrint(Value* sp, Value tos, const ClosureOp* op, ClosureFrame& f) {
+    f.output->print(AS_INT(tos));
+    NEXT(sp - 1, sp[-1]);
+}
+
+// Terminators end the block, then continue at addr in block to: directly
+// when its stack bounds hold and, for a backward branch, no sample is due;
+// else through the runner. A popped top leaves its new top already in *sp.
+#define CHAIN(sp_, tos_, addr_, to_)                                                \
+    do {                                                                            \
+        Value* const s_ = (sp_);                                                    \
+        const Value t_ = (tos_);                                                    \
+        const int32_t a_ = (addr_);                                                 \
+        const ClosureBlock* const b_ = (to_);                                       \
+        f.count += op->count;                                                       \
+        if (f.entry + op->rise > f.high) f.high = f.entry + op->rise;               \
+        if (b_ && s_ - f.base + 1 >= b_->need && f.end - s_ > b_->rise &&           \
+            (a_ > op->addr || !*f.tick)) {                                          \
+            f.entry = s_;                                                           \
+            TAIL_CALL b_->ops[0].fn(s_, t_, b_->ops.data(), f);                     \
+        }                                                                           \
+        *s_ = t_;                                                                   \
+        f.sp = s_;                                                                  \
+        f.next = a_;                                                                \
+        return;                                                                     \
+    } while (0)
+
+#define BRANCH(sp, tos, taken)                                                      \
+    do {                                                                            \
+        if (taken) CHAIN(sp, tos, op->target, op->targetBlock);                     \
+        CHAIN(sp, tos, op->next, op->nextBlock);                                    \
+    } while (0)
+
+void opJmp(Value* sp, Value tos, const ClosureOp* op, ClosureFrame& f) { CHAIN(sp, tos, op->target, op->targetBlock); }
+void opJz(Value* sp, Value tos, const ClosureOp* op, ClosureFrame& f) { BRANCH(sp - 1, sp[-1], AS_INT(tos) == 0); }
+void opJnz(Value* sp, Value tos, const ClosureOp* op, ClosureFrame& f) { BRANCH(sp - 1, sp[-1], AS_INT(tos) != 0); }
+
+// CMP; JZ with the compared values on the stack, in a variable and an
+// immediate (LOAD x; PUSH k), or in two variables (LOAD x; LOAD y)
+void opCmpJz(Value* sp, Value tos, const ClosureOp* op, ClosureFrame& f) {
+    BRANCH(sp - 2, sp[-2], !(AS_INT(sp[-1]) < AS_INT(tos)));
+}
+
+void opVarImmCmpJz(Value* sp, Value tos, const ClosureOp* op, ClosureFrame& f) {
+    BRANCH(sp, tos, !(MEM_INT(f, op->a) < op->b));
+}
+
+void opVarVarCmpJz(Value* sp, Value tos, const ClosureOp* op, ClosureFrame& f) {
+    BRANCH(sp, tos, !(MEM_INT(f, op->a) < MEM_INT(f, op->b)));
+}
+
+void opCall(Value* sp, Value tos, const ClosureOp* op, ClosureFrame& f) {
+    if (f.callStack->size() >= f.callLimit) return opExit(sp, tos, op, f);
+    f.callStack->push_back(op->next);
+    CHAIN(sp, tos, op->target, op->targetBlock);
+}
+
+void opRet(Value* sp, Value tos, const ClosureOp* op, ClosureFrame& f) {
+    if (f.callStack->empty()) return opExit(sp, tos, op, f);
+    const int32_t to = f.callStack->back();
+    f.callStack->pop_back();
+    const int32_t index = f.program->blockAt[to];
+    CHAIN(sp, tos, to, index >= 0 ? &f.program->blocks[index] : nullptr);
+}
+
+#undef CHAIN
+#undef BRANCH
+#undef MEM_INT
+#undef NEXT
+#undef TAIL_CALL
+
+struct Instr {
+    int32_t addr;
+    int32_t opcode;
+    int32_t operand;
+};
+
+// Same rule as VM::decodeAt: out-of-range targets run off the end.
+int jumpTarget(BytecodeView program, int addr) {
+    int32_t target = program[addr + 1];
+    return (target < 0 || (size_t)target >= program.size()) ? (int)program.size() : target;
+}
+
+bool isBranch(int32_t opcode) {
+    return opcode == OP_JMP || opcode == OP_JZ || opcode == OP_JNZ || opcode == OP_CALL;
+}
+
+// Stack effect of an opcode: entries popped, entries pushed
+void stackEffect(int32_t opcode, int& pops, int& pushes) {
+    pops = 0;
+    pushes = 0;
+    switch (opcode) {
+        case OP_PUSH: case OP_LOAD: pushes = 1; break;
+        case OP_DUP: pops = 1; pushes = 2; break;
+        case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_CMP:
+            pops = 2; pushes = 1; break;
+        case OP_POP: case OP_STORE: case OP_PRINT: case OP_JZ: case OP_JNZ:
+            pops = 1; break;
+        default: break;
+    }
+}
+
+ClosureFn handlerFor(int32_t opcode) {
+    switch (opcode) {
+        case OP_PUSH:  return opPush;
+        case OP_POP:   return opPop;
+        case OP_DUP:   return opDup;
+        case OP_ADD:   return opAdd;
+        case OP_SUB:   return opSub;
+        case OP_MUL:   return opMul;
+        case OP_DIV:   return opDiv;
+        case OP_CMP:   return opCmp;
+        case OP_STORE: return opStore;
+        case OP_LOAD:  return opLoad;
+        case OP_PRINT: return opPrint;
+        case OP_JMP:   return opJmp;
+        case OP_JZ:    return opJz;
+        case OP_JNZ:   return opJnz;
+        case OP_CALL:  return opCall;
+        case OP_RET:   return opRet;
+        default:       return opExit;
+    }
+}
+
+// Handler for `PUSH k; op` (immediate) or `LOAD x; op` (variable), or nullptr
+ClosureFn operandHandler(int32_t opcode, bool immediate, int32_t k) {
+    switch (opcode) {
+        case OP_ADD: return immediate ? opAddImm : opAddVar;
+        case OP_SUB: return immediate ? opSubImm : opSubVar;
+        case OP_MUL: return immediate ? opMulImm : opMulVar;
+        case OP_CMP: return immediate ? opCmpImm : opCmpVar;
+        case OP_DIV: return immediate ? (k != 0 ? opDivImm : nullptr) : opDivVar;
+        default:     return nullptr;
+    }
+}
+
+bool matches(const std::vector<Instr>& in, size_t i, std::initializer_list<int32_t> ops) {
+    if (i + ops.size() > in.size()) return false;
+    size_t k = 0;
+    for (int32_t opcode : ops) {
+        if (in[i + k++].opcode != opcode) return false;
+    }
+    return true;
+}
+
+// Builds the closures for one block's instructions, fusing the sequences
+// IRGenerator emits for loop conditions, increments and operands.
+void bindBlock(const std::vector<Instr>& in, const std::vector<int>& rise,
+               BytecodeView program, ClosureBlock& block) {
+    const int size = (int)program.size();
+    for (size_t i = 0; i < in.size(); ) {
+        const Instr& first = in[i];
+        ClosureOp op = {nullptr, first.operand, 0, 0, 0, first.addr, (int32_t)i, rise[i], 0, nullptr, nullptr};
+        size_t length = 1;
+
+        if (matches(in, i, {OP_LOAD, OP_PUSH, OP_CMP, OP_JZ})) {
+            op.fn = opVarImmCmpJz;
+            op.b = in[i + 1].operand;
+            length = 4;
+        } else if (matches(in, i, {OP_LOAD, OP_LOAD, OP_CMP, OP_JZ})) {
+            op.fn = opVarVarCmpJz;
+            op.b = in[i + 1].operand;
+            length = 4;
+        } else if (matches(in, i, {OP_CMP, OP_JZ})) {
+            op.fn = opCmpJz;
+            length = 2;
+        } else if (matches(in, i, {OP_LOAD, OP_PUSH, OP_ADD, OP_STORE})) {
+            op.fn = opAddStore;
+            op.b = in[i + 1].operand;
+            op.target = in[i + 3].operand;
+            length = 4;
+        } else if ((first.opcode == OP_PUSH || first.opcode == OP_LOAD) && i + 1 < in.size() &&
+                   (op.fn = operandHandler(in[i + 1].opcode, first.opcode == OP_PUSH, first.operand))) {
+            length = 2;
+        } else {
+            op.fn = handlerFor(first.opcode);
+        }
+
+        const Instr& last = in[i + length - 1];
+        op.next = last.addr + 1 + std::max(0, operandCount(last.opcode));
+        if (isBranch(last.opcode)) op.target = jumpTarget(program, last.addr);
+        if (op.next > size) op.next = size;
+        block.ops.push_back(op);
+        i += length;
+    }
+}
+
+}  // namespace
+
+void ClosureCompiler::compile(BytecodeView program, ClosureProgram& out) {
+    const int size = (int)program.size();
+    std::vector<bool> isLeader(size + 1, false);
+    isLeader[0] = true;
+    for (int addr = 0; addr < size; ) {
+        int32_t opcode = program[addr];
+        int operands = operandCount(opcode);
+        if (operands < 0 || addr + operands >= size) break;
+        if (isBranch(opcode)) {
+            isLeader[jumpTarget(program, addr)] = true;
+            if (opcode != OP_JMP) isLeader[addr + 2] = true;
+        }
+        addr += 1 + operands;
+    }
+
+    out.blocks.clear();
+    out.blockAt.assign(size + 1, -1);
+    out.numOps = 0;
+    std::vector<Instr> instrs;
+    std::vector<int> rise;
+    for (int start = 0; start < size; start++) {
+        if (!isLeader[start]) continue;
+        ClosureBlock block = {start, 0, 0, 0, {}};
+
+        // Decode up to the terminator; HALT, invalid instructions and a
+        // fall-through into the next leader end the block without one
+        instrs.clear();
+        rise.clear();
+        int depth = 0;
+        int addr = start;
+        bool terminated = false, exits = false;
+        while (addr < size && (addr == start || !isLeader[addr])) {
+            int32_t opcode = program[addr];
+            int operands = operandCount(opcode);
+            bool invalid = operands < 0 || addr + operands >= size;
+            if (!invalid && (opcode == OP_LOAD || opcode == OP_STORE)) {
+                invalid = program[addr + 1] < 0 || program[addr + 1] >= MEMORY_SLOTS;
+            }
+            if (invalid || opcode == OP_HALT) {
+                exits = true;
+                break;
+            }
+
+            instrs.push_back({addr, opcode, operands == 1 ? program[addr + 1] : 0});
+            rise.push_back(block.rise);
+            int pops, pushes;
+            stackEffect(opcode, pops, pushes);
+            depth -= pops;
+            if (-depth > block.need) block.need = -depth;
+            depth += pushes;
+            if (depth > block.rise) block.rise = depth;
+
+            addr += 1 + operands;
+            if (isBranch(opcode) || opcode == OP_RET) {
+                terminated = true;
+                break;
+            }
+        }
+
+        block.count = (int32_t)instrs.size();
+        bindBlock(instrs, rise, program, block);
+        if (!terminated) {
+            ClosureOp end = {exits ? opExit : opJmp, 0, 0, addr, addr, addr,
+                             block.count, block.rise, 0, nullptr, nullptr};
+            block.ops.push_back(end);
+        }
+        ClosureOp& last = block.ops.back();
+        if (last.fn != opExit) {
+            last.rise = block.rise;
+            last.count = block.count;
+        }
+        out.numOps += (int)block.ops.size();
+        out.blockAt[start] = (int32_t)out.blocks.size();
+        out.blocks.push_back(std::move(block));
+    }
+
+    // Branches continue straight into the block they land on
+    auto blockFor = [&out](int32_t addr) -> const ClosureBlock* {
+        const int32_t index = out.blockAt[addr];
+        return index >= 0 ? &out.blocks[index] : nullptr;
+    };
+    for (ClosureBlock& block : out.blocks) {
+        ClosureOp& last = block.ops.back();
+        if (last.fn == opExit) continue;
+        last.targetBlock = blockFor(last.target);
+        last.nextBlock = blockFor(last.next);
+    }
+}
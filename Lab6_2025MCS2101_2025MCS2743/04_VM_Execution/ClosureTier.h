@@ -0,0 +1,83 @@
+#ifndef CLOSURE_TIER_H
+#define CLOSURE_TIER_H
+
+#include <vector>
+#include <cstdint>
+#include "Value.h"
+#include "OutputBuffer.h"
+#include "Bytecode.h"
+
+struct ClosureOp;
+struct ClosureBlock;
+struct ClosureProgram;
+
+// State the closures share besides the stack pointer and top value, which
+// they pass along as arguments. The closure ending the chain stores the top
+// back to *sp and sp here.
+struct ClosureFrame {
+    Value* sp;
+    Value* memory;
+    Value* base;            // stack slot 0
+    Value* end;             // one past the allocated stack
+    Value* entry;           // sp when the running block was entered
+    Value* high;            // highest sp reached
+    long long count;        // instructions of the blocks completed
+    const volatile long* tick;  // nonzero sends backward branches to the runner
+    const ClosureProgram* program;
+    std::vector<int32_t>* callStack;
+    size_t callLimit;       // a CALL at this depth exits to trap
+    OutputBuffer* output;
+    int32_t next;           // address the runner continues at, -1 after an exit
+    const ClosureOp* exit;  // closure that left its instructions to the interpreter
+};
+
+// Runs one closure on the stack whose top slot sp points at, with the top
+// value itself held in tos, then tail-calls op + 1. Terminators tail-call
+// the first closure of the next block when its stack bounds hold, else set
+// frame.next for the runner; an exit sets next to -1.
+typedef void (*ClosureFn)(Value* sp, Value tos, const ClosureOp* op, ClosureFrame& frame);
+
+// A handler bound to the operands of one bytecode instruction, or of a short
+// sequence of them fused into one closure.
+struct ClosureOp {
+    ClosureFn fn;
+    int32_t a;
+    int32_t b;
+    int32_t target;     // branch or call target
+    int32_t next;       // address after the instructions this closure covers
+    int32_t addr;
+    int32_t done;       // block instructions before this closure
+    int32_t rise;       // highest stack depth above block entry before it;
+                        // for a terminator, the whole block's
+    int32_t count;      // for a terminator, the block's instructions
+    const ClosureBlock* targetBlock;    // blocks at target and next, if any
+    const ClosureBlock* nextBlock;
+};
+
+// Straight-line code from a leader up to its branch. need and rise bound the
+// stack depth, so the closures themselves skip overflow/underflow checks.
+struct ClosureBlock {
+    int32_t start;
+    int32_t count;      // bytecode instructions in the block
+    int32_t need;
+    int32_t rise;
+    std::vector<ClosureOp> ops;
+};
+
+struct ClosureProgram {
+    std::vector<ClosureBlock> blocks;
+    std::vector<int32_t> blockAt;   // block index per bytecode address, -1 if none
+    int numOps;
+};
+
+// Compiles every basic block into a chain of pre-bound closures, so running
+// a block needs no decoding and no opcode dispatch, and links each branch to
+// the block it lands on, so control only returns to the runner to trap,
+// grow the stack or take a sample. Portable C++: nothing is generated at run
+// time, which keeps it usable where W^X forbids a JIT.
+class ClosureCompiler {
+public:
+    static void compile(BytecodeView bytecode, ClosureProgram& out);
+};
+
+#endif
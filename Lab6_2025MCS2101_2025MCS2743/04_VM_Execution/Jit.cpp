@@ -0,0 +1,368 @@
+#include "Jit.h"
+#include "Instruction.h"
+#include "X86Emitter.h"
+
+#if VM_JIT_AVAILABLE
+
+// Register assignment inside generated code:
+//   rbx = sp, rbp = high, r12 = memory, r13 = limit, r14 = base, r15 = count
+//   cached top of stack, whose slot at [rbx] is stale: r9 holds the whole
+//   tagged word, or r8:r9 = (type, payload) with VM_WIDE_VALUES
+// Values keep the interpreter's layout; integer operands are brought into
+// eax and ecx.
+
+#if VM_TAGGED_VALUES
+static_assert(sizeof(Value) == 8, "JIT templates assume 8-byte tagged Values");
+#else
+static_assert(sizeof(Value) == 16, "JIT templates assume 16-byte Values");
+#endif
+static_assert(offsetof(JitState, pc) < 128, "JitState fields need disp8 offsets");
+
+// Stack slot size, and the offset of the integer payload inside a slot
+static const int8_t SLOT = sizeof(Value);
+static const int8_t PAYLOAD = VM_TAGGED_VALUES ? 4 : 8;
+
+namespace {
+
+struct ExitStub {
+    int32_t pc;
+    int32_t correction;
+    std::vector<size_t> sites;
+};
+
+bool isExitOpcode(int32_t opcode) {
+    return opcode == OP_PRINT || opcode == OP_CALL || opcode == OP_RET || opcode == OP_HALT;
+}
+
+}  // namespace
+
+JitCode::JitCode(BytecodeView program, const std::atomic<long>* ticks)
+    : buffer(nullptr), size(0), instructions(0) {
+    compile(program, ticks);
+}
+
+JitCode::~JitCode() {
+    if (buffer) munmap(buffer, size);
+}
+
+bool JitCode::canEnter(int pc) const {
+    return buffer && pc >= 0 && (size_t)pc < entryOffset.size() && entryOffset[pc] >= 0;
+}
+
+void JitCode::enter(JitState& state) const {
+    state.target = static_cast<uint8_t*>(buffer) + entryOffset[state.pc];
+    state.count += entryAdjust[state.pc];
+    reinterpret_cast<void (*)(JitState*)>(buffer)(&state);
+}
+
+void JitCode::compile(BytecodeView program, const std::atomic<long>* ticks) {
+    const int n = (int)program.size();
+    entryOffset.assign(n, -1);
+    entryAdjust.assign(n, 0);
+
+    // Instruction starts and block leaders, using the decoder's rules for
+    // invalid instructions and out-of-range jump targets
+    std::vector<bool> isStart(n + 1, false), isLeader(n + 1, false), invalid(n, false);
+    std::vector<int> target(n, n);
+    for (int addr = 0; addr < n; ) {
+        int32_t opcode = program[addr];
+        int operands = operandCount(opcode);
+        isStart[addr] = true;
+        if (operands < 0 || addr + operands >= n ||
+            ((opcode == OP_LOAD || opcode == OP_STORE) &&
+             (program[addr + 1] < 0 || program[addr + 1] >= 1024))) {
+            invalid[addr] = true;
+            isLeader[addr + 1] = true;
+            addr += 1;
+            continue;
+        }
+        if (opcode == OP_JMP || opcode == OP_JZ || opcode == OP_JNZ) {
+            int32_t t = program[addr + 1];
+            target[addr] = (t < 0 || t >= n) ? n : t;
+        }
+        addr += 1 + operands;
+        if (opcode == OP_JMP || opcode == OP_JZ || opcode == OP_JNZ || isExitOpcode(opcode)) {
+            isLeader[addr] = true;
+        }
+    }
+    isLeader[0] = true;
+    std::vector<bool> loopHead(n + 1, false);
+    for (int addr = 0; addr < n; addr++) {
+        if (isStart[addr] && !invalid[addr] && target[addr] < n && isStart[target[addr]]) {
+            isLeader[target[addr]] = true;
+            if (target[addr] <= addr) loopHead[target[addr]] = true;
+        }
+    }
+
+    Emitter e;
+    std::vector<size_t> epilogueSites;
+    std::vector<ExitStub> stubs;
+    std::vector<std::pair<size_t, int>> blockJumps;
+    std::vector<int32_t> blockLabel(n, -1);
+
+    // Prologue: save callee-saved registers and the state pointer, load the
+    // machine state, then jump to the requested entry point
+    e.emit({0x55, 0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57, 0x57});
+    e.emit({0x48, 0x8B, 0x5F}); e.disp8(offsetof(JitState, sp));
+    e.emit({0x48, 0x8B, 0x6F}); e.disp8(offsetof(JitState, high));
+    e.emit({0x4C, 0x8B, 0x77}); e.disp8(offsetof(JitState, base));
+    e.emit({0x4C, 0x8B, 0x6F}); e.disp8(offsetof(JitState, limit));
+    e.emit({0x4C, 0x8B, 0x67}); e.disp8(offsetof(JitState, memory));
+    e.emit({0x4C, 0x8B, 0x7F}); e.disp8(offsetof(JitState, count));
+#if VM_TAGGED_VALUES
+    e.emit({0x4C, 0x8B, 0x0B});                             // mov r9, [rbx]
+#else
+    e.emit({0x4C, 0x8B, 0x03});                             // mov r8, [rbx]
+    e.emit({0x4C, 0x8B, 0x4B, 0x08});                       // mov r9, [rbx+8]
+#endif
+    e.emit({0xFF, 0x67}); e.disp8(offsetof(JitState, target));
+
+    // Leave generated code with pc in edx, uncounting the instructions of
+    // the current block that did not run
+    auto emitExit = [&](int32_t pc, int32_t correction) {
+        e.emit({0xBA}); e.imm32(pc);
+        if (correction > 0) { e.emit({0x49, 0x81, 0xEF}); e.imm32(correction); }
+        epilogueSites.push_back(e.jmp());
+    };
+
+    int blockLength = 0, blockIndex = 0;
+    for (int addr = 0; addr < n; ) {
+        int32_t opcode = program[addr];
+        int length = invalid[addr] ? 1 : 1 + operandCount(opcode);
+        int32_t operand = length > 1 ? program[addr + 1] : 0;
+
+        if (isLeader[addr]) {
+            blockLength = 0;
+            for (int a = addr; a < n; ) {
+                blockLength++;
+                a += invalid[a] ? 1 : 1 + operandCount(program[a]);
+                if (isLeader[a]) break;
+            }
+            blockIndex = 0;
+            blockLabel[addr] = (int32_t)e.pos();
+            if (ticks && loopHead[addr]) {
+                // Jumps stop here for a due sample; entering skips the check
+                e.emit({0x48, 0xB8}); e.imm64((uint64_t)(uintptr_t)ticks);  // mov rax, imm64
+                e.emit({0x48, 0x83, 0x38, 0x00});                           // cmp qword [rax], 0
+                stubs.push_back({addr, 0, {e.jcc(CC_NZ)}});
+            }
+            e.emit({0x49, 0x81, 0xC7}); e.imm32(blockLength);
+        }
+        const int32_t correction = blockLength - blockIndex;
+        entryOffset[addr] = (int32_t)e.pos();
+        entryAdjust[addr] = correction;
+        instructions++;
+
+        // Trap checks leave through a shared stub so the interpreter re-runs
+        // the instruction and raises the trap itself
+        size_t stub = stubs.size();
+        auto toStub = [&](uint8_t cc) {
+            if (stub == stubs.size()) stubs.push_back({addr, correction, {}});
+            stubs[stub].sites.push_back(e.jcc(cc));
+        };
+        auto need = [&](int count) {
+            if (count == 1) {
+                e.emit({0x4C, 0x39, 0xF3});                 // cmp rbx, r14
+            } else {
+                e.emit({0x48, 0x8D, 0x43, (uint8_t)-SLOT}); // lea rax, [rbx-SLOT]
+                e.emit({0x4C, 0x39, 0xF0});                 // cmp rax, r14
+            }
+            toStub(CC_B);
+        };
+        auto pushCheck = [&]() {
+            e.emit({0x4C, 0x39, 0xEB});                     // cmp rbx, r13
+            toStub(CC_AE);
+        };
+        // Push: spill the cached top to its slot and advance sp
+        auto grow = [&]() {
+#if VM_TAGGED_VALUES
+            e.emit({0x4C, 0x89, 0x0B});                     // mov [rbx], r9
+#else
+            e.emit({0x4C, 0x89, 0x03});                     // mov [rbx], r8
+            e.emit({0x4C, 0x89, 0x4B, 0x08});               // mov [rbx+8], r9
+#endif
+            e.emit({0x48, 0x83, 0xC3, (uint8_t)SLOT});      // add rbx, SLOT
+            e.emit({0x48, 0x39, 0xEB});                     // cmp rbx, rbp
+            e.emit({0x48, 0x0F, 0x47, 0xEB});               // cmova rbp, rbx
+        };
+        // Pop: retreat sp and reload the new top
+        auto shrink = [&]() {
+            e.emit({0x48, 0x83, 0xEB, (uint8_t)SLOT});      // sub rbx, SLOT
+#if VM_TAGGED_VALUES
+            e.emit({0x4C, 0x8B, 0x0B});                     // mov r9, [rbx]
+#else
+            e.emit({0x4C, 0x8B, 0x03});                     // mov r8, [rbx]
+            e.emit({0x4C, 0x8B, 0x4B, 0x08});               // mov r9, [rbx+8]
+#endif
+        };
+        // ecx = integer payload of the cached top
+        auto topInt = [&]() {
+#if VM_TAGGED_VALUES
+            e.emit({0x4C, 0x89, 0xC9});                     // mov rcx, r9
+            e.emit({0x48, 0xC1, 0xE9, 0x20});               // shr rcx, 32
+#else
+            e.emit({0x44, 0x89, 0xC9});                     // mov ecx, r9d
+#endif
+        };
+        // Binary op: eax = second operand, ecx = top; the result replaces both
+        auto binaryOperands = [&]() {
+            topInt();
+            e.emit({0x48, 0x83, 0xEB, (uint8_t)SLOT});      // sub rbx, SLOT
+            e.emit({0x8B, 0x43, (uint8_t)PAYLOAD});         // mov eax, [rbx+PAYLOAD]
+        };
+        // The integer in eax becomes the cached top
+        auto intResult = [&]() {
+#if VM_TAGGED_VALUES
+            e.emit({0x48, 0xC1, 0xE0, 0x20});               // shl rax, 32
+            e.emit({0x49, 0x89, 0xC1});                     // mov r9, rax
+#else
+            e.emit({0x41, 0x89, 0xC1});                     // mov r9d, eax
+            e.emit({0x45, 0x31, 0xC0});                     // xor r8d, r8d (VAL_INT)
+#endif
+        };
+        auto branchTo = [&](uint8_t cc, int t) {
+            if (t < n && isLeader[t] && isStart[t]) {
+                blockJumps.push_back({cc ? e.jcc(cc) : e.jmp(), t});
+            } else if (cc) {
+                stubs.push_back({t, 0, {e.jcc(cc)}});
+            } else {
+                emitExit(t, 0);
+            }
+        };
+
+        if (invalid[addr] || isExitOpcode(opcode)) {
+            emitExit(addr, correction);
+        } else {
+            switch (opcode) {
+                case OP_PUSH:
+                    pushCheck();
+                    grow();
+#if VM_TAGGED_VALUES
+                    e.emit({0x41, 0xB9}); e.imm32(operand); // mov r9d, imm32
+                    e.emit({0x49, 0xC1, 0xE1, 0x20});       // shl r9, 32
+#else
+                    e.emit({0x45, 0x31, 0xC0});             // xor r8d, r8d
+                    e.emit({0x49, 0xC7, 0xC1}); e.imm32(operand);
+#endif
+                    break;
+                case OP_LOAD:
+                    pushCheck();
+                    grow();
+#if VM_TAGGED_VALUES
+                    e.emit({0x4D, 0x8B, 0x8C, 0x24}); e.imm32(operand * 8);
+#else
+                    e.emit({0x4D, 0x8B, 0x84, 0x24}); e.imm32(operand * 16);
+                    e.emit({0x4D, 0x8B, 0x8C, 0x24}); e.imm32(operand * 16 + 8);
+#endif
+                    break;
+                case OP_STORE:
+                    need(1);
+#if VM_TAGGED_VALUES
+                    e.emit({0x4D, 0x89, 0x8C, 0x24}); e.imm32(operand * 8);
+#else
+                    e.emit({0x4D, 0x89, 0x84, 0x24}); e.imm32(operand * 16);
+                    e.emit({0x4D, 0x89, 0x8C, 0x24}); e.imm32(operand * 16 + 8);
+#endif
+                    shrink();
+                    break;
+                case OP_POP:
+                    need(1);
+                    shrink();
+                    break;
+                case OP_DUP:
+                    need(1);
+                    pushCheck();
+                    grow();
+                    break;
+                case OP_ADD:
+                    need(2);
+                    binaryOperands();
+                    e.emit({0x01, 0xC8});                   // add eax, ecx
+                    intResult();
+                    break;
+                case OP_SUB:
+                    need(2);
+                    binaryOperands();
+                    e.emit({0x29, 0xC8});                   // sub eax, ecx
+                    intResult();
+                    break;
+                case OP_MUL:
+                    need(2);
+                    binaryOperands();
+                    e.emit({0x0F, 0xAF, 0xC1});             // imul eax, ecx
+                    intResult();
+                    break;
+                case OP_DIV:
+                    need(2);
+                    topInt();
+                    e.emit({0x85, 0xC9});                   // test ecx, ecx
+                    toStub(CC_Z);
+                    binaryOperands();
+                    e.emit({0x99, 0xF7, 0xF9});             // cdq; idiv ecx
+                    intResult();
+                    break;
+                case OP_CMP:
+                    need(2);
+                    binaryOperands();
+                    e.emit({0x39, 0xC8});                   // cmp eax, ecx
+                    e.emit({0x0F, 0x9C, 0xC0});             // setl al
+                    e.emit({0x0F, 0xB6, 0xC0});             // movzx eax, al
+                    intResult();
+                    break;
+                case OP_JMP:
+                    branchTo(0, target[addr]);
+                    break;
+                case OP_JZ:
+                case OP_JNZ:
+                    need(1);
+                    topInt();
+                    shrink();
+                    e.emit({0x85, 0xC9});                   // test ecx, ecx
+                    branchTo(opcode == OP_JZ ? CC_Z : CC_NZ, target[addr]);
+                    break;
+            }
+        }
+
+        blockIndex++;
+        addr += length;
+        if (addr == n && opcode != OP_JMP && !isExitOpcode(opcode) && !invalid[addr - length]) {
+            emitExit(n, 0);
+        }
+    }
+
+    for (ExitStub& stub : stubs) {
+        size_t at = e.pos();
+        for (size_t site : stub.sites) e.bind(site, at);
+        emitExit(stub.pc, stub.correction);
+    }
+    for (const auto& jump : blockJumps) e.bind(jump.first, blockLabel[jump.second]);
+
+    // Epilogue: write the machine state back and restore registers
+    size_t epilogue = e.pos();
+    for (size_t site : epilogueSites) e.bind(site, epilogue);
+#if VM_TAGGED_VALUES
+    e.emit({0x4C, 0x89, 0x0B});                             // mov [rbx], r9
+#else
+    e.emit({0x4C, 0x89, 0x03});                             // mov [rbx], r8
+    e.emit({0x4C, 0x89, 0x4B, 0x08});                       // mov [rbx+8], r9
+#endif
+    e.emit({0x48, 0x8B, 0x3C, 0x24});
+    e.emit({0x48, 0x89, 0x5F}); e.disp8(offsetof(JitState, sp));
+    e.emit({0x48, 0x89, 0x6F}); e.disp8(offsetof(JitState, high));
+    e.emit({0x4C, 0x89, 0x7F}); e.disp8(offsetof(JitState, count));
+    e.emit({0x89, 0x57}); e.disp8(offsetof(JitState, pc));
+    e.emit({0x5F, 0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5B, 0x5D, 0xC3});
+
+    buffer = e.install();
+    if (buffer) size = e.pos();
+}
+
+#else
+
+JitCode::JitCode(BytecodeView, const std::atomic<long>*) : buffer(nullptr), size(0), instructions(0) {}
+JitCode::~JitCode() {}
+bool JitCode::canEnter(int) const { return false; }
+void JitCode::enter(JitState&) const {}
+void JitCode::compile(BytecodeView, const std::atomic<long>*) {}
+
+#endif
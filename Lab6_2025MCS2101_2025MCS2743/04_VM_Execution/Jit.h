@@ -0,0 +1,60 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include "Value.h"
+#include "Bytecode.h"
+
+// The baseline JIT emits x86-64 machine code into an mmap'd buffer. Other
+// targets (or -DVM_NO_JIT) build without it and always interpret.
+#if defined(__x86_64__) && defined(__linux__) && !defined(VM_NO_JIT)
+#define VM_JIT_AVAILABLE 1
+#else
+#define VM_JIT_AVAILABLE 0
+#endif
+
+// Machine state shared with generated code. sp/high follow the interpreter's
+// convention: sp points at the top value, base - 1 when the stack is empty.
+struct JitState {
+    Value* sp;
+    Value* high;
+    Value* base;
+    Value* limit;
+    Value* memory;
+    long long count;
+    const void* target;
+    int32_t pc;
+};
+
+// Whole-program template compiler. Every bytecode instruction start is an
+// entry point; generated code returns with state.pc at the first instruction
+// it does not handle itself (PRINT, CALL/RET, HALT, a failed trap check),
+// which the interpreter then executes. Given a tick counter, loop heads
+// (targets of backward jumps) also return there while it is nonzero.
+class JitCode {
+public:
+    explicit JitCode(BytecodeView program, const std::atomic<long>* ticks = nullptr);
+    ~JitCode();
+    JitCode(const JitCode&) = delete;
+    JitCode& operator=(const JitCode&) = delete;
+
+    bool valid() const { return buffer != nullptr; }
+    bool canEnter(int pc) const;
+    void enter(JitState& state) const;
+    size_t codeSize() const { return size; }
+    int compiledInstructions() const { return instructions; }
+
+private:
+    void* buffer;
+    size_t size;
+    int instructions;
+    std::vector<int32_t> entryOffset;
+    std::vector<int32_t> entryAdjust;
+
+    void compile(BytecodeView program, const std::atomic<long>* ticks);
+};
+
+#endif
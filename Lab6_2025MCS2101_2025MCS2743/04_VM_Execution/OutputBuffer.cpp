@@ -0,0 +1,112 @@
+#include "OutputBuffer.h"
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+
+namespace {
+
+const char LINE_PREFIX[] = "Output : ";
+const size_t PREFIX_LENGTH = sizeof(LINE_PREFIX) - 1;
+
+// "00" "01" ... "99": two digits per division by 100
+const char DIGIT_PAIRS[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+} // namespace
+
+OutputBuffer::OutputBuffer(int fd)
+    : capacity(0), used(0), fd(fd), capture(nullptr), lineBuffered(false), writes(0) {}
+
+OutputBuffer::~OutputBuffer() {
+    flush();
+}
+
+size_t OutputBuffer::formatLine(char* out, int32_t value) {
+    std::memcpy(out, LINE_PREFIX, PREFIX_LENGTH);
+    char* p = out + PREFIX_LENGTH;
+    uint32_t n = (uint32_t)value;
+    if (value < 0) {
+        *p++ = '-';
+        n = 0u - n;
+    }
+    // Digits are produced from the right into a scratch area, then moved up
+    char digits[10];
+    char* d = digits + sizeof(digits);
+    while (n >= 100) {
+        uint32_t pair = n % 100;
+        n /= 100;
+        d -= 2;
+        std::memcpy(d, DIGIT_PAIRS + 2 * pair, 2);
+    }
+    if (n >= 10) {
+        d -= 2;
+        std::memcpy(d, DIGIT_PAIRS + 2 * n, 2);
+    } else {
+        *--d = (char)('0' + n);
+    }
+    size_t length = digits + sizeof(digits) - d;
+    std::memcpy(p, d, length);
+    p += length;
+    *p++ = '\n';
+    return p - out;
+}
+
+void OutputBuffer::makeRoom() {
+    if (!data) {
+        data.reset(new char[CAPACITY]);
+        capacity = CAPACITY;
+        return;
+    }
+    flush();
+}
+
+void OutputBuffer::flush() {
+    if (used == 0) return;
+    if (capture) capture->append(data.get(), used);
+    else writeAll(data.get(), used);
+    used = 0;
+}
+
+void OutputBuffer::append(const std::string& text) {
+    flush();
+    if (capture) capture->append(text);
+    else writeAll(text.data(), text.size());
+}
+
+// Anything already sent through std::cout or stdio goes first, so the two
+// streams interleave in program order. A failed write drops the rest.
+void OutputBuffer::writeAll(const char* p, size_t length) {
+    if (fd == STDOUT_FILENO) {
+        std::cout.flush();
+        std::fflush(stdout);
+    }
+    while (length > 0) {
+        ssize_t n = ::write(fd, p, length);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        writes++;
+        p += n;
+        length -= n;
+    }
+}
+
+void OutputBuffer::setLineBuffered(bool on) {
+    flush();
+    lineBuffered = on;
+}
+
+void OutputBuffer::setFd(int fd) {
+    flush();
+    this->fd = fd;
+}
+
+void OutputBuffer::setCapture(std::string* sink) {
+    flush();
+    capture = sink;
+}
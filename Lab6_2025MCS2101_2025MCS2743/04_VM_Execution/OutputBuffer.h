@@ -0,0 +1,61 @@
+#ifndef OUTPUT_BUFFER_H
+#define OUTPUT_BUFFER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Program output for PRINT. Lines are formatted straight into a byte buffer
+// that reaches the file descriptor in large write(2) calls: when it fills and
+// whenever the VM flushes it (HALT, breakpoints, traps, the end of run()).
+// Line-buffered mode writes each line as it is printed, like the old
+// std::endl path, for interactive debugging. A capture string, when set,
+// receives the flushed bytes instead of the file descriptor.
+class OutputBuffer {
+public:
+    static const size_t CAPACITY = 64 * 1024;
+
+    explicit OutputBuffer(int fd = 1);
+    ~OutputBuffer();
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+    // Appends "Output : <value>\n"
+    void print(int32_t value) {
+        if (capacity - used < MAX_LINE) makeRoom();
+        used += formatLine(data.get() + used, value);
+        if (lineBuffered) flush();
+    }
+    void flush();
+    // Flushes, then sends text the same way (trap messages of captured runs)
+    void append(const std::string& text);
+
+    void setLineBuffered(bool on);
+    bool isLineBuffered() const { return lineBuffered; }
+    void setFd(int fd);
+    int getFd() const { return fd; }
+    void setCapture(std::string* sink);
+    bool isCapturing() const { return capture != nullptr; }
+    size_t pending() const { return used; }
+    long long getWriteCount() const { return writes; }
+
+    // Writes the line for value at out, at most MAX_LINE bytes; returns its length
+    static size_t formatLine(char* out, int32_t value);
+
+private:
+    static const size_t MAX_LINE = 32;
+
+    std::unique_ptr<char[]> data;
+    size_t capacity;                // 0 until the first print allocates data
+    size_t used;
+    int fd;
+    std::string* capture;
+    bool lineBuffered;
+    long long writes;
+
+    void makeRoom();
+    void writeAll(const char* p, size_t length);
+};
+
+#endif
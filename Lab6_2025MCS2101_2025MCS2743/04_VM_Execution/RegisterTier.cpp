@@ -0,0 +1,366 @@
+#include "RegisterTier.h"
+#include "Instruction.h"
+#include <cstdio>
+#include <climits>
+
+static const int MEMORY_SLOTS = 1024;
+
+RegisterTranslator::RegisterTranslator(BytecodeView bytecode)
+    : program(bytecode), numVars(0), maxDepth(0), pending(-1) {}
+
+bool RegisterTranslator::fail(const std::string& why, int addr) {
+    error = why + " at address " + std::to_string(addr);
+    return false;
+}
+
+static bool isJump(int32_t opcode) {
+    return opcode == OP_JMP || opcode == OP_JZ || opcode == OP_JNZ;
+}
+
+// Same rule as VM::decodeAt: out-of-range targets run off the end.
+static int jumpTarget(BytecodeView program, int addr) {
+    int32_t target = program[addr + 1];
+    return (target < 0 || (size_t)target >= program.size()) ? (int)program.size() : target;
+}
+
+bool RegisterTranslator::scan() {
+    const int size = (int)program.size();
+    isStart.assign(size + 1, false);
+    isLeader.assign(size + 1, false);
+    isStart[size] = true;
+    isLeader[0] = true;
+    isLeader[size] = true;
+
+    for (int addr = 0; addr < size; ) {
+        int32_t opcode = program[addr];
+        int operands = operandCount(opcode);
+        if (operands < 0) return fail("unsupported opcode", addr);
+        if (addr + operands >= size) return fail("truncated instruction", addr);
+        if (opcode == OP_CALL || opcode == OP_RET) return fail("CALL/RET not supported", addr);
+        if (opcode == OP_LOAD || opcode == OP_STORE) {
+            int32_t idx = program[addr + 1];
+            if (idx < 0 || idx >= MEMORY_SLOTS) return fail("memory index out of range", addr);
+            if (idx + 1 > numVars) numVars = idx + 1;
+        }
+        isStart[addr] = true;
+        addr += 1 + operands;
+        if (isJump(opcode) || opcode == OP_HALT) isLeader[addr] = true;
+    }
+
+    for (int addr = 0; addr < size; addr++) {
+        if (!isStart[addr] || !isJump(program[addr])) continue;
+        int target = jumpTarget(program, addr);
+        if (!isStart[target]) return fail("jump into an operand", addr);
+        isLeader[target] = true;
+    }
+    return true;
+}
+
+bool RegisterTranslator::computeDepths() {
+    const int size = (int)program.size();
+    entryDepth.assign(size + 1, -1);
+    entryDepth[0] = 0;
+    std::vector<int> worklist = {0};
+
+    auto reach = [&](int target, int depth) {
+        if (entryDepth[target] == -1) {
+            entryDepth[target] = depth;
+            worklist.push_back(target);
+            return true;
+        }
+        return entryDepth[target] == depth;
+    };
+
+    while (!worklist.empty()) {
+        int addr = worklist.back();
+        worklist.pop_back();
+        int depth = entryDepth[addr];
+
+        while (addr < size) {
+            int32_t opcode = program[addr];
+            int next = addr + 1 + operandCount(opcode);
+            int need = 0, delta = 0;
+            switch (opcode) {
+                case OP_PUSH: case OP_LOAD: delta = 1; break;
+                case OP_DUP: need = 1; delta = 1; break;
+                case OP_POP: case OP_STORE: case OP_PRINT: case OP_JZ: case OP_JNZ:
+                    need = 1; delta = -1; break;
+                case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_CMP:
+                    need = 2; delta = -1; break;
+                default: break;
+            }
+            if (depth < need) return fail("stack underflow", addr);
+            depth += delta;
+            if (depth > maxDepth) maxDepth = depth;
+
+            if (opcode == OP_HALT) break;
+            if (opcode == OP_JMP || opcode == OP_JZ || opcode == OP_JNZ) {
+                int target = jumpTarget(program, addr);
+                if (!reach(target, depth)) return fail("inconsistent stack depth", target);
+                if (opcode == OP_JMP) break;
+            }
+            addr = next;
+            if (isLeader[addr]) {
+                if (!reach(addr, depth)) return fail("inconsistent stack depth", addr);
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+void RegisterTranslator::emit(RegOpcode op, int32_t d, int32_t a, int32_t b, int addr) {
+    code.push_back({op, d, a, b, addr});
+    pending = -1;
+}
+
+void RegisterTranslator::emitJump(RegOpcode op, int target, int32_t a, int32_t b, int addr) {
+    fixups.push_back({code.size(), target});
+    emit(op, 0, a, b, addr);
+}
+
+bool RegisterTranslator::referenced(int reg) const {
+    for (const Operand& s : stack) {
+        if (!s.isImm && s.value == reg) return true;
+    }
+    return false;
+}
+
+// Moves stack slot i into its canonical temporary. Slots above i never read
+// temp(i) unless slot i already lives there, so filling bottom-up is safe.
+void RegisterTranslator::materialize(size_t i, int addr) {
+    Operand& s = stack[i];
+    int reg = temp(i);
+    if (!s.isImm && s.value == reg) return;
+    if (s.isImm) emit(R_MOVI, reg, 0, s.value, addr);
+    else emit(R_MOV, reg, s.value, 0, addr);
+    stack[i] = {false, reg};
+}
+
+void RegisterTranslator::materializeAll(int addr) {
+    for (size_t i = 0; i < stack.size(); i++) materialize(i, addr);
+}
+
+static bool fold(int32_t opcode, int32_t a, int32_t b, int32_t& result) {
+    switch (opcode) {
+        case OP_ADD: result = (int32_t)((uint32_t)a + (uint32_t)b); return true;
+        case OP_SUB: result = (int32_t)((uint32_t)a - (uint32_t)b); return true;
+        case OP_MUL: result = (int32_t)((uint32_t)a * (uint32_t)b); return true;
+        case OP_CMP: result = a < b ? 1 : 0; return true;
+        case OP_DIV:
+            if (b == 0 || (a == INT32_MIN && b == -1)) return false;
+            result = a / b;
+            return true;
+        default: return false;
+    }
+}
+
+void RegisterTranslator::binary(int32_t opcode, int addr) {
+    Operand b = stack.back();
+    stack.pop_back();
+    Operand a = stack.back();
+    stack.pop_back();
+
+    int32_t folded;
+    if (a.isImm && b.isImm && fold(opcode, a.value, b.value, folded)) {
+        stack.push_back({true, folded});
+        return;
+    }
+
+    RegOpcode rr, ri, rev;
+    switch (opcode) {
+        case OP_ADD: rr = R_ADD; ri = R_ADDI; rev = R_ADDI; break;
+        case OP_SUB: rr = R_SUB; ri = R_SUBI; rev = R_RSUBI; break;
+        case OP_MUL: rr = R_MUL; ri = R_MULI; rev = R_MULI; break;
+        case OP_DIV: rr = R_DIV; ri = R_DIVI; rev = R_RDIVI; break;
+        default:     rr = R_LT;  ri = R_LTI;  rev = R_RLTI; break;
+    }
+
+    int dst = temp(stack.size());
+    if (a.isImm && b.isImm) {
+        // Left unfolded so the trap still happens at run time
+        emit(R_MOVI, dst, 0, a.value, addr);
+        emit(ri, dst, dst, b.value, addr);
+    } else if (b.isImm) {
+        emit(ri, dst, a.value, b.value, addr);
+    } else if (a.isImm) {
+        emit(rev, dst, b.value, a.value, addr);
+    } else {
+        emit(rr, dst, a.value, b.value, addr);
+    }
+    // The slots may be immediates or variables, which no register holds as
+    // the stack; the runner pushes them only if the division traps
+    if (opcode == OP_DIV && !stack.empty()) {
+        trapSites.push_back({(int32_t)code.size() - 1, (int32_t)trapStack.size(), (int32_t)stack.size()});
+        trapStack.insert(trapStack.end(), stack.begin(), stack.end());
+    }
+    stack.push_back({false, dst});
+    pending = (int)code.size() - 1;
+}
+
+void RegisterTranslator::branch(int32_t opcode, int target, int addr) {
+    Operand cond = stack.back();
+    stack.pop_back();
+
+    if (cond.isImm) {
+        bool taken = (opcode == OP_JZ) == (cond.value == 0);
+        if (taken) {
+            materializeAll(addr);
+            emitJump(R_JMP, target, 0, 0, addr);
+        }
+        return;
+    }
+
+    bool canonical = true;
+    for (size_t i = 0; i < stack.size(); i++) {
+        if (stack[i].isImm || stack[i].value != temp(i)) canonical = false;
+    }
+    if (canonical && pending >= 0 && pending == (int)code.size() - 1 && code[pending].d == cond.value &&
+        (code[pending].op == R_LT || code[pending].op == R_LTI) && !referenced(cond.value)) {
+        RegInstr cmp = code.back();
+        code.pop_back();
+        bool imm = cmp.op == R_LTI;
+        RegOpcode op = (opcode == OP_JZ) ? (imm ? R_JGEI : R_JGE) : (imm ? R_JLTI : R_JLT);
+        emitJump(op, target, cmp.a, cmp.b, cmp.addr);
+        return;
+    }
+
+    materializeAll(addr);
+    emitJump(opcode == OP_JZ ? R_JZ : R_JNZ, target, cond.value, 0, addr);
+}
+
+void RegisterTranslator::store(int var, int addr) {
+    Operand value = stack.back();
+    stack.pop_back();
+    for (size_t i = 0; i < stack.size(); i++) {
+        if (!stack[i].isImm && stack[i].value == var) materialize(i, addr);
+    }
+
+    if (!value.isImm && value.value >= numVars && pending >= 0 && pending == (int)code.size() - 1 &&
+        code[pending].d == value.value && !referenced(value.value)) {
+        code[pending].d = var;
+    } else if (value.isImm) {
+        emit(R_MOVI, var, 0, value.value, addr);
+    } else if (value.value != var) {
+        emit(R_MOV, var, value.value, 0, addr);
+    }
+    pending = -1;
+}
+
+void RegisterTranslator::emitBlock(int start) {
+    const int size = (int)program.size();
+    stack.clear();
+    for (int i = 0; i < entryDepth[start]; i++) stack.push_back({false, temp(i)});
+    pending = -1;
+
+    if (start == size) {
+        emit(R_HALT, size, (int32_t)stack.size(), 0, size);
+        return;
+    }
+
+    for (int addr = start; ; ) {
+        int32_t opcode = program[addr];
+        int next = addr + 1 + operandCount(opcode);
+        int32_t operand = (next > addr + 1) ? program[addr + 1] : 0;
+
+        switch (opcode) {
+            case OP_PUSH: stack.push_back({true, operand}); break;
+            case OP_LOAD: stack.push_back({false, operand}); break;
+            case OP_DUP:  stack.push_back(stack.back()); break;
+            case OP_POP:  stack.pop_back(); break;
+            case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_CMP:
+                binary(opcode, addr);
+                break;
+            case OP_STORE:
+                store(operand, addr);
+                break;
+            case OP_PRINT: {
+                Operand value = stack.back();
+                stack.pop_back();
+                if (value.isImm) emit(R_PRINTI, 0, 0, value.value, addr);
+                else emit(R_PRINT, 0, value.value, 0, addr);
+                break;
+            }
+            case OP_JMP:
+                materializeAll(addr);
+                emitJump(R_JMP, jumpTarget(program, addr), 0, 0, addr);
+                return;
+            case OP_JZ: case OP_JNZ:
+                branch(opcode, jumpTarget(program, addr), addr);
+                break;
+            case OP_HALT:
+                materializeAll(addr);
+                emit(R_HALT, next, (int32_t)stack.size(), 1, addr);
+                return;
+        }
+
+        addr = next;
+        if (isLeader[addr]) {
+            materializeAll(addr);
+            return;
+        }
+    }
+}
+
+bool RegisterTranslator::translate(RegisterProgram& out) {
+    code.clear();
+    fixups.clear();
+    trapSites.clear();
+    trapStack.clear();
+    numVars = 0;
+    maxDepth = 0;
+    if (!scan() || !computeDepths()) return false;
+
+    // Blocks are laid out in address order, so fallthrough needs no jump
+    const int size = (int)program.size();
+    std::vector<int> blockStart(size + 1, -1);
+    for (int addr = 0; addr <= size; addr++) {
+        if (!isLeader[addr] || entryDepth[addr] < 0) continue;
+        blockStart[addr] = (int)code.size();
+        emitBlock(addr);
+    }
+    for (const auto& fixup : fixups) {
+        code[fixup.first].d = blockStart[fixup.second];
+    }
+
+    out.code = code;
+    out.numVars = numVars;
+    out.maxDepth = maxDepth;
+    out.numRegs = numVars + maxDepth;
+    out.trapSites = trapSites;
+    out.trapStack = trapStack;
+    return true;
+}
+
+const char* RegisterTranslator::getOpcodeName(RegOpcode op) {
+    static const char* names[R_COUNT] = {
+        "MOVI", "MOV", "ADD", "SUB", "MUL", "DIV", "LT",
+        "ADDI", "SUBI", "MULI", "DIVI", "LTI", "RSUBI", "RDIVI", "RLTI",
+        "JMP", "JZ", "JNZ", "JLT", "JLTI", "JGE", "JGEI",
+        "PRINT", "PRINTI", "HALT"
+    };
+    return (op >= 0 && op < R_COUNT) ? names[op] : "UNKNOWN";
+}
+
+void RegisterTranslator::print(const RegisterProgram& prog) {
+    printf("; %d vars, %d registers\n", prog.numVars, prog.numRegs);
+    for (size_t i = 0; i < prog.code.size(); i++) {
+        const RegInstr& in = prog.code[i];
+        printf("%3zu: %-6s", i, getOpcodeName(in.op));
+        switch (in.op) {
+            case R_MOVI: printf(" r%d, %d", in.d, in.b); break;
+            case R_MOV: printf(" r%d, r%d", in.d, in.a); break;
+            case R_ADD: case R_SUB: case R_MUL: case R_DIV: case R_LT:
+                printf(" r%d, r%d, r%d", in.d, in.a, in.b); break;
+            case R_JMP: printf(" %d", in.d); break;
+            case R_JZ: case R_JNZ: printf(" r%d, %d", in.a, in.d); break;
+            case R_JLT: case R_JGE: printf(" r%d, r%d, %d", in.a, in.b, in.d); break;
+            case R_JLTI: case R_JGEI: printf(" r%d, %d, %d", in.a, in.b, in.d); break;
+            case R_PRINT: printf(" r%d", in.a); break;
+            case R_PRINTI: printf(" %d", in.b); break;
+            case R_HALT: printf(" %d", in.a); break;
+            default: printf(" r%d, r%d, %d", in.d, in.a, in.b); break;
+        }
+        printf("   ; @%d\n", in.addr);
+    }
+}
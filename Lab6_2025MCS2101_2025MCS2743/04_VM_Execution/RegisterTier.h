@@ -0,0 +1,115 @@
+#ifndef REGISTER_TIER_H
+#define REGISTER_TIER_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include "Bytecode.h"
+
+// Three-address register instruction set. Registers 0..numVars-1 alias the
+// VM memory slots used by LOAD/STORE, the rest hold operand stack temporaries.
+enum RegOpcode : int32_t {
+    R_MOVI,     // d = imm b
+    R_MOV,      // d = a
+    R_ADD,      // d = a + b
+    R_SUB,
+    R_MUL,
+    R_DIV,
+    R_LT,       // d = a < b
+    R_ADDI,     // d = a + imm b
+    R_SUBI,
+    R_MULI,
+    R_DIVI,
+    R_LTI,
+    R_RSUBI,    // d = imm b - a
+    R_RDIVI,    // d = imm b / a
+    R_RLTI,     // d = imm b < a
+    R_JMP,      // goto d
+    R_JZ,       // if a == 0 goto d
+    R_JNZ,      // if a != 0 goto d
+    R_JLT,      // if a < b goto d
+    R_JLTI,     // if a < imm b goto d
+    R_JGE,      // if !(a < b) goto d
+    R_JGEI,     // if !(a < imm b) goto d
+    R_PRINT,    // print a
+    R_PRINTI,   // print imm b
+    R_HALT,     // push a temporaries back onto the stack, pc = d; b = 1 halts
+    R_COUNT
+};
+
+struct RegInstr {
+    RegOpcode op;
+    int32_t d;      // destination register or jump target
+    int32_t a;
+    int32_t b;      // register or immediate, depending on op
+    int32_t addr;   // source bytecode address
+};
+
+// An operand stack slot during translation: an immediate or a register
+struct RegOperand {
+    bool isImm;
+    int32_t value;
+};
+
+// A division and the operand stack below its operands, which a division by
+// zero leaves behind as the stack VM does
+struct RegTrapSite {
+    int32_t instr;      // index into code
+    int32_t first;      // its slots in trapStack, bottom first
+    int32_t count;
+};
+
+struct RegisterProgram {
+    std::vector<RegInstr> code;
+    int numVars;
+    int numRegs;
+    int maxDepth;
+    std::vector<RegTrapSite> trapSites;     // ascending instr
+    std::vector<RegOperand> trapStack;
+};
+
+// Translates stack bytecode into register code by abstract interpretation of
+// the operand stack within each basic block. Temporaries live in canonical
+// registers at block boundaries, so every block entry has the same layout.
+class RegisterTranslator {
+public:
+    explicit RegisterTranslator(BytecodeView bytecode);
+    bool translate(RegisterProgram& out);
+    const std::string& getError() const { return error; }
+
+    static const char* getOpcodeName(RegOpcode op);
+    static void print(const RegisterProgram& prog);
+
+private:
+    typedef RegOperand Operand;
+
+    BytecodeView program;
+    std::vector<bool> isStart;
+    std::vector<bool> isLeader;
+    std::vector<int> entryDepth;
+    std::vector<Operand> stack;
+    std::vector<RegInstr> code;
+    std::vector<std::pair<size_t, int>> fixups;
+    std::vector<RegTrapSite> trapSites;
+    std::vector<Operand> trapStack;
+    int numVars;
+    int maxDepth;
+    int pending;
+    std::string error;
+
+    bool fail(const std::string& why, int addr);
+    bool scan();
+    bool computeDepths();
+    void emitBlock(int start);
+    void emit(RegOpcode op, int32_t d, int32_t a, int32_t b, int addr);
+    void emitJump(RegOpcode op, int target, int32_t a, int32_t b, int addr);
+    int temp(size_t i) const { return numVars + (int)i; }
+    bool referenced(int reg) const;
+    void materialize(size_t i, int addr);
+    void materializeAll(int addr);
+    void binary(int32_t opcode, int addr);
+    void branch(int32_t opcode, int target, int addr);
+    void store(int var, int addr);
+};
+
+#endif
@@ -0,0 +1,134 @@
+#include "Sampler.h"
+#include "VirtualMachine.h"
+#include "Instruction.h"
+#include <signal.h>
+#include <sys/time.h>
+#include <algorithm>
+
+// Timer ticks not yet consumed by the active sampler. Lock-free, so the
+// handler may touch it from any thread.
+static std::atomic<long> pendingTicks(0);
+static std::atomic<bool> samplerActive(false);
+static struct sigaction previousAction;
+
+static_assert(std::atomic<long>::is_always_lock_free, "SIGPROF counter must be lock-free");
+
+static void onSigprof(int) {
+    pendingTicks.fetch_add(1, std::memory_order_relaxed);
+}
+
+Sampler::Sampler(int hz)
+    : hz(hz > 0 && hz <= 100000 ? hz : DEFAULT_HZ), active(false), seed(0x9E3779B9u), ring(RING_SIZE),
+      head(0), tail(0), samples(0), dropped(0) {}
+
+Sampler::~Sampler() {
+    stop();
+}
+
+bool Sampler::start(std::string& error) {
+    if (active) return true;
+    if (samplerActive.exchange(true)) {
+        error = "another program is being sampled";
+        return false;
+    }
+    struct sigaction action = {};
+    action.sa_handler = onSigprof;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGPROF, &action, &previousAction) != 0) {
+        samplerActive = false;
+        error = "cannot install the SIGPROF handler";
+        return false;
+    }
+    pendingTicks = 0;
+    struct itimerval timer = {};
+    long period = 1000000 / hz;
+    timer.it_interval.tv_sec = period / 1000000;
+    timer.it_interval.tv_usec = period % 1000000;
+    timer.it_value = timer.it_interval;
+    if (setitimer(ITIMER_PROF, &timer, nullptr) != 0) {
+        sigaction(SIGPROF, &previousAction, nullptr);
+        samplerActive = false;
+        error = "cannot start the profiling timer";
+        return false;
+    }
+    active = true;
+    return true;
+}
+
+void Sampler::stop() {
+    if (!active) return;
+    struct itimerval timer = {};
+    setitimer(ITIMER_PROF, &timer, nullptr);
+    sigaction(SIGPROF, &previousAction, nullptr);
+    active = false;
+    samplerActive = false;
+}
+
+long long Sampler::nextSlice() {
+    // xorshift32: 2048..6143 instructions, a few microseconds of interpretation
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return 2048 + (seed & 4095);
+}
+
+const std::atomic<long>* Sampler::ticks() {
+    return &pendingTicks;
+}
+
+bool Sampler::due() {
+    if (pendingTicks.load(std::memory_order_relaxed) == 0) return false;
+    // Ticks that arrived during one slice describe the same pc; count them once
+    pendingTicks.store(0, std::memory_order_relaxed);
+    return true;
+}
+
+void Sampler::record(int32_t pc, const std::vector<int32_t>& callStack) {
+    size_t at = head.load(std::memory_order_relaxed);
+    if (at - tail.load(std::memory_order_acquire) == RING_SIZE) {
+        dropped++;
+        return;
+    }
+    Sample& sample = ring[at & (RING_SIZE - 1)];
+    int depth = (int)std::min(callStack.size(), (size_t)MAX_FRAMES);
+    sample.pc = pc;
+    sample.depth = depth;
+    std::copy(callStack.end() - depth, callStack.end(), sample.frames);
+    head.store(at + 1, std::memory_order_release);
+}
+
+bool Sampler::needsCollect() const {
+    return head.load(std::memory_order_relaxed) - tail.load(std::memory_order_relaxed) >= RING_SIZE / 2;
+}
+
+void Sampler::collect(BytecodeView program, const std::vector<int32_t>& lines) {
+    const int size = (int)program.size();
+    size_t at = tail.load(std::memory_order_relaxed);
+    size_t end = head.load(std::memory_order_acquire);
+    for (; at != end; at++) {
+        const Sample& sample = ring[at & (RING_SIZE - 1)];
+        std::string stack = "main";
+        for (int i = 0; i < sample.depth; i++) {
+            // A return address follows its CALL's operand, the callee address
+            int32_t ret = sample.frames[i];
+            stack += ";sub_";
+            stack += (ret >= 2 && ret <= size && program[ret - 2] == OP_CALL)
+                ? std::to_string(program[ret - 1]) : "?";
+        }
+        stack += ';';
+        if (sample.pc >= 0 && sample.pc < (int)lines.size() && lines[sample.pc] > 0) {
+            stack += "line " + std::to_string(lines[sample.pc]) + " ";
+        }
+        std::string name = (sample.pc >= 0 && sample.pc < size) ? VM::getOpcodeName(program[sample.pc]) : "END";
+        name.erase(name.find_last_not_of(' ') + 1);
+        stack += name + "@" + std::to_string(sample.pc);
+        folded[stack]++;
+        samples++;
+    }
+    tail.store(at, std::memory_order_release);
+}
+
+void Sampler::writeFolded(std::ostream& out) const {
+    for (const auto& entry : folded) out << entry.first << " " << entry.second << "\n";
+}
@@ -0,0 +1,73 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <vector>
+#include <string>
+#include <map>
+#include <atomic>
+#include <ostream>
+#include <cstdint>
+#include <cstddef>
+#include "Bytecode.h"
+
+// Statistical profiler. A SIGPROF interval timer (process CPU time) marks a
+// sample as due; the VM checks between interpreter slices, and compiled code
+// polls the tick counter at loop back edges and returns to its runner, which
+// records the pc and call stack. The
+// signal handler only bumps an atomic counter, so it never sees the VM in a
+// half-updated state. Samples go through a lock-free single-producer,
+// single-consumer ring and are aggregated into folded stacks.
+class Sampler {
+public:
+    static const int DEFAULT_HZ = 997;
+    static const size_t RING_SIZE = 4096;   // power of two
+    static const int MAX_FRAMES = 32;       // deeper call stacks are cut at the root
+
+    struct Sample {
+        int32_t pc;
+        int32_t depth;
+        int32_t frames[MAX_FRAMES];         // return addresses, innermost last
+    };
+
+    explicit Sampler(int hz = DEFAULT_HZ);
+    ~Sampler();
+    Sampler(const Sampler&) = delete;
+    Sampler& operator=(const Sampler&) = delete;
+
+    // Installs the SIGPROF handler and starts the timer. One sampler can be
+    // active per process; false with error set otherwise.
+    bool start(std::string& error);
+    void stop();
+
+    // Instructions the VM runs before its next check. Varied so that the
+    // check points do not lock onto the period of a loop.
+    long long nextSlice();
+    bool due();
+    bool isActive() const { return active; }
+    // Nonzero while a sample is due; what compiled code polls
+    static const std::atomic<long>* ticks();
+    void record(int32_t pc, const std::vector<int32_t>& callStack);
+
+    // Drains the ring into the folded-stack counts. Frames are "main", one
+    // "sub_<target>" per CALL and a leaf naming the instruction, prefixed by
+    // its source line when lines (one per bytecode address, 0 if unknown)
+    // cover it.
+    void collect(BytecodeView program, const std::vector<int32_t>& lines);
+    bool needsCollect() const;
+    void writeFolded(std::ostream& out) const;
+    long long getSampleCount() const { return samples; }
+    long long getDroppedCount() const { return dropped; }
+
+private:
+    int hz;
+    bool active;
+    uint32_t seed;
+    std::vector<Sample> ring;
+    std::atomic<size_t> head;   // next slot to write, owned by record()
+    std::atomic<size_t> tail;   // next slot to read, owned by collect()
+    std::map<std::string, long long> folded;
+    long long samples;
+    long long dropped;
+};
+
+#endif
@@ -0,0 +1,484 @@
+#include "Trace.h"
+#include "Instruction.h"
+#include "X86Emitter.h"
+#include <map>
+#include <climits>
+
+namespace {
+
+enum TraceOp {
+    T_MOV,      // d = a
+    T_ADD,      // d = a + b
+    T_SUB,
+    T_MUL,
+    T_DIV,
+    T_LT,       // d = a < b
+    T_EXIT_Z,   // leave through exit if a == 0
+    T_EXIT_NZ,
+    T_EXIT_LT,  // leave through exit if a < b
+    T_EXIT_GE
+};
+
+struct TraceIns {
+    TraceOp op;
+    int d;
+    TraceValue a;
+    TraceValue b;
+    int exit;
+};
+
+struct TraceMove {
+    int slot;
+    TraceValue value;
+};
+
+// Linear code for one iteration plus the moves that carry stack values
+// around the back edge.
+struct TraceCode {
+    std::vector<TraceIns> body;
+    std::vector<TraceMove> backEdge;
+};
+
+const int MAX_SLOTS = 11;
+
+TraceValue immediate(int32_t v) { return {true, v}; }
+TraceValue slotValue(int s) { return {false, s}; }
+
+bool sameValue(TraceValue x, TraceValue y) {
+    return x.isImm == y.isImm && x.value == y.value;
+}
+
+// Folds with the two's-complement wraparound of the generated code
+int32_t fold(TraceOp op, int32_t a, int32_t b) {
+    uint32_t x = (uint32_t)a, y = (uint32_t)b;
+    switch (op) {
+        case T_ADD: return (int32_t)(x + y);
+        case T_SUB: return (int32_t)(x - y);
+        case T_MUL: return (int32_t)(x * y);
+        case T_DIV: return a / b;
+        default:    return a < b;
+    }
+}
+
+// Abstract interpretation of the recorded operand stack. The stack starts
+// empty; popping past its bottom discovers a value that was on the real stack
+// when the iteration began, which then lives in an entry slot.
+class TraceBuilder {
+public:
+    explicit TraceBuilder(Trace& trace) : t(trace), consumed(0), rise(0), pending(-1) {}
+
+    bool build(const std::vector<TraceStep>& steps, TraceCode& out, std::string& error);
+
+private:
+    Trace& t;
+    std::vector<TraceValue> stack;
+    std::vector<TraceIns> code;
+    std::map<int, int> varSlot;
+    std::vector<int> temps;
+    int consumed;
+    int rise;
+    int pending;
+
+    int newSlot() { return t.numSlots++; }
+    int var(int index);
+    int freeTemp() const;
+    bool referenced(int slot) const;
+    void need(size_t n);
+    TraceValue pop();
+    void push(TraceValue v);
+    void emit(TraceOp op, int d, TraceValue a, TraceValue b, int exit = -1);
+    int exitAt(int pc, int count);
+    void binary(TraceOp op);
+    void store(int index);
+    void branch(const TraceStep& step, int count);
+};
+
+int TraceBuilder::var(int index) {
+    auto it = varSlot.find(index);
+    if (it != varSlot.end()) return it->second;
+    int s = newSlot();
+    varSlot[index] = s;
+    t.vars.push_back({index, s});
+    return s;
+}
+
+bool TraceBuilder::referenced(int slot) const {
+    for (const TraceValue& v : stack) {
+        if (!v.isImm && v.value == slot) return true;
+    }
+    return false;
+}
+
+// Temporaries have no fixed home in a linear trace: any one no longer on
+// the abstract stack can be reused
+int TraceBuilder::freeTemp() const {
+    for (int s : temps) {
+        if (!referenced(s)) return s;
+    }
+    return -1;
+}
+
+void TraceBuilder::need(size_t n) {
+    while (stack.size() < n) {
+        int s = newSlot();
+        t.entrySlots.push_back(s);
+        stack.insert(stack.begin(), slotValue(s));
+        consumed++;
+    }
+}
+
+TraceValue TraceBuilder::pop() {
+    need(1);
+    TraceValue v = stack.back();
+    stack.pop_back();
+    return v;
+}
+
+void TraceBuilder::push(TraceValue v) {
+    stack.push_back(v);
+    int depth = (int)stack.size() - consumed;
+    if (depth > rise) rise = depth;
+}
+
+void TraceBuilder::emit(TraceOp op, int d, TraceValue a, TraceValue b, int exit) {
+    code.push_back({op, d, a, b, exit});
+    pending = -1;
+}
+
+int TraceBuilder::exitAt(int pc, int count) {
+    t.exits.push_back({pc, count, rise, consumed, stack});
+    return (int)t.exits.size() - 1;
+}
+
+void TraceBuilder::binary(TraceOp op) {
+    TraceValue b = pop();
+    TraceValue a = pop();
+    if (a.isImm && b.isImm && !(op == T_DIV && a.value == INT_MIN && b.value == -1)) {
+        push(immediate(fold(op, a.value, b.value)));
+        return;
+    }
+    int d = freeTemp();
+    if (d < 0) {
+        d = newSlot();
+        temps.push_back(d);
+    }
+    emit(op, d, a, b);
+    pending = (int)code.size() - 1;
+    push(slotValue(d));
+}
+
+void TraceBuilder::store(int index) {
+    need(1);
+    int s = var(index);
+    bool spilled = false;
+    for (size_t i = 0; i + 1 < stack.size(); i++) {
+        if (stack[i].isImm || stack[i].value != s) continue;
+        int copy = freeTemp();
+        if (copy < 0) {
+            copy = newSlot();
+            temps.push_back(copy);
+        }
+        emit(T_MOV, copy, stack[i], immediate(0));
+        stack[i] = slotValue(copy);
+        spilled = true;
+    }
+
+    int last = pending;
+    TraceValue v = pop();
+    if (sameValue(v, slotValue(s))) return;
+    if (!spilled && last >= 0 && !v.isImm && code[last].d == v.value && !referenced(v.value)) {
+        code[last].d = s;
+        pending = -1;
+        return;
+    }
+    emit(T_MOV, s, v, immediate(0));
+}
+
+void TraceBuilder::branch(const TraceStep& step, int count) {
+    TraceValue cond = pop();
+    if (cond.isImm || step.target == step.pc + 2) return;
+
+    bool exitWhenZero = (step.opcode == OP_JZ) ? !step.taken : step.taken;
+    int exit = exitAt(step.taken ? step.pc + 2 : step.target, count);
+    if (pending >= 0 && code[pending].op == T_LT && code[pending].d == cond.value &&
+        !referenced(cond.value)) {
+        TraceIns lt = code[pending];
+        code.pop_back();
+        emit(exitWhenZero ? T_EXIT_GE : T_EXIT_LT, 0, lt.a, lt.b, exit);
+    } else {
+        emit(exitWhenZero ? T_EXIT_Z : T_EXIT_NZ, 0, cond, immediate(0), exit);
+    }
+}
+
+bool TraceBuilder::build(const std::vector<TraceStep>& steps, TraceCode& out, std::string& error) {
+    for (size_t i = 0; i < steps.size(); i++) {
+        const TraceStep& step = steps[i];
+        switch (step.opcode) {
+            case OP_PUSH: push(immediate(step.operand)); break;
+            case OP_POP:  pop(); break;
+            case OP_DUP: {
+                TraceValue v = pop();
+                push(v);
+                push(v);
+                break;
+            }
+            case OP_ADD: binary(T_ADD); break;
+            case OP_SUB: binary(T_SUB); break;
+            case OP_MUL: binary(T_MUL); break;
+            case OP_CMP: binary(T_LT); break;
+            case OP_DIV:
+                // Exit before a zero divisor so the interpreter raises the trap
+                need(2);
+                if (!stack.back().isImm) {
+                    int exit = exitAt(step.pc, (int)i);
+                    emit(T_EXIT_Z, 0, stack.back(), immediate(0), exit);
+                }
+                binary(T_DIV);
+                break;
+            case OP_LOAD:  push(slotValue(var(step.operand))); break;
+            case OP_STORE: store(step.operand); break;
+            case OP_JZ:
+            case OP_JNZ:   branch(step, (int)i + 1); break;
+            case OP_JMP:   break;
+            default:
+                error = "unsupported opcode in trace";
+                return false;
+        }
+    }
+
+    if ((int)stack.size() != consumed) {
+        error = "loop changes the stack depth";
+        return false;
+    }
+    for (int k = 0; k < consumed; k++) {
+        TraceValue v = stack[consumed - 1 - k];
+        if (!sameValue(v, slotValue(t.entrySlots[k]))) out.backEdge.push_back({t.entrySlots[k], v});
+    }
+    if (t.numSlots > MAX_SLOTS) {
+        error = "too many live values";
+        return false;
+    }
+    t.rise = rise;
+    out.body = code;
+    return true;
+}
+
+}  // namespace
+
+Trace::Trace(const std::vector<TraceStep>& steps)
+    : length((int)steps.size()), rise(0), numSlots(0), buffer(nullptr), size(0) {
+    compile(steps);
+}
+
+bool Trace::canRecord(int32_t opcode) {
+    switch (opcode) {
+        case OP_PUSH: case OP_POP: case OP_DUP:
+        case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_CMP:
+        case OP_JMP: case OP_JZ: case OP_JNZ:
+        case OP_LOAD: case OP_STORE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+#if VM_JIT_AVAILABLE
+
+// Value slots live in these registers for the whole trace; rax, rcx and rdx
+// are scratch and r15 counts completed iterations.
+static const int SLOT_REGS[MAX_SLOTS] = {3, 5, 12, 13, 14, 6, 7, 8, 9, 10, 11};
+
+static_assert(offsetof(TraceState, exit) < 128, "TraceState fields need disp8 offsets");
+
+namespace {
+
+enum Alu { ALU_ADD, ALU_SUB, ALU_CMP, ALU_IMUL };
+
+uint8_t modrm(int reg, int rm) { return (uint8_t)(0xC0 | (reg & 7) << 3 | (rm & 7)); }
+
+void rex(Emitter& e, int reg, int rm) {
+    uint8_t prefix = (uint8_t)(0x40 | (reg >> 3) << 2 | (rm >> 3));
+    if (prefix != 0x40) e.emit({prefix});
+}
+
+void movRR(Emitter& e, int dst, int src) {
+    if (dst == src) return;
+    rex(e, src, dst);
+    e.emit({0x89, modrm(src, dst)});
+}
+
+void load(Emitter& e, int reg, TraceValue v) {
+    if (!v.isImm) {
+        movRR(e, reg, SLOT_REGS[v.value]);
+        return;
+    }
+    rex(e, 0, reg);
+    e.emit({(uint8_t)(0xB8 + (reg & 7))});
+    e.imm32(v.value);
+}
+
+// reg = reg <op> v, 32-bit
+void apply(Emitter& e, Alu op, int reg, TraceValue v) {
+    if (v.isImm) {
+        if (op == ALU_IMUL) {
+            rex(e, reg, reg);
+            e.emit({0x69, modrm(reg, reg)});
+        } else {
+            static const int ext[] = {0, 5, 7};
+            rex(e, 0, reg);
+            e.emit({0x81, modrm(ext[op], reg)});
+        }
+        e.imm32(v.value);
+        return;
+    }
+    int src = SLOT_REGS[v.value];
+    if (op == ALU_IMUL) {
+        rex(e, reg, src);
+        e.emit({0x0F, 0xAF, modrm(reg, src)});
+    } else {
+        static const uint8_t opcode[] = {0x01, 0x29, 0x39};
+        rex(e, src, reg);
+        e.emit({opcode[op], modrm(src, reg)});
+    }
+}
+
+void compare(Emitter& e, TraceValue a, TraceValue b) {
+    int reg = 0;
+    if (a.isImm) load(e, 0, a);
+    else reg = SLOT_REGS[a.value];
+    apply(e, ALU_CMP, reg, b);
+}
+
+void arithmetic(Emitter& e, Alu op, int d, TraceValue a, TraceValue b) {
+    if (!b.isImm && SLOT_REGS[b.value] == d && (a.isImm || SLOT_REGS[a.value] != d)) {
+        load(e, 0, a);
+        apply(e, op, 0, b);
+        movRR(e, d, 0);
+        return;
+    }
+    load(e, d, a);
+    apply(e, op, d, b);
+}
+
+}  // namespace
+
+Trace::~Trace() {
+    if (buffer) munmap(buffer, size);
+}
+
+void Trace::enter(TraceState& state) const {
+    reinterpret_cast<void (*)(TraceState*)>(buffer)(&state);
+}
+
+void Trace::compile(const std::vector<TraceStep>& steps) {
+    TraceCode ir;
+    TraceBuilder builder(*this);
+    if (!builder.build(steps, ir, error)) return;
+
+    Emitter e;
+    std::vector<std::vector<size_t>> exitSites(exits.size());
+
+    // Prologue: save callee-saved registers and the state pointer, load every
+    // value slot into its register
+    e.emit({0x55, 0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57, 0x57});
+    e.emit({0x48, 0x8B, 0x47}); e.disp8(offsetof(TraceState, slots));
+    e.emit({0x45, 0x31, 0xFF});                             // xor r15d, r15d
+    for (int s = 0; s < numSlots; s++) {
+        int reg = SLOT_REGS[s];
+        rex(e, reg, 0);
+        e.emit({0x8B, (uint8_t)(0x40 | (reg & 7) << 3)}); e.disp8(4 * s);
+    }
+
+    size_t loopTop = e.pos();
+    for (const TraceIns& in : ir.body) {
+        int d = SLOT_REGS[in.d];
+        switch (in.op) {
+            case T_MOV: load(e, d, in.a); break;
+            case T_ADD: arithmetic(e, ALU_ADD, d, in.a, in.b); break;
+            case T_SUB: arithmetic(e, ALU_SUB, d, in.a, in.b); break;
+            case T_MUL: arithmetic(e, ALU_IMUL, d, in.a, in.b); break;
+            case T_DIV:
+                load(e, 0, in.a);
+                load(e, 1, in.b);
+                e.emit({0x99, 0xF7, 0xF9});                 // cdq; idiv ecx
+                movRR(e, d, 0);
+                break;
+            case T_LT:
+                compare(e, in.a, in.b);
+                e.emit({0x0F, 0x9C, 0xC0, 0x0F, 0xB6, 0xC0}); // setl al; movzx eax, al
+                movRR(e, d, 0);
+                break;
+            case T_EXIT_Z:
+            case T_EXIT_NZ: {
+                int reg = SLOT_REGS[in.a.value];
+                rex(e, reg, reg);
+                e.emit({0x85, modrm(reg, reg)});
+                exitSites[in.exit].push_back(e.jcc(in.op == T_EXIT_Z ? CC_Z : CC_NZ));
+                break;
+            }
+            case T_EXIT_LT:
+            case T_EXIT_GE:
+                compare(e, in.a, in.b);
+                exitSites[in.exit].push_back(e.jcc(in.op == T_EXIT_LT ? CC_L : CC_GE));
+                break;
+        }
+    }
+
+    // Back edge: carried stack values move in parallel through the machine stack
+    for (const TraceMove& move : ir.backEdge) {
+        if (move.value.isImm) {
+            e.emit({0x68}); e.imm32(move.value.value);
+        } else {
+            int reg = SLOT_REGS[move.value.value];
+            rex(e, 0, reg);
+            e.emit({(uint8_t)(0x50 + (reg & 7))});
+        }
+    }
+    for (auto it = ir.backEdge.rbegin(); it != ir.backEdge.rend(); ++it) {
+        int reg = SLOT_REGS[it->slot];
+        rex(e, 0, reg);
+        e.emit({(uint8_t)(0x58 + (reg & 7))});
+    }
+    e.emit({0x49, 0xFF, 0xC7});                             // inc r15
+    e.bind(e.jmp(), loopTop);
+
+    // Exit stubs leave the exit index in ecx
+    std::vector<size_t> epilogueSites;
+    for (size_t i = 0; i < exits.size(); i++) {
+        if (exitSites[i].empty()) continue;
+        for (size_t site : exitSites[i]) e.bind(site, e.pos());
+        e.emit({0xB9}); e.imm32((int32_t)i);
+        epilogueSites.push_back(e.jmp());
+    }
+
+    // Epilogue: store the value slots and the result, restore registers
+    size_t epilogue = e.pos();
+    for (size_t site : epilogueSites) e.bind(site, epilogue);
+    e.emit({0x48, 0x8B, 0x04, 0x24});                       // mov rax, [rsp]
+    e.emit({0x48, 0x8B, 0x50}); e.disp8(offsetof(TraceState, slots));
+    for (int s = 0; s < numSlots; s++) {
+        int reg = SLOT_REGS[s];
+        rex(e, reg, 0);
+        e.emit({0x89, (uint8_t)(0x42 | (reg & 7) << 3)}); e.disp8(4 * s);
+    }
+    e.emit({0x89, 0x48}); e.disp8(offsetof(TraceState, exit));
+    e.emit({0x4C, 0x89, 0x78}); e.disp8(offsetof(TraceState, iterations));
+    e.emit({0x5F, 0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5B, 0x5D, 0xC3});
+
+    buffer = e.install();
+    if (buffer) size = e.pos();
+    else error = "cannot map executable memory";
+}
+
+#else
+
+Trace::~Trace() {}
+void Trace::enter(TraceState&) const {}
+
+void Trace::compile(const std::vector<TraceStep>& steps) {
+    TraceCode ir;
+    TraceBuilder builder(*this);
+    if (builder.build(steps, ir, error)) error = "tracing JIT needs x86-64 Linux";
+}
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+#include "Jit.h"
+
+// One interpreted instruction of a recorded loop iteration.
+struct TraceStep {
+    int32_t pc;
+    int32_t opcode;
+    int32_t operand;
+    int32_t target;
+    bool taken;     // JZ/JNZ outcome while recording
+};
+
+// A snapshot operand: an immediate or a value slot of the compiled trace.
+struct TraceValue {
+    bool isImm;
+    int32_t value;
+};
+
+// Interpreter state to rebuild when a guard fails. The stack entries replace
+// the `consumed` entry values the iteration had popped so far.
+struct TraceExit {
+    int32_t pc;
+    int32_t count;      // instructions of the failing iteration that ran
+    int32_t rise;       // highest stack depth of that iteration, above entry
+    int32_t consumed;
+    std::vector<TraceValue> stack;
+};
+
+// Shared with generated code: value slots in, exit index and completed
+// iterations out.
+struct TraceState {
+    int32_t* slots;
+    long long iterations;
+    int32_t exit;
+};
+
+// Compiles one recorded iteration of a loop into native code that repeats it
+// until a guard fails. Variables and the stack values carried around the
+// loop live in machine registers; constants are folded while recording's
+// operand stack is interpreted abstractly.
+class Trace {
+public:
+    explicit Trace(const std::vector<TraceStep>& steps);
+    ~Trace();
+    Trace(const Trace&) = delete;
+    Trace& operator=(const Trace&) = delete;
+
+    static bool canRecord(int32_t opcode);
+
+    bool valid() const { return buffer != nullptr; }
+    const std::string& getError() const { return error; }
+    void enter(TraceState& state) const;
+    size_t codeSize() const { return size; }
+
+    int length;                                 // instructions per iteration
+    int rise;                                   // stack rise of a full iteration
+    int numSlots;
+    std::vector<std::pair<int, int>> vars;      // (memory index, slot)
+    std::vector<int> entrySlots;                // slot of the k-th value below the top
+    std::vector<TraceExit> exits;
+
+private:
+    void* buffer;
+    size_t size;
+    std::string error;
+
+    void compile(const std::vector<TraceStep>& steps);
+};
+
+#endif
@@ -4,6 +4,49 @@
 #include "Object.h"
 #include <cstdint>
 
+// Build-time value layout: 8-byte tagged words by default; define
+// VM_WIDE_VALUES for the 16-byte type + union layout.
+#ifndef VM_WIDE_VALUES
+#define VM_TAGGED_VALUES 1
+#else
+#define VM_TAGGED_VALUES 0
+#endif
+
+#if VM_TAGGED_VALUES
+
+// One 64-bit word. Integers sit in the high 32 bits with the low bits clear,
+// so a zeroed word is the integer 0 and the payload is one 32-bit load at
+// offset 4. Objects are at least 2-byte aligned and carry a low-bit tag of 1.
+struct Value {
+    uint64_t bits;
+
+    Value() : bits(0) {}
+};
+
+static_assert(sizeof(Value) == 8, "tagged Values are one word");
+static_assert(alignof(Object) >= 2, "object pointers need a free low bit");
+
+#define VALUE_OBJ_TAG 1ULL
+
+#define IS_INT(v) (((v).bits & VALUE_OBJ_TAG) == 0)
+#define IS_OBJ(v) (((v).bits & VALUE_OBJ_TAG) != 0)
+#define AS_INT(v) ((int32_t)((v).bits >> 32))
+#define AS_OBJ(v) ((Object*)(uintptr_t)((v).bits & ~VALUE_OBJ_TAG))
+
+inline Value INT_VAL(int32_t val) {
+    Value v;
+    v.bits = (uint64_t)(uint32_t)val << 32;
+    return v;
+}
+
+inline Value OBJ_VAL(Object* obj) {
+    Value v;
+    v.bits = (uint64_t)(uintptr_t)obj | VALUE_OBJ_TAG;
+    return v;
+}
+
+#else
+
 enum ValueType { VAL_INT, VAL_OBJ };
 
 struct Value {
@@ -34,4 +77,6 @@ inline Value OBJ_VAL(Object* obj) {
     return v;
 }
 
+#endif
+
 #endif
\ No newline at end of file
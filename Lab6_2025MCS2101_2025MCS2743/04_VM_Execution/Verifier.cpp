@@ -0,0 +1,291 @@
+#include "Verifier.h"
+#include "VirtualMachine.h"
+#include "Instruction.h"
+#include <sstream>
+#include <algorithm>
+#include <map>
+#include <deque>
+#include <climits>
+
+namespace {
+
+// Stack effect of an opcode: entries popped, entries pushed
+void stackEffect(int32_t opcode, int& pops, int& pushes) {
+    pops = 0;
+    pushes = 0;
+    switch (opcode) {
+        case OP_PUSH: case OP_LOAD: pushes = 1; break;
+        case OP_DUP: pops = 1; pushes = 2; break;
+        case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_CMP:
+            pops = 2; pushes = 1; break;
+        case OP_POP: case OP_STORE: case OP_PRINT: case OP_JZ: case OP_JNZ:
+            pops = 1; break;
+        default: break;
+    }
+}
+
+bool isBranch(int32_t opcode) {
+    return opcode == OP_JMP || opcode == OP_JZ || opcode == OP_JNZ || opcode == OP_CALL;
+}
+
+std::string opName(int32_t opcode) {
+    std::string name = VM::getOpcodeName(opcode);
+    name.erase(name.find_last_not_of(' ') + 1);
+    return name;
+}
+
+bool reject(Verification& out, int pc, const std::string& message) {
+    out.valid = false;
+    out.balanced = false;
+    out.errorPc = pc;
+    out.error = "pc " + std::to_string(pc) + ": " + message;
+    return false;
+}
+
+bool checkStructure(BytecodeView program, size_t memorySlots,
+                    std::vector<bool>& isStart, Verification& out) {
+    const int size = (int)program.size();
+    isStart.assign(size, false);
+    for (int addr = 0; addr < size;) {
+        int32_t opcode = program[addr];
+        int operands = operandCount(opcode);
+        if (operands < 0) {
+            std::ostringstream message;
+            message << "unknown opcode 0x" << std::hex << opcode;
+            return reject(out, addr, message.str());
+        }
+        if (addr + operands >= size) return reject(out, addr, opName(opcode) + " is missing its operand");
+        isStart[addr] = true;
+        addr += 1 + operands;
+    }
+    for (int addr = 0; addr < size; addr++) {
+        if (!isStart[addr]) continue;
+        int32_t opcode = program[addr];
+        int32_t operand = operandCount(opcode) ? program[addr + 1] : 0;
+        if (isBranch(opcode)) {
+            if (operand < 0 || operand >= size) {
+                return reject(out, addr, opName(opcode) + " target " + std::to_string(operand) +
+                                         " is outside the program (0.." + std::to_string(size - 1) + ")");
+            }
+            if (!isStart[operand]) {
+                return reject(out, addr, opName(opcode) + " target " + std::to_string(operand) +
+                                         " is not an instruction boundary");
+            }
+        }
+        if ((opcode == OP_LOAD || opcode == OP_STORE) && (operand < 0 || (size_t)operand >= memorySlots)) {
+            return reject(out, addr, opName(opcode) + " memory index " + std::to_string(operand) +
+                                     " is out of range (0.." + std::to_string(memorySlots - 1) + ")");
+        }
+    }
+    return true;
+}
+
+// Stack behaviour of one procedure, depths relative to its entry
+struct Procedure {
+    int entry;
+    std::vector<int> body;      // reachable instruction addresses
+    std::vector<int> callees;
+    bool bounded = true;
+    bool returns = false;
+    int rise = 0;               // highest depth reached, nested calls included
+    int net = 0;                // highest depth at a RET
+    int calls = 0;              // deepest CALL chain below it
+};
+
+void findBody(BytecodeView program, const std::map<int, int>& index, Procedure& proc) {
+    const int size = (int)program.size();
+    std::vector<bool> seen(size, false);
+    std::vector<int> work = {proc.entry};
+    seen[proc.entry] = true;
+    while (!work.empty()) {
+        int addr = work.back();
+        work.pop_back();
+        proc.body.push_back(addr);
+        int32_t opcode = program[addr];
+        int next[2];
+        int count = 0;
+        if (opcode == OP_CALL) {
+            int callee = index.at(program[addr + 1]);
+            if (std::find(proc.callees.begin(), proc.callees.end(), callee) == proc.callees.end()) {
+                proc.callees.push_back(callee);
+            }
+            next[count++] = addr + 2;
+        } else if (opcode != OP_RET) {
+            if (opcode != OP_JMP && opcode != OP_HALT) next[count++] = addr + 1 + operandCount(opcode);
+            if (isBranch(opcode)) next[count++] = program[addr + 1];
+        }
+        for (int i = 0; i < count; i++) {
+            if (next[i] >= size || seen[next[i]]) continue;
+            seen[next[i]] = true;
+            work.push_back(next[i]);
+        }
+    }
+}
+
+// Longest path of depths through proc, with its callees already summarized
+void summarize(BytecodeView program, const std::map<int, int>& index,
+               std::vector<Procedure>& procs, Procedure& proc, std::vector<int>& depth) {
+    const int size = (int)program.size();
+    const int unseen = INT_MIN;
+    // FIFO relaxation: without a cycle that gains depth, no address is taken
+    // from the queue more often than there are instructions in the body
+    std::map<int, int> visits;
+    std::deque<int> work = {proc.entry};
+    std::map<int, bool> queued = {{proc.entry, true}};
+    depth[proc.entry] = 0;
+    for (int callee : proc.callees) {
+        const Procedure& q = procs[callee];
+        if (!q.bounded) proc.bounded = false;
+        proc.calls = std::max(proc.calls, 1 + q.calls);
+    }
+    while (proc.bounded && !work.empty()) {
+        int addr = work.front();
+        work.pop_front();
+        queued[addr] = false;
+        if (++visits[addr] > (int)proc.body.size()) {
+            proc.bounded = false;
+            break;
+        }
+        int32_t opcode = program[addr];
+        int d = depth[addr];
+        proc.rise = std::max(proc.rise, d);
+        int after;
+        int next[2];
+        int count = 0;
+        if (opcode == OP_CALL) {
+            const Procedure& q = procs[index.at(program[addr + 1])];
+            proc.rise = std::max(proc.rise, d + q.rise);
+            if (!q.returns) continue;
+            after = d + q.net;
+            next[count++] = addr + 2;
+        } else if (opcode == OP_RET) {
+            proc.net = proc.returns ? std::max(proc.net, d) : d;
+            proc.returns = true;
+            continue;
+        } else {
+            int pops, pushes;
+            stackEffect(opcode, pops, pushes);
+            after = d - pops + pushes;
+            proc.rise = std::max(proc.rise, after);
+            if (opcode != OP_JMP && opcode != OP_HALT) next[count++] = addr + 1 + operandCount(opcode);
+            if (isBranch(opcode)) next[count++] = program[addr + 1];
+        }
+        for (int i = 0; i < count; i++) {
+            if (next[i] >= size || (depth[next[i]] != unseen && depth[next[i]] >= after)) continue;
+            depth[next[i]] = after;
+            if (queued[next[i]]) continue;
+            queued[next[i]] = true;
+            work.push_back(next[i]);
+        }
+    }
+    for (int addr : proc.body) depth[addr] = unseen;
+}
+
+void computeBounds(BytecodeView program, const std::vector<bool>& isStart, Verification& out) {
+    const int size = (int)program.size();
+    if (size == 0) {
+        out.maxDepth = 0;
+        out.maxCallDepth = 0;
+        return;
+    }
+    std::vector<Procedure> procs;
+    std::map<int, int> index;
+    procs.push_back(Procedure());
+    procs[0].entry = 0;
+    index[0] = 0;
+    for (int addr = 0; addr < size; addr++) {
+        if (!isStart[addr] || program[addr] != OP_CALL || index.count(program[addr + 1])) continue;
+        index[program[addr + 1]] = (int)procs.size();
+        procs.push_back(Procedure());
+        procs.back().entry = program[addr + 1];
+    }
+    for (Procedure& proc : procs) findBody(program, index, proc);
+
+    // Callees before callers; a CALL back into an active procedure is recursion
+    std::vector<int> order;
+    std::vector<int> state(procs.size(), 0);   // 0 new, 1 active, 2 done
+    std::vector<std::pair<int, size_t>> stack = {{0, 0}};
+    state[0] = 1;
+    while (!stack.empty()) {
+        auto& [current, next] = stack.back();
+        if (next < procs[current].callees.size()) {
+            int callee = procs[current].callees[next++];
+            if (state[callee] == 1) return;
+            if (state[callee] == 0) {
+                state[callee] = 1;
+                stack.push_back({callee, 0});
+            }
+            continue;
+        }
+        state[current] = 2;
+        order.push_back(current);
+        stack.pop_back();
+    }
+
+    std::vector<int> depth(size, INT_MIN);
+    for (int p : order) summarize(program, index, procs, procs[p], depth);
+    if (!procs[0].bounded) return;
+    out.maxDepth = procs[0].rise;
+    out.maxCallDepth = procs[0].calls;
+}
+
+} // namespace
+
+void Verifier::verify(BytecodeView program, size_t memorySlots, Verification& out) {
+    out = Verification();
+    const int size = (int)program.size();
+    out.depth.assign(size, -1);
+    std::vector<bool> isStart;
+    if (!checkStructure(program, memorySlots, isStart, out)) return;
+    computeBounds(program, isStart, out);
+    for (int addr = 0; addr < size; addr++) {
+        if (isStart[addr] && (program[addr] == OP_CALL || program[addr] == OP_RET)) return;
+    }
+
+    // Depth on entry to each reachable instruction, propagated along every
+    // edge. Underflow is judged only once the depths are known to agree, so
+    // the verdict does not depend on the order paths are explored in.
+    std::vector<int> depth(size, 0);
+    std::vector<bool> reached(size, false);
+    std::vector<int> work;
+    if (size > 0) {
+        reached[0] = true;
+        work.push_back(0);
+    }
+    while (!work.empty()) {
+        int addr = work.back();
+        work.pop_back();
+        int32_t opcode = program[addr];
+        int pops, pushes;
+        stackEffect(opcode, pops, pushes);
+        int after = depth[addr] - pops + pushes;
+        int next[2];
+        int count = 0;
+        if (opcode != OP_JMP && opcode != OP_HALT) next[count++] = addr + 1 + operandCount(opcode);
+        if (isBranch(opcode)) next[count++] = program[addr + 1];
+        for (int i = 0; i < count; i++) {
+            if (next[i] >= size) continue;
+            if (!reached[next[i]]) {
+                reached[next[i]] = true;
+                depth[next[i]] = after;
+                work.push_back(next[i]);
+            } else if (depth[next[i]] != after) {
+                // Legal, but underflow is then left to the runtime checks
+                return;
+            }
+        }
+    }
+    for (int addr = 0; addr < size; addr++) {
+        if (!reached[addr]) continue;
+        int pops, pushes;
+        stackEffect(program[addr], pops, pushes);
+        if (depth[addr] < pops) {
+            reject(out, addr, opName(program[addr]) + " needs " + std::to_string(pops) +
+                               " stack value" + (pops == 1 ? "" : "s") + ", " +
+                               std::to_string(std::max(depth[addr], 0)) + " available");
+            return;
+        }
+        out.depth[addr] = depth[addr];
+    }
+    out.balanced = true;
+}
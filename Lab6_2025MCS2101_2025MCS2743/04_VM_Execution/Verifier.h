@@ -0,0 +1,41 @@
+#ifndef VERIFIER_H
+#define VERIFIER_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include "Bytecode.h"
+
+// Outcome of verifying a program once, when its VM is constructed.
+struct Verification {
+    bool valid = true;          // false rejects the program; error says why
+    bool balanced = false;      // every reachable instruction has one stack depth,
+                                // never below the operands it pops
+    int errorPc = -1;
+    std::string error;
+    std::vector<int32_t> depth; // stack depth on entry per address, -1 if unknown
+    int maxDepth = -1;          // highest operand-stack depth, -1 if unbounded
+    int maxCallDepth = -1;      // deepest chain of CALLs, -1 if unbounded
+};
+
+// Load-time bytecode verifier. Structural checks reject the program: unknown
+// opcodes, missing operands, jump or call targets outside the program or not
+// on an instruction boundary (found by a linear sweep from address 0), and
+// memory indices outside [0, memorySlots). A data-flow pass over the reachable
+// code then propagates stack depths through each basic block; an instruction
+// that pops more than its depth is rejected. Depths that differ between the
+// paths into an instruction (a loop that grows the stack) or CALL/RET, whose
+// depth depends on the caller, leave the program valid but not balanced.
+//
+// Valid programs also get static bounds. Each procedure (address 0 and every
+// CALL target) is summarized, callees first, by the longest path of stack
+// depths through it; a CALL adds its callee's peak and the depth it returns
+// with. Recursion, or a cycle that raises the depth, makes the bounds
+// unknown. For balanced programs the operand bound is exact.
+class Verifier {
+public:
+    static void verify(BytecodeView program, size_t memorySlots, Verification& out);
+};
+
+#endif
@@ -1,285 +1,1466 @@
-#include "VirtualMachine.h"
-#include "Instruction.h"
-#include <iostream>
-
-VM::VM(const std::vector<int32_t>& bytecode)
-    : program(bytecode), 
-      memory(1024, INT_VAL(0)),      
-      objects(nullptr),  
-      instructionCount(0),
-      maxStackDepth(0),
-      pc(0), 
-      running(true) {}
-
-VM::~VM() {
-    Object* obj = objects;
-    while (obj != nullptr) {
-        Object* next = obj->next;
-        delete obj;
-        obj = next;
-    }
-}
-
-int VM::getObjectCount() {
-    int count = 0;
-    Object* obj = objects;
-    while (obj != nullptr) {
-        count++;
-        obj = obj->next;
-    }
-    return count;
-}
-
-void VM::printRegisters() {
-    std::cout << "--- VM Register State ---" << std::endl;
-    std::cout << "PC    : " << pc << std::endl;
-    std::cout << "Stack : [ ";
-    for (const auto& v : stack) {
-        std::cout << AS_INT(v) << " ";
-    }
-    std::cout << "]" << std::endl;
-}
-
-void VM::setBreakpoint(int address) {
-    breakpoints.insert(address);
-    std::cout << "Breakpoint set at " << address << std::endl;
-}
-
-void VM::clearBreakpoint(int address) {
-    breakpoints.erase(address);
-    std::cout << "Breakpoint removed from " << address << std::endl;
-}
-
-void VM::executeNext() {
-    if (!running || pc >= (int)program.size()) return;
-
-    if (breakpoints.count(pc)) {
-        std::cout << "Breakpoint hit at PC: " << pc << std::endl;
-        return; 
-    }
-
-    execute(program[pc++]);
-    instructionCount++;
-}
-
-void VM::run() {
-    running = true;
-    while (running && pc < (int)program.size()) {
-        if (breakpoints.count(pc)) {
-            std::cout << "Stopped at breakpoint: " << pc << std::endl;
-            break;
-        }
-        execute(program[pc++]);
-        instructionCount++;
-    }
-}
-
-void VM::printHeapStatus() {
-    int count = getObjectCount();
-    std::cout << "Heap objects : " << count << std::endl;
-}
-
-void VM::push(Value v) {
-    stack.push_back(v);
-    updateMaxStackDepth();
-}
-
-void VM::pushStack(Value v) {
-    push(v);
-}
-
-Value VM::pop() {
-    if (stack.empty()) {
-        std::cerr << "Stack underflow\n";
-        running = false;
-        return INT_VAL(0);
-    }
-    Value v = stack.back();
-    stack.pop_back();
-    return v;
-}
-
-Object* VM::allocatePair(Object* a, Object* b) {
-    ObjPair* pair = new ObjPair();
-    pair->obj.type = OBJ_PAIR;
-    pair->obj.marked = false;
-    pair->obj.next = objects;
-    objects = (Object*)pair;
-
-    pair->left = a;
-    pair->right = b;
-    return (Object*)pair;
-}
-
-void VM::markObject(Object* obj) {
-    if (obj == nullptr || obj->marked) return;
-    obj->marked = true; 
-    if (obj->type == OBJ_PAIR) {
-        ObjPair* pair = (ObjPair*)obj;
-        markObject(pair->left);
-        markObject(pair->right);
-    }
-}
-
-void VM::markValue(Value v) {
-    if (IS_OBJ(v)) markObject(AS_OBJ(v));
-}
-
-int VM::sweep() {
-    int freedCount = 0;
-    Object** object = &objects;
-    while (*object != nullptr) {
-        if (!(*object)->marked) {
-            Object* unreached = *object;
-            *object = unreached->next; 
-            delete unreached;          
-            freedCount++;
-        } else {
-            (*object)->marked = false;
-            object = &(*object)->next;
-        }
-    }
-    return freedCount;
-}
-
-GCStats VM::gc() {
-    int initial = getObjectCount();
-    for (const Value& v : stack) markValue(v);
-    for (const Value& v : memory) markValue(v);
-    int freed = sweep();
-    
-    GCStats stats;
-    stats.initialCount = initial;
-    stats.objectsFreed = freed;
-    stats.objectsSurvived = initial - freed;
-    return stats;
-}
-
-void VM::execute(int32_t opcode) {
-    switch (opcode) {
-        case OP_PUSH:
-            push(INT_VAL(program[pc++]));
-            break;
-        case OP_ADD: {
-            Value b = pop(); Value a = pop();
-            push(INT_VAL(AS_INT(a) + AS_INT(b)));
-            break;
-        }
-        case OP_SUB: {
-            Value b = pop(); Value a = pop();
-            push(INT_VAL(AS_INT(a) - AS_INT(b)));
-            break;
-        }
-        case OP_MUL: {
-            Value b = pop(); Value a = pop();
-            push(INT_VAL(AS_INT(a) * AS_INT(b)));
-            break;
-        }
-        case OP_DIV: {
-            Value b = pop(); Value a = pop();
-            if (AS_INT(b) == 0) { std::cerr << "Division by zero\n"; running = false; break; }
-            push(INT_VAL(AS_INT(a) / AS_INT(b)));
-            break;
-        }
-        case OP_CMP: {
-            Value b = pop(); Value a = pop();
-            push(INT_VAL(AS_INT(a) < AS_INT(b) ? 1 : 0));
-            break;
-        }
-        case OP_JMP:
-            pc = program[pc++];
-            break;
-        case OP_JZ: {
-            int32_t addr = program[pc++];
-            if (AS_INT(pop()) == 0) pc = addr;
-            break;
-        }
-        case OP_JNZ: {
-            int32_t addr = program[pc++];
-            if (AS_INT(pop()) != 0) pc = addr;
-            break;
-        }
-        case OP_STORE: {
-            int32_t idx = program[pc++];
-            memory[idx] = pop();
-            break;
-        }
-        case OP_LOAD:
-            push(memory[program[pc++]]);
-            break;
-        case OP_DUP:
-            push(stack.back());
-            break;
-        case OP_POP:
-            pop();
-            break;
-        case OP_CALL: {
-            int32_t addr = program[pc++];
-            callStack.push_back(pc);
-            pc = addr;
-            break;
-        }
-        case OP_RET:
-            pc = callStack.back();
-            callStack.pop_back();
-            break;
-        case OP_PRINT:
-            std::cout << "Output : " << AS_INT(pop()) << std::endl;
-            break;
-        case OP_HALT:
-            running = false;
-            break;
-        default:
-            running = false;
-            break;
-    }
-    updateMaxStackDepth();
-}
-
-void VM::updateMaxStackDepth() {
-    if (stack.size() > maxStackDepth) maxStackDepth = stack.size();
-}
-
-void VM::printFinalStack() {
-    if (stack.empty()) return;
-    std::cout << "Final Stack: ";
-    for (const Value& v : stack) std::cout << AS_INT(v) << " ";
-    std::cout << std::endl;
-}
-
-std::string VM::getOpcodeName(int32_t opcode) {
-    switch (opcode) {
-        case 0x01: return "PUSH ";
-        case 0x02: return "POP  ";
-        case 0x03: return "DUP  ";
-        case 0x10: return "ADD  ";
-        case 0x11: return "SUB  ";
-        case 0x12: return "MUL  ";
-        case 0x13: return "DIV  ";
-        case 0x14: return "CMP  ";
-        case 0x20: return "JMP  ";
-        case 0x21: return "JZ   ";
-        case 0x22: return "JNZ  ";
-        case 0x30: return "STORE";
-        case 0x31: return "LOAD ";
-        case 0x40: return "CALL ";
-        case 0x41: return "RET  ";
-        case 0x42: return "PRINT";
-        case 0xFF: return "HALT ";
-        default:   return "UNKNOWN";
-    }
-}
-
-void VM::printStats() {
-    std::cout << "\n=== Execution Statistics ===\n";
-    std::cout << "Instructions executed: " << instructionCount << std::endl;
-    std::cout << "Max stack depth: " << maxStackDepth << std::endl;
-}
-
-bool VM::validAddress(int addr) {
-    return addr >= 0 && static_cast<size_t>(addr) < program.size();
-}
-
-bool VM::validMemory(int idx) {
-    return idx >= 0 && static_cast<size_t>(idx) < memory.size();
+#include "VirtualMachine.h"
+#include "Instruction.h"
+#include <iostream>
+#include <climits>
+#include <algorithm>
+#include <mutex>
+#include <atomic>
+#include <iomanip>
+#include <ctime>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// runJit gives up after this many entries averaging fewer than
+// JIT_BAILOUT_RUN native instructions each
+static const long long JIT_BAILOUT_ENTRIES = 4096;
+static const long long JIT_BAILOUT_RUN = 16;
+
+// Back-edge count at which the tracing JIT records a loop, and the longest
+// iteration it records
+static const int32_t HOT_LOOP_THRESHOLD = 64;
+static const size_t TRACE_MAX_LENGTH = 512;
+
+// Stack slots a program without a proven depth bound starts with, and the
+// least a full stack grows by
+static const size_t INITIAL_STACK_SLOTS = 256;
+static const size_t MIN_STACK_GROWTH = 64;
+
+// Profiler clock: the time-stamp counter on x86, monotonic nanoseconds elsewhere
+#if defined(__x86_64__) || defined(__i386__)
+static inline uint64_t profileClock() { return __rdtsc(); }
+static const char* const PROFILE_UNIT = "cycles";
+#else
+static inline uint64_t profileClock() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+static const char* const PROFILE_UNIT = "ns";
+#endif
+
+// Heap ids tag each object with the heap that allocated it; fork() gives
+// parent and child new ones, so the objects they share carry neither
+static std::atomic<uint32_t> nextHeapId(1);
+
+// Pairs are the only objects; they are allocated as ObjPair
+static void freeObject(Object* obj) {
+    delete (ObjPair*)obj;
+}
+
+VM::VM(const std::vector<int32_t>& bytecode, size_t stackLimit)
+    : VM(std::make_shared<const std::vector<int32_t>>(bytecode), stackLimit) {}
+
+VM::VM(std::shared_ptr<const std::vector<int32_t>> words, size_t stackLimit)
+    : VM(BytecodeView(*words), words, stackLimit) {}
+
+VM::VM(BytecodeView bytecode, std::shared_ptr<const void> owner, size_t stackLimit)
+    : image(std::move(owner)),
+      program(bytecode),
+      memory(1024, INT_VAL(0)),      
+      objects(nullptr),  
+      heapId(nextHeapId++),
+      instructionCount(0),
+      jitThreshold(DEFAULT_JIT_THRESHOLD),
+      traceEntries(0),
+      maxStackDepth(0),
+      fusionCount(0),
+      stackTop(0),
+      stackLimit(stackLimit),
+      stackCapacity(0),
+      pc(0), 
+      running(true),
+      stoppedAtBreakpoint(false),
+      ranRegisterTier(false),
+      tracing(false),
+      profiling(false),
+      checked(true),
+      stackFull(false),
+      profileOverhead(0),
+      traceAnchor(-1),
+      trap(VMTrap::NONE) {
+    Verifier::verify(program, memory.size(), verification);
+    // A proven bound sizes the stack once; otherwise it starts small and the
+    // checked interpreter grows it on demand, up to stackLimit
+    const int bound = verification.maxDepth;
+    const bool fits = bound >= 0 && (size_t)bound <= stackLimit;
+    checked = !(verification.balanced && fits);
+    stackCapacity = fits ? (size_t)bound : std::min(stackLimit, INITIAL_STACK_SLOTS);
+    stack.assign(stackCapacity + 3, INT_VAL(0));
+    if (verification.maxCallDepth > 0) callStack.reserve(verification.maxCallDepth);
+    if (!verification.valid) {
+        running = false;
+        trap = VMTrap::INVALID_BYTECODE;
+        reportTrap();
+    }
+    decode();
+}
+
+VM::VM(VM& parent, ForkTag)
+    : image(parent.image),
+      program(parent.program),
+      plain(parent.plain),
+      stack(parent.stack),
+      memory(parent.memory),
+      callStack(parent.callStack),
+      breakpoints(parent.breakpoints),
+      objects(nullptr),
+      sharedHeap(parent.sharedHeap),
+      heapId(nextHeapId++),
+      instructionCount(parent.instructionCount),
+      jitThreshold(parent.jitThreshold),
+      traceEntries(0),
+      maxStackDepth(parent.maxStackDepth),
+      fusionCount(0),
+      stackTop(parent.stackTop),
+      stackLimit(parent.stackLimit),
+      stackCapacity(parent.stackCapacity),
+      pc(parent.pc),
+      running(parent.running),
+      stoppedAtBreakpoint(parent.stoppedAtBreakpoint),
+      ranRegisterTier(false),
+      tracing(false),
+      profiling(false),
+      checked(parent.checked),
+      stackFull(parent.stackFull),
+      profileOverhead(0),
+      traceAnchor(-1),
+      trap(parent.trap),
+      verification(parent.verification) {
+    output.setLineBuffered(parent.output.isLineBuffered());
+    output.setFd(parent.output.getFd());
+    // Fused, with breakpoints, without the parent's trace anchors
+    rebuildCode();
+}
+
+VM::~VM() {
+    Object* obj = objects;
+    while (obj != nullptr) {
+        Object* next = obj->next;
+        freeObject(obj);
+        obj = next;
+    }
+}
+
+VM::HeapSegment::~HeapSegment() {
+    while (objects != nullptr) {
+        Object* next = objects->next;
+        freeObject(objects);
+        objects = next;
+    }
+}
+
+std::unique_ptr<VM> VM::fork() {
+    output.flush();
+    if (objects != nullptr) {
+        auto segment = std::make_shared<HeapSegment>();
+        segment->objects = objects;
+        objects = nullptr;
+        sharedHeap.push_back(segment);
+    }
+    heapId = nextHeapId++;
+    return std::unique_ptr<VM>(new VM(*this, ForkTag()));
+}
+
+int VM::getObjectCount() {
+    int count = getSharedObjectCount();
+    Object* obj = objects;
+    while (obj != nullptr) {
+        count++;
+        obj = obj->next;
+    }
+    return count;
+}
+
+int VM::getSharedObjectCount() const {
+    int count = 0;
+    for (const auto& segment : sharedHeap) {
+        for (const Object* obj = segment->objects; obj != nullptr; obj = obj->next) count++;
+    }
+    return count;
+}
+
+void VM::printRegisters() {
+    std::cout << "--- VM Register State ---" << std::endl;
+    std::cout << "PC    : " << pc << std::endl;
+    std::cout << "Stack : [ ";
+    for (size_t i = 0; i < stackTop; i++) {
+        std::cout << AS_INT(stackBase()[i]) << " ";
+    }
+    std::cout << "]" << std::endl;
+}
+
+void VM::setBreakpoint(int address) {
+    breakpoints[address] = DecodedInstr();
+    rebuildCode();
+    std::cout << "Breakpoint set at " << address << std::endl;
+}
+
+void VM::clearBreakpoint(int address) {
+    auto it = breakpoints.find(address);
+    if (it != breakpoints.end()) {
+        if (address >= 0 && address < (int)program.size()) code[address] = it->second;
+        breakpoints.erase(it);
+    }
+    std::cout << "Breakpoint removed from " << address << std::endl;
+}
+
+void VM::rebuildCode() {
+    code = plain;
+    fuse();
+    if (tracing) {
+        for (int addr = 0; addr < (int)program.size(); addr += 1 + std::max(0, operandCount(plain[addr].opcode))) {
+            DecodedInstr& in = code[addr];
+            if (in.opcode != OP_JMP || in.target > addr || coldLoops.count(in.target)) continue;
+            in.opcode = OP_LOOP;
+#if VM_THREADED_DISPATCH
+            in.handler = handlerTable()[OP_LOOP];
+#endif
+        }
+    }
+    for (auto& [address, original] : breakpoints) {
+        if (address < 0 || address >= (int)program.size()) continue;
+        original = code[address];
+        code[address].opcode = OP_BREAK;
+#if VM_THREADED_DISPATCH
+        code[address].handler = handlerTable()[OP_BREAK];
+#endif
+    }
+}
+
+void VM::executeNext() {
+    if (!running || trap != VMTrap::NONE || pc >= (int)program.size()) return;
+
+    if (!stoppedAtBreakpoint && breakpoints.count(pc)) {
+        output.flush();
+        std::cout << "Breakpoint hit at PC: " << pc << std::endl;
+        stoppedAtBreakpoint = true;
+        return; 
+    }
+
+    stoppedAtBreakpoint = false;
+    runLoop(plain.data(), 1);
+    if (!running || pc >= (int)program.size()) output.flush();
+}
+
+void VM::run() {
+    if (trap != VMTrap::NONE) return;
+    running = true;
+    runTiers();
+    output.flush();
+    if (stoppedAtBreakpoint) {
+        std::cout << "Stopped at breakpoint: " << pc << std::endl;
+    }
+}
+
+bool VM::runSlice(long long budget) {
+    const int size = (int)program.size();
+    if (!running || trap != VMTrap::NONE || pc >= size) return false;
+    if (stoppedAtBreakpoint) {
+        stoppedAtBreakpoint = false;
+        runLoop(plain.data(), 1);
+        budget--;
+    }
+    if (running && budget > 0) runLoop(code.data(), budget);
+    output.flush();
+    return running && trap == VMTrap::NONE && pc < size && !stoppedAtBreakpoint;
+}
+
+// Picks the engine for run(): opt-in tiers from a fresh start without
+// breakpoints, else the JIT or the interpreter
+void VM::runTiers() {
+    if (registerCode && !profiling && !sampler && pc == 0 && instructionCount == 0 && breakpoints.empty()) {
+        runRegisters();
+        return;
+    }
+    if (profiling) {
+        runProfiled();
+        return;
+    }
+    if (stoppedAtBreakpoint) {
+        stoppedAtBreakpoint = false;
+        runLoop(plain.data(), 1);
+    }
+    if (!running) return;
+    if (sampler) runSampled();
+    else runSelected();
+}
+
+// The closure, AOT or JIT tier when enabled, else the interpreter
+void VM::runSelected() {
+    if (closureCode && breakpoints.empty()) {
+        runClosures();
+        return;
+    }
+    if (aot && breakpoints.empty()) {
+        runAot();
+        return;
+    }
+    if (VM_JIT_AVAILABLE && !tracing && jitThreshold >= 0 && breakpoints.empty()) {
+        long long warmup = jitThreshold - instructionCount;
+        if (!jit && warmup > 0) {
+            runInterpreter(warmup);
+            if (!running || trap != VMTrap::NONE || pc >= (int)program.size()) return;
+        }
+        runJit();
+        return;
+    }
+    // Traces keep control until a guard fails, so sampling interprets
+    if (tracing && !sampler) runTraced();
+    else runInterpreter(LLONG_MAX);
+}
+
+// The fused interpreter for about budget instructions; while sampling, in
+// slices of a few thousand with a sample between them
+void VM::runInterpreter(long long budget) {
+    if (!sampler || !sampler->isActive()) {
+        runLoop(code.data(), budget);
+        return;
+    }
+    const int size = (int)program.size();
+    while (budget > 0 && running && trap == VMTrap::NONE && pc < size) {
+        const long long before = instructionCount;
+        runLoop(code.data(), std::min(budget, sampler->nextSlice()));
+        if (stoppedAtBreakpoint) break;
+        budget -= instructionCount - before;
+        sampleIfDue();
+    }
+}
+
+// Records the pc and call stack if a tick arrived since the last sample
+void VM::sampleIfDue() {
+    if (!sampler || !sampler->isActive() || !sampler->due()) return;
+    sampler->record(pc, callStack);
+    if (sampler->needsCollect()) sampler->collect(program, sourceLines);
+}
+
+bool VM::enableRegisterTier(std::string& error) {
+    auto prog = std::make_unique<RegisterProgram>();
+    RegisterTranslator translator(program);
+    if (!translator.translate(*prog)) {
+        error = translator.getError();
+        return false;
+    }
+    if ((size_t)prog->maxDepth > stackLimit) {
+        error = "stack depth exceeds limit";
+        return false;
+    }
+    registerCode = std::move(prog);
+    return true;
+}
+
+void VM::printRegisterCode() const {
+    if (registerCode) RegisterTranslator::print(*registerCode);
+}
+
+// Alternates between generated code and single interpreter steps for the
+// instructions the JIT leaves to the interpreter. Programs that keep leaving
+// after a few instructions (CALL/RET-heavy code) go back to the interpreter.
+void VM::runJit() {
+    if (!jit) jit = std::make_unique<JitCode>(program, sampler ? Sampler::ticks() : nullptr);
+    if (!jit->valid()) {
+        runInterpreter(LLONG_MAX);
+        return;
+    }
+
+    const int size = (int)program.size();
+    long long entries = 0, jitted = 0;
+    while (running && trap == VMTrap::NONE && pc < size) {
+        if (entries == JIT_BAILOUT_ENTRIES && jitted < entries * JIT_BAILOUT_RUN) {
+            runInterpreter(LLONG_MAX);
+            return;
+        }
+        if (jit->canEnter(pc)) {
+            JitState state;
+            state.base = stackBase();
+            state.sp = state.base + stackTop - 1;
+            state.high = state.sp;
+            state.limit = state.base + stackCapacity - 1;
+            state.memory = memory.data();
+            state.count = 0;
+            state.pc = pc;
+            jit->enter(state);
+
+            stackTop = state.sp - state.base + 1;
+            if ((size_t)(state.high - state.base + 1) > maxStackDepth) {
+                maxStackDepth = state.high - state.base + 1;
+            }
+            instructionCount += state.count;
+            jitted += state.count;
+            entries++;
+            pc = state.pc;
+            if (pc >= size) break;
+            sampleIfDue();
+        }
+        runLoop(plain.data(), 1);
+    }
+}
+
+// The counter compiled code polls: the running sampler's ticks, else one
+// that stays zero
+static const volatile long* pollTicks(const Sampler* sampler) {
+    static const long noTicks = 0;
+    static_assert(sizeof(std::atomic<long>) == sizeof(long), "compiled code reads the tick counter as a long");
+    return sampler && sampler->isActive() ? reinterpret_cast<const volatile long*>(Sampler::ticks()) : &noTicks;
+}
+
+void VM::enableClosureTier() {
+    auto prog = std::make_unique<ClosureProgram>();
+    ClosureCompiler::compile(program, *prog);
+    closureCode = std::move(prog);
+}
+
+// Runs closure-compiled blocks, which branch straight into one another. The
+// interpreter takes single steps where no block starts, where a block's
+// stack bounds do not hold, and for the instructions a closure exited at,
+// raising any trap itself.
+void VM::runClosures() {
+    const ClosureProgram& cp = *closureCode;
+    const int size = (int)program.size();
+    ClosureFrame frame;
+    frame.memory = memory.data();
+    frame.tick = pollTicks(sampler.get());
+    frame.program = &cp;
+    frame.callStack = &callStack;
+    frame.callLimit = MAX_CALL_DEPTH;
+    frame.output = &output;
+
+    while (running && trap == VMTrap::NONE && pc < size) {
+        // Growing the stack moves it
+        Value* const base = stackBase();
+        Value* sp = base + stackTop - 1;
+        frame.base = base;
+        frame.end = base + stackCapacity;
+        frame.high = base + maxStackDepth - 1;
+        frame.count = 0;
+        long long grow = 0;
+        bool step = true;
+        int next = pc;
+        if (cp.blockAt[pc] >= 0) {
+            const ClosureBlock& block = cp.blocks[cp.blockAt[pc]];
+            const long long depth = sp - base + 1;
+            if (depth >= block.need && depth + block.rise <= (long long)stackLimit) {
+                if (depth + block.rise > (long long)stackCapacity) {
+                    grow = depth + block.rise;
+                } else {
+                    frame.entry = sp;
+                    block.ops[0].fn(sp, *sp, block.ops.data(), frame);
+                    sp = frame.sp;
+                    next = frame.next;
+                    if (next < 0) {
+                        if (frame.entry + frame.exit->rise > frame.high) frame.high = frame.entry + frame.exit->rise;
+                        frame.count += frame.exit->done;
+                        next = frame.exit->addr;
+                    } else {
+                        step = false;
+                    }
+                }
+            }
+        }
+        stackTop = sp - base + 1;
+        maxStackDepth = frame.high - base + 1;
+        instructionCount += frame.count;
+        pc = next;
+        sampleIfDue();
+        if (grow) reserveStack(grow);
+        else if (step && pc < size) runLoop(plain.data(), 1);
+    }
+}
+
+bool VM::enableAot(std::string& error) {
+    auto code = std::make_unique<AotCode>(program);
+    if (!code->valid()) {
+        error = code->getError();
+        return false;
+    }
+    aot = std::move(code);
+    return true;
+}
+
+static void printOutput(void* output, int32_t value) {
+    static_cast<OutputBuffer*>(output)->print(value);
+}
+
+// Same protocol as runJit: the compiled program runs until an instruction it
+// leaves to the interpreter, which executes that one and re-enters.
+void VM::runAot() {
+    const volatile long* const ticks = pollTicks(sampler.get());
+    const int size = (int)program.size();
+    while (running && trap == VMTrap::NONE && pc < size) {
+        if (aot->canEnter(pc)) {
+            AotState state;
+            state.base = stackBase();
+            state.sp = state.base + stackTop - 1;
+            state.high = state.sp;
+            state.limit = state.base + stackCapacity - 1;
+            state.memory = memory.data();
+            state.count = 0;
+            state.print = printOutput;
+            state.output = &output;
+            state.tick = ticks;
+            state.pc = pc;
+            aot->enter(state);
+
+            stackTop = state.sp - state.base + 1;
+            if ((size_t)(state.high - state.base + 1) > maxStackDepth) {
+                maxStackDepth = state.high - state.base + 1;
+            }
+            instructionCount += state.count;
+            pc = state.pc;
+            if (pc >= size) break;
+            sampleIfDue();
+        }
+        runLoop(plain.data(), 1);
+    }
+}
+
+void VM::enableProfiling() {
+    profiling = true;
+    profile.assign(program.size(), InstrProfile());
+    // Cost of reading the clock itself, subtracted from every sample
+    profileOverhead = UINT64_MAX;
+    for (int i = 0; i < 64; i++) {
+        uint64_t start = profileClock();
+        profileOverhead = std::min(profileOverhead, profileClock() - start);
+    }
+}
+
+// Steps the unfused code one instruction at a time and charges each step's
+// clock ticks to its pc. Other tiers are bypassed: the profile describes the
+// interpreter. A step's cost includes entering runLoop for one instruction.
+void VM::runProfiled() {
+    const int size = (int)program.size();
+    bool resume = stoppedAtBreakpoint;
+    stoppedAtBreakpoint = false;
+    while (running && trap == VMTrap::NONE && pc >= 0 && pc < size) {
+        if (!resume && breakpoints.count(pc)) {
+            stoppedAtBreakpoint = true;
+            return;
+        }
+        resume = false;
+        int at = pc;
+        long long before = instructionCount;
+        uint64_t start = profileClock();
+        runLoop(plain.data(), 1);
+        uint64_t ticks = profileClock() - start;
+        if (instructionCount == before) break;
+        profile[at].count++;
+        profile[at].cycles += ticks > profileOverhead ? ticks - profileOverhead : 0;
+    }
+}
+
+void VM::printProfile(size_t top) const {
+    if (!profiling) {
+        std::cout << "Profiling was not enabled" << std::endl;
+        return;
+    }
+    std::map<int32_t, InstrProfile> opcodes;
+    std::vector<int> hot;
+    uint64_t total = 0;
+    for (size_t addr = 0; addr < profile.size(); addr++) {
+        if (profile[addr].count == 0) continue;
+        InstrProfile& op = opcodes[program[addr]];
+        op.count += profile[addr].count;
+        op.cycles += profile[addr].cycles;
+        total += profile[addr].cycles;
+        hot.push_back((int)addr);
+    }
+    std::sort(hot.begin(), hot.end(), [this](int a, int b) { return profile[a].cycles > profile[b].cycles; });
+    std::vector<std::pair<int32_t, InstrProfile>> byOpcode(opcodes.begin(), opcodes.end());
+    std::sort(byOpcode.begin(), byOpcode.end(),
+              [](const auto& a, const auto& b) { return a.second.cycles > b.second.cycles; });
+
+    std::ios::fmtflags flags = std::cout.flags();
+    std::streamsize precision = std::cout.precision();
+    auto row = [total](const InstrProfile& p) {
+        std::cout << std::setw(12) << p.count << std::setw(14) << p.cycles << std::setw(10)
+                  << std::fixed << std::setprecision(1) << (double)p.cycles / p.count
+                  << std::setw(8) << (total ? 100.0 * p.cycles / total : 0.0) << "%" << std::endl;
+    };
+    std::cout << "\n=== Profile (" << PROFILE_UNIT << ", " << instructionCount << " instructions) ===\n";
+    std::cout << "Hottest opcodes:\n" << std::left << std::setw(12) << "  opcode" << std::right
+              << std::setw(12) << "count" << std::setw(14) << PROFILE_UNIT << std::setw(10) << "avg"
+              << std::setw(9) << "share" << std::endl;
+    for (size_t i = 0; i < byOpcode.size() && i < top; i++) {
+        std::cout << "  " << std::left << std::setw(10) << getOpcodeName(byOpcode[i].first) << std::right;
+        row(byOpcode[i].second);
+    }
+    std::cout << "Hottest instructions:\n" << std::left << std::setw(12) << "  pc" << std::right
+              << std::setw(12) << "count" << std::setw(14) << PROFILE_UNIT << std::setw(10) << "avg"
+              << std::setw(9) << "share" << std::endl;
+    for (size_t i = 0; i < hot.size() && i < top; i++) {
+        std::cout << "  " << std::setw(4) << hot[i] << " " << std::left << std::setw(5)
+                  << getOpcodeName(program[hot[i]]) << std::right;
+        row(profile[hot[i]]);
+    }
+    std::cout.flags(flags);
+    std::cout.precision(precision);
+}
+
+void VM::enableSampling(int hz) {
+    sampler = std::make_unique<Sampler>(hz);
+    // Recompiled with polls at its loop heads
+    jit.reset();
+}
+
+// Runs the tier run() would pick under the SIGPROF timer. The interpreter
+// runs in slices with a sample between them; JIT, AOT and closure code stop
+// at the next loop head (or exit) once a tick is due, so their samples name
+// that pc. The register and trace tiers are not sampled: such programs are
+// interpreted.
+void VM::runSampled() {
+    std::string error;
+    if (!sampler->start(error)) {
+        std::cout << "Sampling unavailable (" << error << ")" << std::endl;
+    }
+    runSelected();
+    sampler->stop();
+    sampler->collect(program, sourceLines);
+}
+
+void VM::writeFoldedStacks(std::ostream& out) const {
+    if (sampler) sampler->writeFolded(out);
+}
+
+bool VM::enableTracing() {
+    if (!VM_JIT_AVAILABLE) return false;
+    tracing = true;
+    loopHits.assign(program.size() + 1, 0);
+    rebuildCode();
+    return true;
+}
+
+// Interprets with counting back edges. A loop that gets hot is recorded once
+// and from then on runs as native code until one of its guards fails.
+void VM::runTraced() {
+    for (;;) {
+        traceAnchor = -1;
+        runLoop(code.data(), LLONG_MAX);
+        if (traceAnchor < 0 || !running) return;
+
+        int anchor = traceAnchor;
+        if (!breakpoints.empty()) {
+            loopHits[anchor] = 0;
+            continue;
+        }
+        auto it = traces.find(anchor);
+        if (it == traces.end()) {
+            bool recorded = recordTrace(anchor);
+            if (!running || trap != VMTrap::NONE) return;
+            if (!recorded) {
+                coldLoops.insert(anchor);
+                rebuildCode();
+                continue;
+            }
+            it = traces.find(anchor);
+            if (pc != anchor) continue;
+        }
+        runTrace(*it->second);
+    }
+}
+
+// Steps the interpreter through one iteration starting at the loop header,
+// logging each instruction and branch outcome
+bool VM::recordTrace(int anchor) {
+    std::vector<TraceStep> steps;
+    while (steps.size() < TRACE_MAX_LENGTH) {
+        const DecodedInstr& in = plain[pc];
+        if (!Trace::canRecord(in.opcode)) return false;
+        TraceStep step = {pc, in.opcode, in.operand, in.target, false};
+        runLoop(plain.data(), 1);
+        if (!running || trap != VMTrap::NONE) return false;
+        step.taken = pc == in.target;
+        steps.push_back(step);
+        if (pc == anchor) break;
+        if (pc < step.pc) return false;
+    }
+    if (pc != anchor) return false;
+
+    auto trace = std::make_unique<Trace>(steps);
+    if (!trace->valid()) return false;
+    traces[anchor] = std::move(trace);
+    return true;
+}
+
+// Runs a compiled trace from its loop header, then rebuilds the interpreter
+// state described by the exit it left through
+void VM::runTrace(const Trace& trace) {
+    const long long depth = stackTop;
+    if (depth < (long long)trace.entrySlots.size() || !reserveStack(depth + trace.rise)) return;
+
+    std::vector<int32_t> slots(trace.numSlots, 0);
+    Value* top = stackBase() + depth - 1;
+    for (const auto& [index, slot] : trace.vars) {
+        if (!IS_INT(memory[index])) return;
+        slots[slot] = AS_INT(memory[index]);
+    }
+    for (size_t k = 0; k < trace.entrySlots.size(); k++) {
+        if (!IS_INT(top[-(long long)k])) return;
+        slots[trace.entrySlots[k]] = AS_INT(top[-(long long)k]);
+    }
+
+    TraceState state = {slots.data(), 0, 0};
+    trace.enter(state);
+    traceEntries++;
+
+    const TraceExit& exit = trace.exits[state.exit];
+    for (const auto& [index, slot] : trace.vars) memory[index] = INT_VAL(slots[slot]);
+    for (size_t k = exit.consumed; k < trace.entrySlots.size(); k++) {
+        top[-(long long)k] = INT_VAL(slots[trace.entrySlots[k]]);
+    }
+    Value* at = top + 1 - exit.consumed;
+    for (const TraceValue& v : exit.stack) *at++ = INT_VAL(v.isImm ? v.value : slots[v.value]);
+    stackTop = depth - exit.consumed + exit.stack.size();
+
+    long long high = depth + (state.iterations > 0 ? trace.rise : exit.rise);
+    if (high > (long long)maxStackDepth) maxStackDepth = high;
+    instructionCount += state.iterations * trace.length + exit.count;
+    pc = exit.pc;
+}
+
+const char* VM::dispatchMode() {
+    return VM_THREADED_DISPATCH ? "threaded" : "switch";
+}
+
+DecodedInstr VM::decodeAt(int addr) const {
+    const int size = (int)program.size();
+    DecodedInstr in;
+    in.opcode = program[addr];
+    in.operand = 0;
+    in.operand2 = 0;
+    in.target = size;
+
+    int operands = operandCount(in.opcode);
+    if (operands < 0 || addr + operands >= size) {
+        in.opcode = DOP_INVALID;
+        return in;
+    }
+    if (operands == 1) in.operand = program[addr + 1];
+
+    switch (in.opcode) {
+        case OP_JMP: case OP_JZ: case OP_JNZ: case OP_CALL:
+            if (in.operand >= 0 && in.operand < size) in.target = in.operand;
+            break;
+        case OP_LOAD: case OP_STORE:
+            if (!validMemory(in.operand)) in.opcode = DOP_INVALID;
+            break;
+        default:
+            break;
+    }
+    return in;
+}
+
+void VM::decode() {
+#if VM_THREADED_DISPATCH
+    static std::once_flag handlersReady;
+    std::call_once(handlersReady, [this] {
+        interpret<false>(nullptr, 0);
+        interpret<true>(nullptr, 0);
+    });
+#endif
+    plain.resize(program.size() + 1);
+    for (int addr = 0; addr < (int)program.size(); addr++) {
+        plain[addr] = decodeAt(addr);
+    }
+    DecodedInstr& end = plain[program.size()];
+    end.opcode = DOP_END;
+    end.operand = 0;
+    end.operand2 = 0;
+    end.target = (int32_t)program.size();
+#if VM_THREADED_DISPATCH
+    for (DecodedInstr& in : plain) in.handler = handlerTable()[in.opcode];
+#endif
+    rebuildCode();
+}
+
+void VM::fuse() {
+    const int size = (int)program.size();
+    fusionCount = 0;
+    std::vector<int> starts;
+    std::vector<bool> barrier(size + 1, false);
+    for (int addr = 0; addr < size; addr += 1 + operandCount(plain[addr].opcode)) {
+        const DecodedInstr& in = plain[addr];
+        if (in.opcode == DOP_INVALID) break;
+        starts.push_back(addr);
+        if (in.opcode == OP_JMP || in.opcode == OP_JZ || in.opcode == OP_JNZ || in.opcode == OP_CALL) {
+            barrier[in.target] = true;
+        }
+        if (in.opcode == OP_CALL) barrier[addr + 2] = true;
+    }
+    for (const auto& bp : breakpoints) {
+        if (bp.first >= 0 && bp.first < size) barrier[bp.first] = true;
+    }
+
+    auto matches = [&](size_t i, std::initializer_list<int32_t> ops) {
+        if (i + ops.size() > starts.size()) return false;
+        size_t k = 0;
+        for (int32_t op : ops) {
+            if (plain[starts[i + k]].opcode != op) return false;
+            if (k > 0 && barrier[starts[i + k]]) return false;
+            k++;
+        }
+        return true;
+    };
+
+    for (size_t i = 0; i < starts.size(); i++) {
+        const DecodedInstr& first = plain[starts[i]];
+        DecodedInstr fused = first;
+        size_t length = 0;
+
+        if (matches(i, {OP_LOAD, OP_PUSH, OP_ADD, OP_STORE}) &&
+            plain[starts[i + 3]].operand == first.operand) {
+            fused.opcode = OP_INC_VAR;
+            fused.operand2 = plain[starts[i + 1]].operand;
+            length = 4;
+        } else if (matches(i, {OP_LOAD, OP_LOAD, OP_CMP, OP_JZ})) {
+            fused.opcode = OP_LOAD_LOAD_CMP_JZ;
+            fused.operand2 = plain[starts[i + 1]].operand;
+            fused.target = plain[starts[i + 3]].target;
+            length = 4;
+        } else if (matches(i, {OP_LOAD, OP_PUSH, OP_CMP, OP_JZ})) {
+            fused.opcode = OP_LOAD_PUSH_CMP_JZ;
+            fused.operand2 = plain[starts[i + 1]].operand;
+            fused.target = plain[starts[i + 3]].target;
+            length = 4;
+        } else if (matches(i, {OP_LOAD, OP_LOAD, OP_ADD})) {
+            fused.opcode = OP_LOAD_LOAD_ADD;
+            fused.operand2 = plain[starts[i + 1]].operand;
+            length = 3;
+        } else if (matches(i, {OP_CMP, OP_JZ})) {
+            fused.opcode = OP_CMP_JZ;
+            fused.target = plain[starts[i + 1]].target;
+            length = 2;
+        }
+
+        if (length == 0) continue;
+#if VM_THREADED_DISPATCH
+        fused.handler = handlerTable()[fused.opcode];
+#endif
+        code[starts[i]] = fused;
+        fusionCount++;
+        i += length - 1;
+    }
+}
+
+#if VM_THREADED_DISPATCH
+const void* VM::handlers[2][DOP_COUNT];
+
+#define TARGET(op) L_##op:
+#define NEXT()                                      \
+    do {                                            \
+        if (--remaining < 0) goto exhausted;        \
+        goto *code[ip].handler;                     \
+    } while (0)
+#define REDISPATCH(op) goto L_##op
+#else
+#define TARGET(op) case op:
+#define NEXT() continue
+#define REDISPATCH(op) do { opcode = op; goto redispatch; } while (0)
+#endif
+
+// Programs the verifier proved balanced never underflow: no check,
+#define STACK_NEED(n)                                           \
+    do { if (Checked && sp < base + (n) - 1) goto stack_underflow; } while (0)
+// nor overflow: the stack was sized from the verifier's bound
+#define STACK_PUSH(v)                                           \
+    do {                                                        \
+        if (Checked && sp >= limit) goto stack_overflow;        \
+        *sp++ = tos;                                            \
+        tos = (v);                                              \
+        if (sp > high) high = sp;                               \
+    } while (0)
+#define STACK_DROP() (tos = *--sp)
+#define STACK_RESERVE(n)                                        \
+    do { if (sp + (n) > high) high = sp + (n); } while (0)
+
+void VM::runLoop(const DecodedInstr* stream, long long budget) {
+    if (!checked) {
+        interpret<false>(stream, budget);
+        return;
+    }
+    for (;;) {
+        long long before = instructionCount;
+        interpret<true>(stream, budget);
+        if (!stackFull) return;
+        // The push that did not fit runs again on the larger stack
+        stackFull = false;
+        reserveStack(stackCapacity + 1);
+        budget -= instructionCount - before;
+    }
+}
+
+template <bool Checked>
+void VM::interpret(const DecodedInstr* code, long long budget) {
+#if VM_THREADED_DISPATCH
+    const void** handlers = VM::handlers[Checked];
+    if (code == nullptr) {
+        for (int op = 0; op < DOP_COUNT; op++) handlers[op] = &&L_DOP_INVALID;
+        handlers[OP_PUSH]             = &&L_OP_PUSH;
+        handlers[OP_POP]              = &&L_OP_POP;
+        handlers[OP_DUP]              = &&L_OP_DUP;
+        handlers[OP_ADD]              = &&L_OP_ADD;
+        handlers[OP_SUB]              = &&L_OP_SUB;
+        handlers[OP_MUL]              = &&L_OP_MUL;
+        handlers[OP_DIV]              = &&L_OP_DIV;
+        handlers[OP_CMP]              = &&L_OP_CMP;
+        handlers[OP_JMP]              = &&L_OP_JMP;
+        handlers[OP_JZ]               = &&L_OP_JZ;
+        handlers[OP_JNZ]              = &&L_OP_JNZ;
+        handlers[OP_STORE]            = &&L_OP_STORE;
+        handlers[OP_LOAD]             = &&L_OP_LOAD;
+        handlers[OP_CALL]             = &&L_OP_CALL;
+        handlers[OP_RET]              = &&L_OP_RET;
+        handlers[OP_PRINT]            = &&L_OP_PRINT;
+        handlers[OP_HALT]             = &&L_OP_HALT;
+        handlers[OP_BREAK]            = &&L_OP_BREAK;
+        handlers[OP_LOOP]             = &&L_OP_LOOP;
+        handlers[OP_LOAD_LOAD_ADD]    = &&L_OP_LOAD_LOAD_ADD;
+        handlers[OP_INC_VAR]          = &&L_OP_INC_VAR;
+        handlers[OP_CMP_JZ]           = &&L_OP_CMP_JZ;
+        handlers[OP_LOAD_LOAD_CMP_JZ] = &&L_OP_LOAD_LOAD_CMP_JZ;
+        handlers[OP_LOAD_PUSH_CMP_JZ] = &&L_OP_LOAD_PUSH_CMP_JZ;
+        handlers[DOP_END]             = &&L_DOP_END;
+        return;
+    }
+#endif
+
+    Value* const base = stackBase();
+    Value* const limit = base + stackCapacity - 1;
+    Value* sp = base + stackTop - 1;
+    Value* high = sp;
+    Value tos = *sp;
+    Value* mem = memory.data();
+    int ip = pc;
+    long long remaining = budget;
+
+#if VM_THREADED_DISPATCH
+    NEXT();
+#else
+    for (;;) {
+        if (--remaining < 0) goto exhausted;
+        int32_t opcode = code[ip].opcode;
+    redispatch:
+        switch (opcode) {
+#endif
+
+    TARGET(OP_PUSH)
+        STACK_PUSH(INT_VAL(code[ip].operand));
+        ip += 2;
+        NEXT();
+    TARGET(OP_POP)
+        STACK_NEED(1);
+        STACK_DROP();
+        ip += 1;
+        NEXT();
+    TARGET(OP_DUP)
+        STACK_NEED(1);
+        STACK_PUSH(tos);
+        ip += 1;
+        NEXT();
+    TARGET(OP_ADD)
+        STACK_NEED(2);
+        --sp;
+        tos = INT_VAL(AS_INT(*sp) + AS_INT(tos));
+        ip += 1;
+        NEXT();
+    TARGET(OP_SUB)
+        STACK_NEED(2);
+        --sp;
+        tos = INT_VAL(AS_INT(*sp) - AS_INT(tos));
+        ip += 1;
+        NEXT();
+    TARGET(OP_MUL)
+        STACK_NEED(2);
+        --sp;
+        tos = INT_VAL(AS_INT(*sp) * AS_INT(tos));
+        ip += 1;
+        NEXT();
+    TARGET(OP_DIV)
+        STACK_NEED(2);
+        ip += 1;
+        if (AS_INT(tos) == 0) {
+            sp -= 2;
+            tos = *sp;
+            goto division_by_zero;
+        }
+        --sp;
+        tos = INT_VAL(AS_INT(*sp) / AS_INT(tos));
+        NEXT();
+    TARGET(OP_CMP)
+        STACK_NEED(2);
+        --sp;
+        tos = INT_VAL(AS_INT(*sp) < AS_INT(tos) ? 1 : 0);
+        ip += 1;
+        NEXT();
+    TARGET(OP_JMP)
+        ip = code[ip].target;
+        NEXT();
+    TARGET(OP_JZ) {
+        STACK_NEED(1);
+        int32_t cond = AS_INT(tos);
+        STACK_DROP();
+        ip = (cond == 0) ? code[ip].target : ip + 2;
+        NEXT();
+    }
+    TARGET(OP_JNZ) {
+        STACK_NEED(1);
+        int32_t cond = AS_INT(tos);
+        STACK_DROP();
+        ip = (cond != 0) ? code[ip].target : ip + 2;
+        NEXT();
+    }
+    TARGET(OP_STORE)
+        STACK_NEED(1);
+        mem[code[ip].operand] = tos;
+        STACK_DROP();
+        ip += 2;
+        NEXT();
+    TARGET(OP_LOAD)
+        STACK_PUSH(mem[code[ip].operand]);
+        ip += 2;
+        NEXT();
+    TARGET(OP_CALL)
+        if (callStack.size() >= MAX_CALL_DEPTH) goto call_overflow;
+        callStack.push_back(ip + 2);
+        ip = code[ip].target;
+        NEXT();
+    TARGET(OP_RET)
+        // A RET with no caller stops the program like an invalid instruction
+        if (Checked && callStack.empty()) REDISPATCH(DOP_INVALID);
+        ip = callStack.back();
+        callStack.pop_back();
+        NEXT();
+    TARGET(OP_PRINT)
+        STACK_NEED(1);
+        output.print(AS_INT(tos));
+        STACK_DROP();
+        ip += 1;
+        NEXT();
+    TARGET(OP_LOAD_LOAD_ADD)
+        if (Checked && sp + 2 > limit) REDISPATCH(OP_LOAD);
+        STACK_RESERVE(2);
+        *sp++ = tos;
+        tos = INT_VAL(AS_INT(mem[code[ip].operand]) + AS_INT(mem[code[ip].operand2]));
+        remaining -= 2;
+        ip += 5;
+        NEXT();
+    TARGET(OP_INC_VAR) {
+        if (Checked && sp + 2 > limit) REDISPATCH(OP_LOAD);
+        STACK_RESERVE(2);
+        Value& var = mem[code[ip].operand];
+        var = INT_VAL(AS_INT(var) + code[ip].operand2);
+        remaining -= 3;
+        ip += 7;
+        NEXT();
+    }
+    TARGET(OP_CMP_JZ) {
+        if (Checked && sp < base + 1) REDISPATCH(OP_CMP);
+        bool less = AS_INT(*(sp - 1)) < AS_INT(tos);
+        sp -= 2;
+        tos = *sp;
+        ip = less ? ip + 3 : code[ip].target;
+        remaining -= 1;
+        NEXT();
+    }
+    TARGET(OP_LOAD_LOAD_CMP_JZ)
+        if (Checked && sp + 2 > limit) REDISPATCH(OP_LOAD);
+        STACK_RESERVE(2);
+        ip = (AS_INT(mem[code[ip].operand]) < AS_INT(mem[code[ip].operand2]))
+            ? ip + 7 : code[ip].target;
+        remaining -= 3;
+        NEXT();
+    TARGET(OP_LOAD_PUSH_CMP_JZ)
+        if (Checked && sp + 2 > limit) REDISPATCH(OP_LOAD);
+        STACK_RESERVE(2);
+        ip = (AS_INT(mem[code[ip].operand]) < code[ip].operand2) ? ip + 7 : code[ip].target;
+        remaining -= 3;
+        NEXT();
+    TARGET(OP_HALT)
+        ip += 1;
+        running = false;
+        goto done;
+    TARGET(OP_LOOP)
+        ip = code[ip].target;
+        if (++loopHits[ip] < HOT_LOOP_THRESHOLD) NEXT();
+        traceAnchor = ip;
+        goto done;
+    TARGET(OP_BREAK)
+        remaining++;
+        stoppedAtBreakpoint = true;
+        goto done;
+    TARGET(DOP_END)
+        remaining++;
+        goto done;
+#if VM_THREADED_DISPATCH
+    TARGET(DOP_INVALID)
+#else
+        default:
+#endif
+        ip += 1;
+        running = false;
+        goto done;
+
+#if !VM_THREADED_DISPATCH
+        }
+    }
+#endif
+
+stack_overflow:
+    if (stackCapacity < stackLimit) {
+        remaining++;
+        stackFull = true;
+        goto done;
+    }
+    trap = VMTrap::STACK_OVERFLOW;
+    running = false;
+    goto done;
+stack_underflow:
+    trap = VMTrap::STACK_UNDERFLOW;
+    running = false;
+    goto done;
+call_overflow:
+    trap = VMTrap::CALL_STACK_OVERFLOW;
+    running = false;
+    goto done;
+division_by_zero:
+    trap = VMTrap::DIVISION_BY_ZERO;
+    running = false;
+    goto done;
+exhausted:
+    remaining++;
+done:
+    *sp = tos;
+    stackTop = sp - base + 1;
+    if ((size_t)(high - base + 1) > maxStackDepth) maxStackDepth = high - base + 1;
+    pc = ip;
+    instructionCount += budget - remaining;
+    if (trap != VMTrap::NONE) reportTrap();
+}
+
+#undef TARGET
+#undef NEXT
+#undef REDISPATCH
+#undef STACK_NEED
+#undef STACK_PUSH
+#undef STACK_DROP
+#undef STACK_RESERVE
+
+// Register tier interpreter. Variables are loaded into registers on entry and
+// written back to memory on exit; temporaries left at HALT, or the slots
+// below a division that traps, become the stack.
+void VM::runRegisters() {
+    const RegisterProgram& rp = *registerCode;
+    if (!reserveStack(stackTop + rp.maxDepth)) {
+        runLoop(code.data(), LLONG_MAX);
+        return;
+    }
+    std::vector<Value> regs(rp.numRegs, INT_VAL(0));
+    std::copy(memory.begin(), memory.begin() + rp.numVars, regs.begin());
+    Value* const r = regs.data();
+    const RegInstr* const rcode = rp.code.data();
+    const RegInstr* in = rcode;
+    long long count = 0;
+
+#if VM_THREADED_DISPATCH
+    static const void* const labels[R_COUNT] = {
+        &&L_R_MOVI, &&L_R_MOV, &&L_R_ADD, &&L_R_SUB, &&L_R_MUL, &&L_R_DIV, &&L_R_LT,
+        &&L_R_ADDI, &&L_R_SUBI, &&L_R_MULI, &&L_R_DIVI, &&L_R_LTI,
+        &&L_R_RSUBI, &&L_R_RDIVI, &&L_R_RLTI,
+        &&L_R_JMP, &&L_R_JZ, &&L_R_JNZ, &&L_R_JLT, &&L_R_JLTI, &&L_R_JGE, &&L_R_JGEI,
+        &&L_R_PRINT, &&L_R_PRINTI, &&L_R_HALT
+    };
+#define RTARGET(op) L_##op:
+#define RNEXT() do { ++count; goto *labels[in->op]; } while (0)
+    RNEXT();
+#else
+#define RTARGET(op) case op:
+#define RNEXT() continue
+    for (;; ) {
+        ++count;
+        switch (in->op) {
+#endif
+
+#define RINT(reg) AS_INT(r[reg])
+    RTARGET(R_MOVI)  r[in->d] = INT_VAL(in->b); ++in; RNEXT();
+    RTARGET(R_MOV)   r[in->d] = r[in->a]; ++in; RNEXT();
+    RTARGET(R_ADD)   r[in->d] = INT_VAL(RINT(in->a) + RINT(in->b)); ++in; RNEXT();
+    RTARGET(R_SUB)   r[in->d] = INT_VAL(RINT(in->a) - RINT(in->b)); ++in; RNEXT();
+    RTARGET(R_MUL)   r[in->d] = INT_VAL(RINT(in->a) * RINT(in->b)); ++in; RNEXT();
+    RTARGET(R_DIV)
+        if (RINT(in->b) == 0) goto division_by_zero;
+        r[in->d] = INT_VAL(RINT(in->a) / RINT(in->b)); ++in; RNEXT();
+    RTARGET(R_LT)    r[in->d] = INT_VAL(RINT(in->a) < RINT(in->b) ? 1 : 0); ++in; RNEXT();
+    RTARGET(R_ADDI)  r[in->d] = INT_VAL(RINT(in->a) + in->b); ++in; RNEXT();
+    RTARGET(R_SUBI)  r[in->d] = INT_VAL(RINT(in->a) - in->b); ++in; RNEXT();
+    RTARGET(R_MULI)  r[in->d] = INT_VAL(RINT(in->a) * in->b); ++in; RNEXT();
+    RTARGET(R_DIVI)
+        if (in->b == 0) goto division_by_zero;
+        r[in->d] = INT_VAL(RINT(in->a) / in->b); ++in; RNEXT();
+    RTARGET(R_LTI)   r[in->d] = INT_VAL(RINT(in->a) < in->b ? 1 : 0); ++in; RNEXT();
+    RTARGET(R_RSUBI) r[in->d] = INT_VAL(in->b - RINT(in->a)); ++in; RNEXT();
+    RTARGET(R_RDIVI)
+        if (RINT(in->a) == 0) goto division_by_zero;
+        r[in->d] = INT_VAL(in->b / RINT(in->a)); ++in; RNEXT();
+    RTARGET(R_RLTI)  r[in->d] = INT_VAL(in->b < RINT(in->a) ? 1 : 0); ++in; RNEXT();
+    RTARGET(R_JMP)   in = rcode + in->d; RNEXT();
+    RTARGET(R_JZ)    in = (RINT(in->a) == 0) ? rcode + in->d : in + 1; RNEXT();
+    RTARGET(R_JNZ)   in = (RINT(in->a) != 0) ? rcode + in->d : in + 1; RNEXT();
+    RTARGET(R_JLT)   in = (RINT(in->a) < RINT(in->b)) ? rcode + in->d : in + 1; RNEXT();
+    RTARGET(R_JLTI)  in = (RINT(in->a) < in->b) ? rcode + in->d : in + 1; RNEXT();
+    RTARGET(R_JGE)   in = !(RINT(in->a) < RINT(in->b)) ? rcode + in->d : in + 1; RNEXT();
+    RTARGET(R_JGEI)  in = !(RINT(in->a) < in->b) ? rcode + in->d : in + 1; RNEXT();
+    RTARGET(R_PRINT)
+        output.print(RINT(in->a));
+        ++in; RNEXT();
+    RTARGET(R_PRINTI)
+        output.print(in->b);
+        ++in; RNEXT();
+    RTARGET(R_HALT)
+        for (int i = 0; i < in->a; i++) stackBase()[stackTop++] = r[rp.numVars + i];
+        pc = in->d;
+        if (in->b) running = false;
+        goto done;
+#if !VM_THREADED_DISPATCH
+            default:
+                goto done;
+        }
+    }
+#endif
+#undef RINT
+#undef RTARGET
+#undef RNEXT
+
+division_by_zero: {
+    // The stack VM pops the operands and keeps the values below them
+    const int32_t at = (int32_t)(in - rcode);
+    auto site = std::lower_bound(rp.trapSites.begin(), rp.trapSites.end(), at,
+                                 [](const RegTrapSite& t, int32_t i) { return t.instr < i; });
+    if (site != rp.trapSites.end() && site->instr == at) {
+        for (int32_t i = 0; i < site->count; i++) {
+            const RegOperand& slot = rp.trapStack[site->first + i];
+            stackBase()[stackTop++] = slot.isImm ? INT_VAL(slot.value) : r[slot.value];
+        }
+    }
+    trap = VMTrap::DIVISION_BY_ZERO;
+    running = false;
+    pc = in->addr + 1;
+}
+done:
+    std::copy(regs.begin(), regs.begin() + rp.numVars, memory.begin());
+    if ((size_t)rp.maxDepth > maxStackDepth) maxStackDepth = rp.maxDepth;
+    instructionCount += count;
+    ranRegisterTier = true;
+    if (trap != VMTrap::NONE) reportTrap();
+}
+
+void VM::printHeapStatus() {
+    int count = getObjectCount();
+    std::cout << "Heap objects : " << count << std::endl;
+}
+
+void VM::pushStack(Value v) {
+    if (stackTop >= stackLimit) {
+        trap = VMTrap::STACK_OVERFLOW;
+        running = false;
+        reportTrap();
+        return;
+    }
+    // An unchecked program still needs its whole bound above the new value
+    size_t need = stackTop + 1 + (checked ? 0 : verification.maxDepth);
+    if (need > stackLimit) {
+        checked = true;
+        decode();
+        need = stackTop + 1;
+    }
+    reserveStack(need);
+    stackBase()[stackTop++] = v;
+    if (stackTop > maxStackDepth) maxStackDepth = stackTop;
+}
+
+// Makes room for depth values, growing the stack geometrically up to
+// stackLimit. False when depth is beyond the limit.
+bool VM::reserveStack(size_t depth) {
+    if (depth <= stackCapacity) return true;
+    if (depth > stackLimit) return false;
+    size_t capacity = std::max(stackCapacity * 2, stackCapacity + MIN_STACK_GROWTH);
+    stackCapacity = std::min(std::max(capacity, depth), stackLimit);
+    stack.resize(stackCapacity + 3, INT_VAL(0));
+    return true;
+}
+
+std::vector<Value> VM::getStack() const {
+    const Value* base = stackBase();
+    return std::vector<Value>(base, base + stackTop);
+}
+
+const char* VM::getTrapName(VMTrap t) {
+    switch (t) {
+        case VMTrap::STACK_OVERFLOW:   return "Stack overflow";
+        case VMTrap::STACK_UNDERFLOW:  return "Stack underflow";
+        case VMTrap::DIVISION_BY_ZERO: return "Division by zero";
+        case VMTrap::CALL_STACK_OVERFLOW: return "Call stack overflow";
+        case VMTrap::INVALID_BYTECODE: return "Invalid bytecode";
+        default:                       return "None";
+    }
+}
+
+void VM::reportTrap() {
+    std::string message = getTrapName(trap);
+    if (trap == VMTrap::INVALID_BYTECODE) message += ": " + verification.error;
+    message += "\n";
+    if (output.isCapturing()) {
+        output.append(message);
+        return;
+    }
+    output.flush();
+    std::cerr << message;
+}
+
+Object* VM::allocatePair(Object* a, Object* b) {
+    ObjPair* pair = new ObjPair();
+    pair->obj.type = OBJ_PAIR;
+    pair->obj.marked = false;
+    pair->obj.heap = heapId;
+    pair->obj.next = objects;
+    objects = (Object*)pair;
+
+    pair->left = a;
+    pair->right = b;
+    return (Object*)pair;
+}
+
+// Shared objects belong to an older heap and only point into older heaps,
+// so marking stops at them and never writes to them
+void VM::markObject(Object* obj) {
+    if (obj == nullptr || obj->heap != heapId || obj->marked) return;
+    obj->marked = true; 
+    if (obj->type == OBJ_PAIR) {
+        ObjPair* pair = (ObjPair*)obj;
+        markObject(pair->left);
+        markObject(pair->right);
+    }
+}
+
+void VM::markValue(Value v) {
+    if (IS_OBJ(v)) markObject(AS_OBJ(v));
+}
+
+// Tagged integers have a clear low bit, so a block of them is skipped after
+// one OR over its words
+void VM::markRoots(const Value* roots, size_t count) {
+    size_t i = 0;
+#if VM_TAGGED_VALUES
+    for (; i + 8 <= count; i += 8) {
+        const Value* r = roots + i;
+        uint64_t tags = (r[0].bits | r[1].bits | r[2].bits | r[3].bits) |
+                        (r[4].bits | r[5].bits | r[6].bits | r[7].bits);
+        if (!(tags & VALUE_OBJ_TAG)) continue;
+        for (int k = 0; k < 8; k++) markValue(r[k]);
+    }
+#endif
+    for (; i < count; i++) markValue(roots[i]);
+}
+
+int VM::sweep() {
+    int freedCount = 0;
+    Object** object = &objects;
+    while (*object != nullptr) {
+        if (!(*object)->marked) {
+            Object* unreached = *object;
+            *object = unreached->next; 
+            freeObject(unreached);          
+            freedCount++;
+        } else {
+            (*object)->marked = false;
+            object = &(*object)->next;
+        }
+    }
+    return freedCount;
+}
+
+GCStats VM::gc() {
+    int initial = getObjectCount();
+    markRoots(stackBase(), stackTop);
+    markRoots(memory.data(), memory.size());
+    int freed = sweep();
+    
+    GCStats stats;
+    stats.initialCount = initial;
+    stats.objectsFreed = freed;
+    stats.objectsSurvived = initial - freed;
+    return stats;
+}
+
+void VM::printFinalStack() {
+    if (stackTop == 0) return;
+    std::cout << "Final Stack: ";
+    for (size_t i = 0; i < stackTop; i++) std::cout << AS_INT(stackBase()[i]) << " ";
+    std::cout << std::endl;
+}
+
+std::string VM::getOpcodeName(int32_t opcode) {
+    switch (opcode) {
+        case 0x01: return "PUSH ";
+        case 0x02: return "POP  ";
+        case 0x03: return "DUP  ";
+        case 0x10: return "ADD  ";
+        case 0x11: return "SUB  ";
+        case 0x12: return "MUL  ";
+        case 0x13: return "DIV  ";
+        case 0x14: return "CMP  ";
+        case 0x20: return "JMP  ";
+        case 0x21: return "JZ   ";
+        case 0x22: return "JNZ  ";
+        case 0x30: return "STORE";
+        case 0x31: return "LOAD ";
+        case 0x40: return "CALL ";
+        case 0x41: return "RET  ";
+        case 0x42: return "PRINT";
+        case 0x50: return "LOAD_LOAD_ADD";
+        case 0x51: return "INC_VAR";
+        case 0x52: return "CMP_JZ";
+        case 0x53: return "LOAD_LOAD_CMP_JZ";
+        case 0x54: return "LOAD_PUSH_CMP_JZ";
+        case 0xFD: return "LOOP ";
+        case 0xFE: return "BREAK";
+        case 0xFF: return "HALT ";
+        default:   return "UNKNOWN";
+    }
+}
+
+void VM::printStats() {
+    std::cout << "\n=== Execution Statistics ===\n";
+    std::cout << "Instructions executed: " << instructionCount << std::endl;
+    std::cout << "Max stack depth: " << maxStackDepth << std::endl;
+    std::cout << "Fused superinstructions: " << fusionCount << std::endl;
+    if (isJitCompiled()) {
+        std::cout << "JIT compiled: " << jit->compiledInstructions() << " instructions, "
+                  << jit->codeSize() << " bytes" << std::endl;
+    }
+    if (!traces.empty()) {
+        size_t bytes = 0;
+        for (const auto& entry : traces) bytes += entry.second->codeSize();
+        std::cout << "Traces compiled: " << traces.size() << " (" << bytes << " bytes, "
+                  << traceEntries << " entries)" << std::endl;
+    }
+    if (closureCode) {
+        std::cout << "Execution tier: closures (" << closureCode->blocks.size() << " blocks, "
+                  << closureCode->numOps << " closures)" << std::endl;
+    }
+    if (aot) {
+        std::cout << "Execution tier: AOT (" << aot->getPath()
+                  << (aot->loadedFromCache() ? ", cached" : ", compiled") << ")" << std::endl;
+    }
+    if (ranRegisterTier) {
+        std::cout << "Execution tier: register (" << registerCode->numRegs
+                  << " registers, " << registerCode->code.size() << " instructions)" << std::endl;
+    }
+}
+
+bool VM::validAddress(int addr) const {
+    return addr >= 0 && static_cast<size_t>(addr) < program.size();
+}
+
+bool VM::validMemory(int idx) const {
+    return idx >= 0 && static_cast<size_t>(idx) < memory.size();
 }
\ No newline at end of file
@@ -5,9 +5,61 @@
 #include <cstdint>
 #include <iostream>
 #include <string>
+#include <map>
 #include <set>
+#include <memory>
 #include "Value.h"
 #include "Object.h"
+#include "RegisterTier.h"
+#include "Jit.h"
+#include "Trace.h"
+#include "ClosureTier.h"
+#include "Aot.h"
+#include "Sampler.h"
+#include "Verifier.h"
+#include "OutputBuffer.h"
+#include "Bytecode.h"
+
+// Build-time dispatch selection: GCC/Clang use the direct-threaded core
+// (labels-as-values); define VM_SWITCH_DISPATCH to force the portable switch.
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(VM_SWITCH_DISPATCH)
+#define VM_THREADED_DISPATCH 1
+#else
+#define VM_THREADED_DISPATCH 0
+#endif
+
+// Decoder-only opcodes, placed above the bytecode opcode range.
+enum DecodedOpcode : int32_t {
+    DOP_END     = 0x100,
+    DOP_INVALID = 0x101,
+    DOP_COUNT   = 0x102
+};
+
+// One entry per bytecode address, so any jump target is also an index.
+struct DecodedInstr {
+#if VM_THREADED_DISPATCH
+    const void* handler;
+#endif
+    int32_t opcode;
+    int32_t operand;
+    int32_t operand2;
+    int32_t target;
+};
+
+enum class VMTrap {
+    NONE,
+    STACK_OVERFLOW,
+    STACK_UNDERFLOW,
+    DIVISION_BY_ZERO,
+    CALL_STACK_OVERFLOW,
+    INVALID_BYTECODE    // rejected by the verifier; the program never runs
+};
+
+// Profiler sample totals for one bytecode address (or one opcode)
+struct InstrProfile {
+    long long count = 0;
+    uint64_t cycles = 0;
+};
 
 struct GCStats {
     int objectsFreed;
@@ -17,10 +69,35 @@ struct GCStats {
 
 class VM {
 public:
-    VM(const std::vector<int32_t>& bytecode);
+    static const size_t DEFAULT_STACK_LIMIT = 4096;
+    // Nested CALLs before a CALL traps
+    static const size_t MAX_CALL_DEPTH = 1024;
+    // Instructions interpreted by run() before the program is JIT-compiled
+    static const long long DEFAULT_JIT_THRESHOLD = 100000;
+
+    VM(const std::vector<int32_t>& bytecode, size_t stackLimit = DEFAULT_STACK_LIMIT);
+    // Runs bytecode in place, without a copy (a MappedBytecode's view);
+    // owner keeps the words alive for this VM and its forks
+    VM(BytecodeView bytecode, std::shared_ptr<const void> owner, size_t stackLimit = DEFAULT_STACK_LIMIT);
     ~VM();
 
+    // Copy-on-write child for checkpoints. The bytecode and every heap
+    // object allocated so far are shared, not copied: no instruction writes
+    // to a pair once allocated, so after the fork each VM allocates into a fresh
+    // private heap and its collector leaves the shared objects alone; they
+    // are freed with the last VM that shares them. The stack, memory and
+    // call stack are bounded (stackLimit, 1024 slots, MAX_CALL_DEPTH) and
+    // are copied. The
+    // child keeps breakpoints and the output mode but not the tiers,
+    // profiles or traces; it continues on the interpreter.
+    std::unique_ptr<VM> fork();
+
     void run();
+    // Time slice for a scheduler: interprets about `budget` more
+    // instructions (whole fused groups) and flushes the output. Other tiers
+    // are not used. False once the program has halted, trapped or stopped
+    // at a breakpoint.
+    bool runSlice(long long budget);
     void executeNext();
     void stop() { running = false; }
     GCStats gc();           
@@ -28,6 +105,7 @@ public:
     
     void pushStack(Value v);
     int getObjectCount();      
+    int getSharedObjectCount() const;
     void printHeapStatus();    
     static std::string getOpcodeName(int32_t opcode);
     void printFinalStack();
@@ -36,32 +114,168 @@ public:
     
     void setBreakpoint(int address);
     void clearBreakpoint(int address);
+
+    // Opt-in register tier: used by run() from a fresh start without breakpoints
+    bool enableRegisterTier(std::string& error);
+    bool hasRegisterTier() const { return registerCode != nullptr; }
+    void printRegisterCode() const;
+
+    // Negative threshold disables the JIT; 0 compiles on the first run()
+    void setJitThreshold(long long threshold) { jitThreshold = threshold; }
+    bool isJitCompiled() const { return jit && jit->valid(); }
+
+    // Opt-in tracing JIT: hot loops are recorded and run as native traces.
+    // Replaces the whole-program JIT; false when traces cannot be compiled here.
+    bool enableTracing();
+    int getTraceCount() const { return (int)traces.size(); }
+
+    // Opt-in closure-compiled engine: portable, no generated machine code.
+    // Used by run() without breakpoints in place of the interpreter and JIT.
+    // Still behind the threaded interpreter on call- and branch-heavy loops
+    // (bench_threaded), so the shell does not offer it.
+    void enableClosureTier();
+    bool hasClosureTier() const { return closureCode != nullptr; }
+
+    // Opt-in AOT backend: the program is compiled to a cached shared object
+    // and run() enters it instead of interpreting. False with error set when
+    // the object cannot be built or loaded.
+    bool enableAot(std::string& error);
+    bool hasAot() const { return aot != nullptr; }
+
+    // Opt-in profiler: run() times every instruction (rdtsc on x86) and
+    // records count and cycles per pc. The normal run loop is unaffected.
+    void enableProfiling();
+    bool isProfiling() const { return profiling; }
+    const std::vector<InstrProfile>& getProfile() const { return profile; }
+    void printProfile(size_t top = 10) const;
+
+    // Opt-in statistical sampler: run() keeps its tier and records the pc
+    // and call stack whenever a SIGPROF tick is due (see runSampled). Source
+    // lines (one per bytecode address, 0 if unknown) label the samples.
+    void enableSampling(int hz = Sampler::DEFAULT_HZ);
+    bool isSampling() const { return sampler != nullptr; }
+    void setSourceLines(const std::vector<int32_t>& lines) { sourceLines = lines; }
+    long long getSampleCount() const { return sampler ? sampler->getSampleCount() : 0; }
+    void writeFoldedStacks(std::ostream& out) const;
+
+    // PRINT output is batched (see OutputBuffer) and flushed when run()
+    // returns, at HALT and breakpoints, and before a trap is reported.
+    // Line-buffered output writes each line at once, for interactive use.
+    void setLineBuffered(bool on) { output.setLineBuffered(on); }
+    bool isLineBuffered() const { return output.isLineBuffered(); }
+    void setOutputFd(int fd) { output.setFd(fd); }
+    // Collects output, trap messages included, in sink instead
+    void setOutputCapture(std::string* sink) { output.setCapture(sink); }
+    void flushOutput() { output.flush(); }
+    const OutputBuffer& getOutput() const { return output; }
     
     size_t getPC() const { return pc; }
     bool isRunning() const { return running; }
+    long long getInstructionCount() const { return instructionCount; }
+    size_t getMaxStackDepth() const { return maxStackDepth; }
+    int getFusionCount() const { return fusionCount; }
+    std::vector<Value> getStack() const;
+    VMTrap getTrap() const { return trap; }
+    // Verifier result. Balanced programs whose depth bound fits stackLimit
+    // run on the unchecked interpreter with a stack allocated once
+    const Verification& getVerification() const { return verification; }
+    bool isChecked() const { return checked; }
+    size_t getStackCapacity() const { return stackCapacity; }
+    static const char* getTrapName(VMTrap t);
+    static const char* dispatchMode();
 
 private:
-    std::vector<int32_t> program;
+    // Heap objects frozen by fork()
+    struct HeapSegment {
+        Object* objects;
+        ~HeapSegment();
+    };
+    struct ForkTag {};
+
+    std::shared_ptr<const void> image;     // owns the words program points at
+    BytecodeView program;
+    std::vector<DecodedInstr> plain;
+    std::vector<DecodedInstr> code;
+    // Operand stack: slot 0 is a scratch sentinel, values live from slot 1,
+    // with room for stackCapacity values and two spare slots.
     std::vector<Value> stack;
     std::vector<Value> memory;
     std::vector<int32_t> callStack;
-    std::set<int> breakpoints;
+    std::map<int, DecodedInstr> breakpoints;
+    std::unique_ptr<RegisterProgram> registerCode;
+    std::unique_ptr<JitCode> jit;
+    std::unique_ptr<ClosureProgram> closureCode;
+    std::unique_ptr<AotCode> aot;
+    std::map<int, std::unique_ptr<Trace>> traces;
+    std::set<int> coldLoops;
+    std::vector<int32_t> loopHits;
+    std::vector<InstrProfile> profile;
+    std::unique_ptr<Sampler> sampler;
+    std::vector<int32_t> sourceLines;
     
     Object* objects; 
+    std::vector<std::shared_ptr<const HeapSegment>> sharedHeap;
+    uint32_t heapId;
     long long instructionCount;
+    long long jitThreshold;
+    long long traceEntries;
     size_t maxStackDepth;
+    int fusionCount;
+    size_t stackTop;
+    size_t stackLimit;
+    size_t stackCapacity;
     int pc;
     bool running;
+    bool stoppedAtBreakpoint;
+    bool ranRegisterTier;
+    bool tracing;
+    bool profiling;
+    bool checked;
+    bool stackFull;         // the checked interpreter stopped to grow the stack
+    uint64_t profileOverhead;
+    int traceAnchor;
+    VMTrap trap;
+    Verification verification;
+    OutputBuffer output;
 
-    Value pop();
-    void push(Value v);
-    void execute(int32_t opcode);
-    void updateMaxStackDepth();
-    bool validAddress(int addr);
-    bool validMemory(int idx);
+    VM(std::shared_ptr<const std::vector<int32_t>> words, size_t stackLimit);
+    VM(VM& parent, ForkTag);
+    Value* stackBase() { return stack.data() + 1; }
+    const Value* stackBase() const { return stack.data() + 1; }
+    void reportTrap();
+    bool reserveStack(size_t depth);
+    void decode();
+    DecodedInstr decodeAt(int addr) const;
+    void fuse();
+    void rebuildCode();
+    // Runs the interpreter instantiation matching the decoded stream's handlers
+    void runLoop(const DecodedInstr* stream, long long budget);
+    void runTiers();
+    void runSelected();
+    void runInterpreter(long long budget);
+    template <bool Checked> void interpret(const DecodedInstr* stream, long long budget);
+    void runRegisters();
+    void runJit();
+    void runTraced();
+    bool recordTrace(int anchor);
+    void runTrace(const Trace& trace);
+    void runClosures();
+    void runAot();
+    void runProfiled();
+    void runSampled();
+    void sampleIfDue();
+    bool validAddress(int addr) const;
+    bool validMemory(int idx) const;
     void markObject(Object* obj);
     void markValue(Value v);
+    void markRoots(const Value* roots, size_t count);
     int sweep(); 
+
+#if VM_THREADED_DISPATCH
+    // Label addresses of interpret<false> and interpret<true>
+    static const void* handlers[2][DOP_COUNT];
+    const void* const* handlerTable() const { return handlers[checked]; }
+#endif
 };
 
 #endif
\ No newline at end of file
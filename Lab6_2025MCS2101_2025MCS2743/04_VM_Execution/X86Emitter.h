@@ -0,0 +1,59 @@
+#ifndef X86_EMITTER_H
+#define X86_EMITTER_H
+
+#include "Jit.h"
+
+#if VM_JIT_AVAILABLE
+#include <sys/mman.h>
+#include <cstring>
+#include <cstdint>
+#include <vector>
+#include <initializer_list>
+
+// Byte-level x86-64 code buffer shared by the JIT compilers.
+
+const uint8_t CC_B  = 0x82;
+const uint8_t CC_AE = 0x83;
+const uint8_t CC_Z  = 0x84;
+const uint8_t CC_NZ = 0x85;
+const uint8_t CC_L  = 0x8C;
+const uint8_t CC_GE = 0x8D;
+
+class Emitter {
+public:
+    std::vector<uint8_t> bytes;
+
+    size_t pos() const { return bytes.size(); }
+    void emit(std::initializer_list<uint8_t> b) { bytes.insert(bytes.end(), b); }
+    void imm32(int32_t v) {
+        for (int i = 0; i < 4; i++) bytes.push_back((uint8_t)((uint32_t)v >> (8 * i)));
+    }
+    void imm64(uint64_t v) {
+        for (int i = 0; i < 8; i++) bytes.push_back((uint8_t)(v >> (8 * i)));
+    }
+    void disp8(size_t offset) { bytes.push_back((uint8_t)offset); }
+
+    // Branch with a rel32 operand to be bound later; returns the patch site
+    size_t jcc(uint8_t cc) { emit({0x0F, cc}); size_t at = pos(); imm32(0); return at; }
+    size_t jmp() { emit({0xE9}); size_t at = pos(); imm32(0); return at; }
+    void bind(size_t at, size_t target) {
+        int32_t rel = (int32_t)(target - (at + 4));
+        std::memcpy(&bytes[at], &rel, 4);
+    }
+
+    // Copies the code into fresh executable memory; nullptr on failure
+    void* install() const {
+        void* mem = mmap(nullptr, pos(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED) return nullptr;
+        std::memcpy(mem, bytes.data(), pos());
+        if (mprotect(mem, pos(), PROT_READ | PROT_EXEC) != 0) {
+            munmap(mem, pos());
+            return nullptr;
+        }
+        return mem;
+    }
+};
+
+#endif
+
+#endif
@@ -0,0 +1,1005 @@
+#include <iostream>
+#include <algorithm>
+#include <cassert>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <sstream>
+#include <climits>
+#include <cstdio>
+#include <unistd.h>
+#include <thread>
+#include "VirtualMachine.h"
+#include "Instruction.h"
+#include "Value.h"
+
+using namespace std;
+
+void runTest(const string& name, void (*testFunc)()) {
+    cout << "\n==================================================" << endl;
+    cout << "VM TEST: " << name << endl;
+    cout << "==================================================" << endl;
+
+    try {
+        testFunc();
+        cout << ">>> RESULT: PASSED" << endl;
+    } catch (...) {
+        cout << ">>> RESULT: FAILED" << endl;
+        exit(1);
+    }
+}
+
+int32_t topInt(const VM& vm) {
+    vector<Value> stack = vm.getStack();
+    assert(!stack.empty());
+    return AS_INT(stack.back());
+}
+
+void testValueEncoding() {
+    const int32_t ints[] = {0, 1, -1, 42, INT32_MAX, INT32_MIN};
+    for (int32_t i : ints) {
+        Value v = INT_VAL(i);
+        assert(IS_INT(v) && !IS_OBJ(v) && AS_INT(v) == i);
+    }
+    assert(IS_INT(Value()) && AS_INT(Value()) == 0);
+    VM vm({OP_HALT});
+    Object* pair = vm.allocatePair(nullptr, nullptr);
+    Value v = OBJ_VAL(pair);
+    assert(IS_OBJ(v) && !IS_INT(v) && AS_OBJ(v) == pair);
+    assert(sizeof(Value) == (VM_TAGGED_VALUES ? 8u : 16u));
+    cout << "   [Check] " << (VM_TAGGED_VALUES ? "Tagged" : "Wide") << " " << sizeof(Value)
+         << "-byte Values round-trip ints and objects." << endl;
+}
+
+void testArithmetic() {
+    VM vm({OP_PUSH, 20, OP_PUSH, 5, OP_DIV, OP_PUSH, 3, OP_MUL, OP_HALT});
+    vm.run();
+    assert(topInt(vm) == 12);
+    assert(vm.getInstructionCount() == 6);
+    assert(vm.getMaxStackDepth() == 2);
+    cout << "   [Check] (20 / 5) * 3 = " << topInt(vm) << endl;
+}
+
+// x += 1 for 3 x 2 iterations, leaving x on the stack
+const vector<int32_t> nestedLoopProgram = {
+    OP_PUSH, 0, OP_STORE, 0, OP_PUSH, 0, OP_STORE, 1,
+    OP_LOAD, 1, OP_PUSH, 3, OP_CMP, OP_JZ, 51, OP_PUSH, 0, OP_STORE, 2,
+    OP_LOAD, 2, OP_PUSH, 2, OP_CMP, OP_JZ, 42,
+    OP_LOAD, 0, OP_PUSH, 1, OP_ADD, OP_STORE, 0,
+    OP_LOAD, 2, OP_PUSH, 1, OP_ADD, OP_STORE, 2, OP_JMP, 19,
+    OP_LOAD, 1, OP_PUSH, 1, OP_ADD, OP_STORE, 1, OP_JMP, 8,
+    OP_LOAD, 0, OP_HALT};
+
+void testNestedLoop() {
+    VM vm(nestedLoopProgram);
+    vm.run();
+    assert(topInt(vm) == 6);
+    assert(vm.getInstructionCount() == 133);
+    assert(vm.getMaxStackDepth() == 2);
+    assert(vm.getFusionCount() == 5);
+    cout << "   [Check] Nested loop result " << topInt(vm) << " after "
+         << vm.getInstructionCount() << " instructions." << endl;
+}
+
+void testNestedCall() {
+    VM vm({OP_CALL, 3, OP_HALT,
+           OP_CALL, 9, OP_PUSH, 10, OP_ADD, OP_RET,
+           OP_PUSH, 20, OP_RET});
+    vm.run();
+    assert(topInt(vm) == 30);
+    assert(vm.getInstructionCount() == 8);
+    cout << "   [Check] Nested calls returned " << topInt(vm) << endl;
+}
+
+void testMisalignedJump() {
+    VM vm({OP_JMP, 1, OP_HALT});
+    vm.run();
+    assert(vm.getTrap() == VMTrap::INVALID_BYTECODE);
+    assert(vm.getVerification().error == "pc 0: JMP target 1 is not an instruction boundary");
+    assert(vm.getInstructionCount() == 0);
+    cout << "   [Check] Jump into an operand rejected at load." << endl;
+}
+
+void testDivisionByZero() {
+    VM vm({OP_PUSH, 10, OP_PUSH, 0, OP_DIV, OP_PUSH, 1, OP_HALT});
+    vm.run();
+    assert(!vm.isRunning());
+    assert(vm.getTrap() == VMTrap::DIVISION_BY_ZERO);
+    assert(vm.getStack().empty());
+    assert(vm.getInstructionCount() == 3);
+    cout << "   [Check] Division by zero stopped the VM." << endl;
+}
+
+void testInvalidOpcode() {
+    VM vm({OP_PUSH, 7, 0x7F, OP_PUSH, 8, OP_HALT});
+    vm.run();
+    assert(!vm.isRunning());
+    assert(vm.getTrap() == VMTrap::INVALID_BYTECODE);
+    assert(vm.getVerification().errorPc == 2);
+    assert(vm.getVerification().error == "pc 2: unknown opcode 0x7f");
+    assert(vm.getStack().empty());
+    cout << "   [Check] Unknown opcode rejected at load." << endl;
+}
+
+void testVerifierDiagnostics() {
+    struct Case { vector<int32_t> program; string error; };
+    const Case cases[] = {
+        {{OP_PUSH}, "pc 0: PUSH is missing its operand"},
+        {{OP_PUSH, 1, OP_JZ, 40, OP_HALT}, "pc 2: JZ target 40 is outside the program (0..4)"},
+        {{OP_LOAD, 1024, OP_HALT}, "pc 0: LOAD memory index 1024 is out of range (0..1023)"},
+        {{OP_STORE, -1, OP_HALT}, "pc 0: STORE memory index -1 is out of range (0..1023)"},
+        {{OP_PUSH, 4, OP_ADD, OP_HALT}, "pc 2: ADD needs 2 stack values, 1 available"},
+        {{OP_PUSH, 0, OP_JNZ, 5, OP_HALT, OP_POP, OP_HALT}, "pc 5: POP needs 1 stack value, 0 available"},
+    };
+    for (const Case& c : cases) {
+        VM vm(c.program);
+        assert(vm.getTrap() == VMTrap::INVALID_BYTECODE);
+        assert(vm.getVerification().error == c.error);
+    }
+
+    // Balanced code runs unchecked; growing loops and calls keep the checks
+    VM loop(nestedLoopProgram);
+    assert(loop.getVerification().valid && !loop.isChecked());
+    assert(loop.getVerification().depth[51] == 0);
+    VM grow({OP_PUSH, 1, OP_DUP, OP_JMP, 2});
+    assert(grow.getVerification().valid && grow.isChecked());
+    VM call({OP_CALL, 3, OP_HALT, OP_PUSH, 20, OP_RET});
+    assert(call.getVerification().valid && call.isChecked());
+    VM ret({OP_PUSH, 1, OP_RET, OP_PUSH, 2, OP_HALT});
+    ret.run();
+    assert(!ret.isRunning() && ret.getTrap() == VMTrap::NONE);
+    assert(ret.getPC() == 3 && topInt(ret) == 1);
+    cout << "   [Check] " << sizeof(cases) / sizeof(cases[0]) << " malformed programs rejected with their pc." << endl;
+}
+
+void testSingleStep() {
+    VM vm({OP_PUSH, 20, OP_PUSH, 5, OP_DIV, OP_PUSH, 3, OP_MUL, OP_HALT});
+    const size_t expectedPC[] = {2, 4, 5, 7, 8, 9};
+    for (size_t pc : expectedPC) {
+        vm.executeNext();
+        assert(vm.getPC() == pc);
+    }
+    assert(!vm.isRunning());
+    assert(topInt(vm) == 12);
+    assert(vm.getInstructionCount() == 6);
+    cout << "   [Check] executeNext advanced one instruction at a time." << endl;
+}
+
+void testBreakpointStop() {
+    VM vm({OP_PUSH, 1, OP_PUSH, 2, OP_ADD, OP_HALT});
+    vm.setBreakpoint(4);
+    vm.run();
+    assert(vm.isRunning());
+    assert(vm.getPC() == 4);
+    assert(vm.getStack().size() == 2);
+    vm.clearBreakpoint(4);
+    vm.run();
+    assert(topInt(vm) == 3);
+    cout << "   [Check] Run stopped at breakpoint and resumed after clear." << endl;
+}
+
+void testFusedGroupStepping() {
+    VM vm({OP_PUSH, 5, OP_STORE, 0,
+           OP_LOAD, 0, OP_PUSH, 1, OP_ADD, OP_STORE, 0,
+           OP_LOAD, 0, OP_HALT});
+    assert(vm.getFusionCount() == 1);
+    vm.setBreakpoint(8);
+    assert(vm.getFusionCount() == 0);
+    vm.run();
+    assert(vm.getPC() == 8);
+    assert(vm.getStack().size() == 2);
+    vm.executeNext();
+    assert(vm.getPC() == 9);
+    assert(topInt(vm) == 6);
+    vm.run();
+    assert(topInt(vm) == 6);
+    assert(vm.getInstructionCount() == 8);
+    cout << "   [Check] Breakpoint inside INC_VAR group stopped at the original ADD." << endl;
+}
+
+void testContinuePastBreakpoint() {
+    VM vm({OP_PUSH, 0, OP_STORE, 0,
+           OP_LOAD, 0, OP_PUSH, 3, OP_CMP, OP_JZ, 21,
+           OP_LOAD, 0, OP_PUSH, 1, OP_ADD, OP_STORE, 0, OP_JMP, 4,
+           OP_HALT, OP_HALT});
+    vm.setBreakpoint(11);
+    int stops = 0;
+    vm.run();
+    while (vm.isRunning()) {
+        assert(vm.getPC() == 11);
+        stops++;
+        vm.run();
+    }
+    assert(stops == 3);
+    vm.executeNext();
+    cout << "   [Check] Continue resumed past the patched breakpoint " << stops << " times." << endl;
+}
+
+void testStepOntoBreakpoint() {
+    VM vm({OP_PUSH, 1, OP_PUSH, 2, OP_ADD, OP_HALT});
+    vm.setBreakpoint(2);
+    vm.executeNext();
+    assert(vm.getPC() == 2);
+    vm.executeNext();
+    assert(vm.getPC() == 2);
+    vm.executeNext();
+    assert(vm.getPC() == 4);
+    assert(vm.getStack().size() == 2);
+    cout << "   [Check] Step reported the breakpoint once, then stepped over it." << endl;
+}
+
+void testStackOverflowTrap() {
+    VM vm({OP_PUSH, 1, OP_DUP, OP_JMP, 2}, 16);
+    vm.run();
+    assert(vm.getTrap() == VMTrap::STACK_OVERFLOW);
+    assert(vm.getStack().size() == 16);
+    assert(vm.getMaxStackDepth() == 16);
+    assert(vm.getPC() == 2);
+    vm.run();
+    assert(vm.getStack().size() == 16);
+    cout << "   [Check] Unbounded DUP loop trapped at the 16-slot limit." << endl;
+}
+
+void testStackUnderflowTrap() {
+    // Depth at pc 6 is 0 or 1 depending on the JZ, so the verifier leaves
+    // the underflow to the checked interpreter
+    VM vm({OP_PUSH, 0, OP_JZ, 6, OP_PUSH, 9, OP_PUSH, 4, OP_ADD, OP_HALT});
+    assert(vm.isChecked());
+    vm.run();
+    assert(vm.getTrap() == VMTrap::STACK_UNDERFLOW);
+    assert(vm.getPC() == 8);
+    assert(topInt(vm) == 4);
+    cout << "   [Check] ADD with one operand trapped without touching the stack." << endl;
+}
+
+void testStaticStackBound() {
+    VM loop(nestedLoopProgram);
+    assert(loop.getVerification().maxDepth == 2 && loop.getVerification().maxCallDepth == 0);
+    assert(!loop.isChecked() && loop.getStackCapacity() == 2);
+    loop.run();
+    assert(loop.getMaxStackDepth() == 2 && topInt(loop) == 6);
+
+    VM call({OP_CALL, 3, OP_HALT,
+             OP_CALL, 9, OP_PUSH, 10, OP_ADD, OP_RET,
+             OP_PUSH, 20, OP_RET});
+    assert(call.getVerification().maxDepth == 2 && call.getVerification().maxCallDepth == 2);
+    assert(call.isChecked() && call.getStackCapacity() == 2);
+    call.run();
+    assert(call.getMaxStackDepth() == 2 && topInt(call) == 30);
+
+    // Both arms of the JZ are bounded even though their depths differ
+    VM branch({OP_PUSH, 0, OP_JZ, 6, OP_PUSH, 9, OP_PUSH, 4, OP_ADD, OP_HALT});
+    assert(branch.getVerification().maxDepth == 2 && branch.isChecked());
+
+    VM recursive({OP_PUSH, 1, OP_CALL, 0});
+    assert(recursive.getVerification().maxDepth == -1);
+    VM grow({OP_PUSH, 1, OP_DUP, OP_JMP, 2});
+    assert(grow.getVerification().maxDepth == -1 && grow.getVerification().maxCallDepth == -1);
+
+    // A value pushed from outside still leaves room for the whole bound
+    VM pushed(nestedLoopProgram);
+    pushed.pushStack(INT_VAL(7));
+    assert(!pushed.isChecked() && pushed.getStackCapacity() >= 3);
+    pushed.run();
+    assert(pushed.getStack().size() == 2 && topInt(pushed) == 6);
+    cout << "   [Check] Static bounds match the depths reached at run time." << endl;
+}
+
+void testStackGrowth() {
+    // Leaves i on the stack for i = 0..999: no static bound
+    const vector<int32_t> program = {
+        OP_PUSH, 0, OP_STORE, 0,
+        OP_LOAD, 0, OP_PUSH, 1000, OP_CMP, OP_JZ, 22,
+        OP_LOAD, 0, OP_LOAD, 0, OP_PUSH, 1, OP_ADD, OP_STORE, 0, OP_JMP, 4,
+        OP_HALT};
+    for (int tier = 0; tier < 3; tier++) {
+        VM vm(program);
+        assert(vm.isChecked() && vm.getStackCapacity() < 1000);
+        if (tier == 1) vm.enableClosureTier();
+        if (tier == 2) vm.setJitThreshold(0);
+        vm.run();
+        assert(vm.getTrap() == VMTrap::NONE && !vm.isRunning());
+        vector<Value> stack = vm.getStack();
+        assert(stack.size() == 1000 && AS_INT(stack[0]) == 0 && AS_INT(stack[999]) == 999);
+        assert(vm.getMaxStackDepth() == 1002);
+        assert(vm.getStackCapacity() >= 1002 && vm.getStackCapacity() <= VM::DEFAULT_STACK_LIMIT);
+        assert(vm.getInstructionCount() == 2 + 1000 * 10 + 5);
+    }
+
+    VM capped(program, 600);
+    capped.run();
+    assert(capped.getTrap() == VMTrap::STACK_OVERFLOW);
+    assert(capped.getStack().size() == 600 && capped.getStackCapacity() == 600);
+    cout << "   [Check] Stack grew to hold 1000 values and trapped at a 600-slot limit." << endl;
+}
+
+void testCallDepthTrap() {
+    // Calls itself forever; the bound is unknown to the verifier
+    const vector<int32_t> program = {OP_PUSH, 1, OP_POP, OP_CALL, 0};
+    for (int tier = 0; tier < 3; tier++) {
+        VM vm(program);
+        assert(vm.getVerification().maxCallDepth == -1);
+        if (tier == 1) vm.enableClosureTier();
+        if (tier == 2) vm.setJitThreshold(0);
+        vm.run();
+        assert(vm.getTrap() == VMTrap::CALL_STACK_OVERFLOW && !vm.isRunning());
+        assert(vm.getPC() == 3);
+        assert(vm.getInstructionCount() == (long long)VM::MAX_CALL_DEPTH * 3 + 3);
+        assert(vm.getStack().empty());
+    }
+    cout << "   [Check] Unbounded recursion trapped after " << VM::MAX_CALL_DEPTH << " nested calls." << endl;
+}
+
+void testRegisterTierLoop() {
+    VM vm(nestedLoopProgram);
+    string reason;
+    assert(vm.enableRegisterTier(reason));
+    vm.run();
+    assert(!vm.isRunning());
+    assert(vm.getStack().size() == 1);
+    assert(topInt(vm) == 6);
+    assert(vm.getInstructionCount() == 44);
+    cout << "   [Check] Register tier result " << topInt(vm) << " after "
+         << vm.getInstructionCount() << " instructions (stack VM: 133)." << endl;
+}
+
+void testRegisterTierStackTemps() {
+    // Counter kept on the operand stack across the loop back edge
+    VM vm({OP_PUSH, 0, OP_DUP, OP_PUSH, 5, OP_CMP, OP_JZ, 14,
+           OP_PUSH, 1, OP_ADD, OP_JMP, 2, OP_HALT, OP_PUSH, 7, OP_HALT});
+    string reason;
+    assert(vm.enableRegisterTier(reason));
+    vm.run();
+    vector<Value> stack = vm.getStack();
+    assert(stack.size() == 2);
+    assert(AS_INT(stack[0]) == 5 && AS_INT(stack[1]) == 7);
+    assert(vm.getPC() == 17);
+    cout << "   [Check] Stack after register run: [5 7]" << endl;
+}
+
+void testRegisterTierFallback() {
+    VM vm({OP_CALL, 3, OP_HALT, OP_PUSH, 20, OP_RET});
+    string reason;
+    assert(!vm.enableRegisterTier(reason));
+    assert(!vm.hasRegisterTier());
+    vm.run();
+    assert(topInt(vm) == 20);
+    cout << "   [Check] Fallback to stack VM: " << reason << endl;
+}
+
+void testRegisterTierDivisionByZero() {
+    VM vm({OP_PUSH, 7, OP_STORE, 0, OP_LOAD, 0, OP_PUSH, 0, OP_DIV, OP_PRINT, OP_HALT});
+    string reason;
+    assert(vm.enableRegisterTier(reason));
+    vm.run();
+    assert(vm.getTrap() == VMTrap::DIVISION_BY_ZERO);
+    assert(!vm.isRunning());
+    assert(vm.getPC() == 9);
+    cout << "   [Check] Register tier trapped: " << VM::getTrapName(vm.getTrap()) << endl;
+}
+
+void testRegisterTierTrapStack() {
+    // Values below the divisor: a temporary, an immediate and a variable
+    const vector<vector<int32_t>> programs = {
+        {OP_PUSH, 9, OP_STORE, 4, OP_PUSH, 9, OP_STORE, 1,
+         OP_LOAD, 4, OP_LOAD, 1, OP_SUB, OP_PUSH, 10, OP_LOAD, 3, OP_DIV, OP_HALT},
+        {OP_PUSH, 5, OP_LOAD, 2, OP_PUSH, 8, OP_LOAD, 0, OP_DIV, OP_HALT},
+        {OP_PUSH, 6, OP_STORE, 1, OP_LOAD, 1, OP_PUSH, 4, OP_PUSH, 0, OP_DIV, OP_HALT},
+    };
+    for (const auto& program : programs) {
+        VM interp(program);
+        interp.run();
+        VM reg(program);
+        string reason;
+        assert(reg.enableRegisterTier(reason));
+        reg.run();
+        assert(reg.getTrap() == VMTrap::DIVISION_BY_ZERO && interp.getTrap() == VMTrap::DIVISION_BY_ZERO);
+        assert(reg.getPC() == interp.getPC());
+        vector<Value> expected = interp.getStack();
+        vector<Value> actual = reg.getStack();
+        assert(actual.size() == expected.size());
+        for (size_t i = 0; i < actual.size(); i++) assert(AS_INT(actual[i]) == AS_INT(expected[i]));
+        cout << "   [Check] Trap at pc " << reg.getPC() << " left " << actual.size()
+             << " value(s), as the interpreter does." << endl;
+    }
+}
+
+void testJitNestedLoop() {
+    VM vm(nestedLoopProgram);
+    vm.setJitThreshold(0);
+    vm.run();
+    assert(VM_JIT_AVAILABLE == vm.isJitCompiled());
+    assert(topInt(vm) == 6);
+    assert(vm.getInstructionCount() == 133);
+    assert(vm.getMaxStackDepth() == 2);
+    cout << "   [Check] JIT result " << topInt(vm) << " after "
+         << vm.getInstructionCount() << " instructions." << endl;
+}
+
+void testJitInterpreterExits() {
+    // PRINT and CALL/RET inside a loop leave native code and resume in it
+    VM vm({OP_PUSH, 0, OP_STORE, 0,
+           OP_LOAD, 0, OP_PUSH, 3, OP_CMP, OP_JZ, 23,
+           OP_CALL, 25, OP_LOAD, 0, OP_PUSH, 1, OP_ADD, OP_STORE, 0, OP_JMP, 4,
+           OP_HALT, OP_HALT, OP_HALT,
+           OP_LOAD, 0, OP_PRINT, OP_RET});
+    vm.setJitThreshold(0);
+    vm.run();
+    assert(!vm.isRunning());
+    assert(vm.getPC() == 24);
+    assert(vm.getStack().empty());
+    assert(vm.getInstructionCount() == 3 * 13 + 2 + 5);
+}
+
+void testJitTraps() {
+    VM div({OP_PUSH, 1, OP_PUSH, 2, OP_ADD, OP_PUSH, 0, OP_DIV, OP_PUSH, 9, OP_HALT});
+    div.setJitThreshold(0);
+    div.run();
+    assert(div.getTrap() == VMTrap::DIVISION_BY_ZERO);
+    assert(div.getPC() == 8);
+    assert(div.getInstructionCount() == 5);
+
+    VM over({OP_PUSH, 1, OP_JMP, 0}, 16);
+    over.setJitThreshold(0);
+    over.run();
+    assert(over.getTrap() == VMTrap::STACK_OVERFLOW);
+    assert(over.getStack().size() == 16);
+    assert(over.getMaxStackDepth() == 16);
+    cout << "   [Check] JIT traps match the interpreter." << endl;
+}
+
+void testTracedLoop() {
+    // s = s + i * 3 for i below 1000: the loop runs as a trace once hot
+    VM vm({OP_PUSH, 0, OP_STORE, 0, OP_PUSH, 0, OP_STORE, 1,
+           OP_LOAD, 1, OP_PUSH, 1000, OP_CMP, OP_JZ, 34,
+           OP_LOAD, 0, OP_LOAD, 1, OP_PUSH, 3, OP_MUL, OP_ADD, OP_STORE, 0,
+           OP_LOAD, 1, OP_PUSH, 1, OP_ADD, OP_STORE, 1, OP_JMP, 8,
+           OP_LOAD, 0, OP_HALT});
+    assert(vm.enableTracing() == VM_JIT_AVAILABLE);
+    vm.run();
+    assert(vm.getTraceCount() == (VM_JIT_AVAILABLE ? 1 : 0));
+    assert(topInt(vm) == 1498500);
+    assert(vm.getPC() == 37);
+    assert(vm.getInstructionCount() == 4 + 1000 * 15 + 4 + 2);
+    assert(vm.getMaxStackDepth() == 3);
+    cout << "   [Check] Traced loop result " << topInt(vm) << " after "
+         << vm.getInstructionCount() << " instructions." << endl;
+}
+
+void testTraceSideExit() {
+    // Every 100th iteration takes the other side of the inner JZ, leaving the
+    // trace; the stack-carried counter survives each exit
+    VM vm({OP_PUSH, 0, OP_PUSH, 0, OP_STORE, 0,
+           OP_DUP, OP_PUSH, 500, OP_CMP, OP_JZ, 37,
+           OP_DUP, OP_DUP, OP_PUSH, 100, OP_DIV, OP_PUSH, 100, OP_MUL, OP_SUB, OP_JNZ, 30,
+           OP_LOAD, 0, OP_PUSH, 1, OP_ADD, OP_STORE, 0,
+           OP_PUSH, 1, OP_ADD, OP_JMP, 6, OP_HALT, OP_HALT,
+           OP_LOAD, 0, OP_HALT});
+    vm.enableTracing();
+    vm.run();
+    vector<Value> stack = vm.getStack();
+    assert(stack.size() == 2);
+    assert(AS_INT(stack[0]) == 500 && AS_INT(stack[1]) == 5);
+    assert(vm.getPC() == 40);
+    cout << "   [Check] Side exits kept counter " << AS_INT(stack[0])
+         << " and hits " << AS_INT(stack[1]) << endl;
+}
+
+void testTraceDivisionByZero() {
+    // The divisor reaches zero inside the compiled trace
+    VM vm({OP_PUSH, 100, OP_STORE, 0, OP_PUSH, 0, OP_STORE, 1,
+           OP_PUSH, 1000, OP_LOAD, 0, OP_DIV, OP_STORE, 1,
+           OP_LOAD, 0, OP_PUSH, 1, OP_SUB, OP_STORE, 0, OP_JMP, 8});
+    vm.enableTracing();
+    vm.run();
+    assert(vm.getTrap() == VMTrap::DIVISION_BY_ZERO);
+    assert(vm.getPC() == 13);
+    assert(vm.getInstructionCount() == 4 + 100 * 9 + 3);
+    cout << "   [Check] Trace exited to the trap: " << VM::getTrapName(vm.getTrap()) << endl;
+}
+
+void testClosureNestedLoop() {
+    VM vm(nestedLoopProgram);
+    vm.enableClosureTier();
+    vm.run();
+    assert(vm.hasClosureTier());
+    assert(topInt(vm) == 6);
+    assert(vm.getInstructionCount() == 133);
+    assert(vm.getMaxStackDepth() == 2);
+    cout << "   [Check] Closure result " << topInt(vm) << " after "
+         << vm.getInstructionCount() << " instructions." << endl;
+}
+
+void testClosureCallsAndTraps() {
+    VM calls({OP_PUSH, 0, OP_STORE, 0,
+              OP_LOAD, 0, OP_PUSH, 3, OP_CMP, OP_JZ, 23,
+              OP_CALL, 25, OP_LOAD, 0, OP_PUSH, 1, OP_ADD, OP_STORE, 0, OP_JMP, 4,
+              OP_HALT, OP_HALT, OP_HALT,
+              OP_LOAD, 0, OP_PRINT, OP_RET});
+    calls.enableClosureTier();
+    calls.run();
+    assert(!calls.isRunning());
+    assert(calls.getPC() == 24);
+    assert(calls.getInstructionCount() == 3 * 13 + 2 + 5);
+
+    VM div({OP_PUSH, 1, OP_PUSH, 2, OP_ADD, OP_PUSH, 0, OP_DIV, OP_PUSH, 9, OP_HALT});
+    div.enableClosureTier();
+    div.run();
+    assert(div.getTrap() == VMTrap::DIVISION_BY_ZERO);
+    assert(div.getPC() == 8);
+    assert(div.getInstructionCount() == 5);
+
+    VM over({OP_PUSH, 1, OP_JMP, 0}, 16);
+    over.enableClosureTier();
+    over.run();
+    assert(over.getTrap() == VMTrap::STACK_OVERFLOW);
+    assert(over.getStack().size() == 16);
+    assert(over.getMaxStackDepth() == 16);
+    cout << "   [Check] Closure calls and traps match the interpreter." << endl;
+}
+
+// AOT tests build into a private cache directory, removed at the end
+string aotCache;
+
+bool enableAotOrSkip(VM& vm) {
+    if (aotCache.empty()) {
+        char dir[] = "/tmp/lab6_aot_test_XXXXXX";
+        assert(mkdtemp(dir) != nullptr);
+        aotCache = dir;
+        setenv("LAB6_AOT_CACHE", dir, 1);
+    }
+    string error;
+    if (vm.enableAot(error)) return true;
+    cout << "   [Skip] AOT backend unavailable: " << error << endl;
+    return false;
+}
+
+void testAotNestedLoop() {
+    VM vm(nestedLoopProgram);
+    if (!enableAotOrSkip(vm)) return;
+    vm.run();
+    assert(topInt(vm) == 6);
+    assert(vm.getInstructionCount() == 133);
+    assert(vm.getMaxStackDepth() == 2);
+
+    // A second compile of the same bytecode is served from the cache
+    AotCode again(nestedLoopProgram);
+    assert(again.valid() && again.loadedFromCache());
+    cout << "   [Check] AOT result " << topInt(vm) << " after "
+         << vm.getInstructionCount() << " instructions, cached at " << again.getPath() << endl;
+}
+
+void testAotCallsAndTraps() {
+    VM calls({OP_PUSH, 0, OP_STORE, 0,
+              OP_LOAD, 0, OP_PUSH, 3, OP_CMP, OP_JZ, 23,
+              OP_CALL, 25, OP_LOAD, 0, OP_PUSH, 1, OP_ADD, OP_STORE, 0, OP_JMP, 4,
+              OP_HALT, OP_HALT, OP_HALT,
+              OP_LOAD, 0, OP_PRINT, OP_RET});
+    if (!enableAotOrSkip(calls)) return;
+    calls.run();
+    assert(!calls.isRunning());
+    assert(calls.getPC() == 24);
+    assert(calls.getInstructionCount() == 3 * 13 + 2 + 5);
+
+    VM div({OP_PUSH, 1, OP_PUSH, 2, OP_ADD, OP_PUSH, 0, OP_DIV, OP_PUSH, 9, OP_HALT});
+    assert(enableAotOrSkip(div));
+    div.run();
+    assert(div.getTrap() == VMTrap::DIVISION_BY_ZERO);
+    assert(div.getPC() == 8);
+    assert(div.getInstructionCount() == 5);
+
+    VM over({OP_PUSH, 1, OP_JMP, 0}, 16);
+    assert(enableAotOrSkip(over));
+    over.run();
+    assert(over.getTrap() == VMTrap::STACK_OVERFLOW);
+    assert(over.getStack().size() == 16);
+    assert(over.getMaxStackDepth() == 16);
+    cout << "   [Check] AOT calls and traps match the interpreter." << endl;
+}
+
+void testProfiler() {
+    VM vm(nestedLoopProgram);
+    vm.enableProfiling();
+    vm.setBreakpoint(42);
+    int stops = 0;
+    for (vm.run(); vm.isRunning() && vm.getPC() == 42; vm.run()) stops++;
+    assert(stops == 3);
+    assert(topInt(vm) == 6);
+    assert(vm.getInstructionCount() == 133);
+    assert(vm.getMaxStackDepth() == 2);
+
+    const vector<InstrProfile>& profile = vm.getProfile();
+    long long total = 0;
+    for (const InstrProfile& p : profile) total += p.count;
+    assert(total == vm.getInstructionCount());
+    assert(profile[8].count == 4);     // outer loop head
+    assert(profile[19].count == 9);    // inner loop head
+    assert(profile[1].count == 0);     // operand, never an instruction
+    cout << "   [Check] Profiled " << total << " instructions; outer head ran "
+         << profile[8].count << " times, inner head " << profile[19].count << "." << endl;
+}
+
+void testSamplerFolding() {
+    // main calls 5, which calls 9; the leaf sits on source line 3
+    vector<int32_t> program = {OP_CALL, 5, OP_HALT, OP_HALT, OP_HALT,
+                               OP_CALL, 9, OP_RET, OP_HALT,
+                               OP_PUSH, 1, OP_RET};
+    vector<int32_t> lines(program.size(), 0);
+    lines[9] = 3;
+    Sampler sampler;
+    sampler.record(9, {2, 7});
+    sampler.record(9, {2, 7});
+    sampler.record(7, {2});
+    sampler.collect(program, lines);
+    ostringstream folded;
+    sampler.writeFolded(folded);
+    assert(folded.str() == "main;sub_5;RET@7 1\n"
+                           "main;sub_5;sub_9;line 3 PUSH@9 2\n");
+    assert(sampler.getSampleCount() == 3);
+    cout << "   [Check] Folded stacks:\n" << folded.str();
+}
+
+void testSampledRun() {
+    // 2M calls to a counter increment, long enough for a few dozen ticks
+    vector<int32_t> program = {OP_PUSH, 0, OP_STORE, 0,
+                               OP_LOAD, 0, OP_PUSH, 2000000, OP_CMP, OP_JZ, 16,
+                               OP_CALL, 17, OP_JMP, 4, OP_HALT, OP_HALT,
+                               OP_LOAD, 0, OP_PUSH, 1, OP_ADD, OP_STORE, 0, OP_RET};
+    VM plainRun(program);
+    plainRun.setJitThreshold(-1);
+    plainRun.run();
+    VM vm(program);
+    vm.enableSampling(4000);
+    vm.run();
+    assert(vm.getInstructionCount() == plainRun.getInstructionCount());
+    assert(vm.getMaxStackDepth() == plainRun.getMaxStackDepth());
+    assert(vm.getPC() == plainRun.getPC());
+    assert(vm.getSampleCount() > 0);
+    ostringstream folded;
+    vm.writeFoldedStacks(folded);
+    assert(folded.str().find("main;sub_17;") != string::npos);
+    cout << "   [Check] " << vm.getSampleCount() << " samples over "
+         << vm.getInstructionCount() << " instructions." << endl;
+}
+
+void testSampledTiers() {
+    // A loop with no exit besides its end: only back-edge polls take samples
+    const int32_t n = 20000000;
+    const vector<int32_t> program = {OP_PUSH, 0, OP_STORE, 0,
+                                     OP_LOAD, 0, OP_PUSH, n, OP_CMP, OP_JZ, 20,
+                                     OP_LOAD, 0, OP_PUSH, 1, OP_ADD, OP_STORE, 0, OP_JMP, 4,
+                                     OP_LOAD, 0, OP_HALT};
+    for (int tier = 0; tier < 3; tier++) {
+        VM vm(program);
+        if (tier == 1) vm.enableClosureTier();
+        if (tier == 2 && !enableAotOrSkip(vm)) continue;
+        vm.enableSampling(4000);
+        vm.run();
+        assert(topInt(vm) == n);
+        assert(vm.getInstructionCount() == 9LL * n + 8);
+        if (tier == 0) assert(vm.isJitCompiled());
+        // The interpreted JIT warm-up is too short for more than a tick
+        assert(vm.getSampleCount() >= 3);
+        ostringstream folded;
+        vm.writeFoldedStacks(folded);
+        assert(folded.str().find("LOAD@4") != string::npos);
+        cout << "   [Check] " << (tier == 0 ? "JIT" : tier == 1 ? "Closure tier" : "AOT") << " kept running: "
+             << vm.getSampleCount() << " samples at its loop head." << endl;
+    }
+}
+
+// Everything written to fd since offset 0
+string readBack(int fd) {
+    string text;
+    char chunk[4096];
+    assert(lseek(fd, 0, SEEK_SET) == 0);
+    for (ssize_t n; (n = read(fd, chunk, sizeof(chunk))) > 0;) text.append(chunk, n);
+    return text;
+}
+
+void testBufferedOutput() {
+    const int32_t samples[] = {0, 7, -7, 10, 99, 100, -1000, 123456789, INT32_MAX, INT32_MIN};
+    for (int32_t v : samples) {
+        char line[32];
+        size_t length = OutputBuffer::formatLine(line, v);
+        assert(string(line, length) == "Output : " + to_string(v) + "\n");
+    }
+
+    // Prints 0..4999, about 70 KiB of output
+    const vector<int32_t> program = {
+        OP_PUSH, 0, OP_STORE, 0,
+        OP_LOAD, 0, OP_PUSH, 5000, OP_CMP, OP_JZ, 23,
+        OP_LOAD, 0, OP_PRINT, OP_LOAD, 0, OP_PUSH, 1, OP_ADD, OP_STORE, 0, OP_JMP, 4,
+        OP_HALT};
+    string expected;
+    for (int i = 0; i < 5000; i++) expected += "Output : " + to_string(i) + "\n";
+    for (int tier = 0; tier < 6; tier++) {
+        FILE* file = tmpfile();
+        assert(file != nullptr);
+        VM vm(program);
+        vm.setOutputFd(fileno(file));
+        string reason;
+        vm.setJitThreshold(tier == 1 ? 0 : -1);
+        if (tier == 2) vm.enableClosureTier();
+        if (tier == 3) assert(vm.enableRegisterTier(reason));
+        if (tier == 4) vm.enableTracing();
+        if (tier == 5 && !enableAotOrSkip(vm)) {
+            fclose(file);
+            continue;
+        }
+        vm.run();
+        assert(!vm.isRunning() && vm.getOutput().pending() == 0);
+        assert(readBack(fileno(file)) == expected);
+        assert(vm.getOutput().getWriteCount() <= 3);
+        fclose(file);
+    }
+
+    // Line-buffered: one write per PRINT, nothing held between steps
+    FILE* file = tmpfile();
+    VM stepped({OP_PUSH, 1, OP_PRINT, OP_PUSH, -2, OP_PRINT, OP_HALT});
+    stepped.setOutputFd(fileno(file));
+    stepped.setLineBuffered(true);
+    stepped.executeNext();
+    stepped.executeNext();
+    assert(stepped.getOutput().getWriteCount() == 1 && readBack(fileno(file)) == "Output : 1\n");
+    stepped.run();
+    assert(stepped.getOutput().getWriteCount() == 2);
+    assert(readBack(fileno(file)) == "Output : 1\nOutput : -2\n");
+    fclose(file);
+    cout << "   [Check] 5000 lines per tier in at most 3 writes; line mode writes each line." << endl;
+}
+
+void testConcurrentVMs() {
+    // Sums 1..n, printing each partial sum, then divides by zero when n is even
+    auto program = [](int32_t n) {
+        return vector<int32_t>{
+            OP_PUSH, 0, OP_STORE, 0, OP_PUSH, 0, OP_STORE, 1,
+            OP_LOAD, 0, OP_PUSH, n, OP_CMP, OP_JZ, 34,
+            OP_LOAD, 0, OP_PUSH, 1, OP_ADD, OP_STORE, 0,
+            OP_LOAD, 1, OP_LOAD, 0, OP_ADD, OP_STORE, 1, OP_LOAD, 1, OP_PRINT, OP_JMP, 8,
+            OP_PUSH, 1, OP_PUSH, n % 2, OP_DIV, OP_HALT};
+    };
+    const int threads = 8;
+    vector<string> captured(threads);
+    vector<long long> counts(threads);
+    vector<VMTrap> traps(threads);
+    vector<thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&, t] {
+            VM vm(program(2000 + t));
+            vm.setOutputCapture(&captured[t]);
+            string reason;
+            if (t % 4 == 0) vm.setJitThreshold(-1);
+            if (t % 4 == 1) vm.setJitThreshold(0);
+            if (t % 4 == 2) vm.enableClosureTier();
+            if (t % 4 == 3) vm.enableTracing();
+            vm.run();
+            vm.setOutputCapture(nullptr);
+            counts[t] = vm.getInstructionCount();
+            traps[t] = vm.getTrap();
+        });
+    }
+    for (thread& w : workers) w.join();
+    for (int t = 0; t < threads; t++) {
+        const int n = 2000 + t;
+        string expected;
+        for (int i = 1, sum = 0; i <= n; i++) expected += "Output : " + to_string(sum += i) + "\n";
+        if (n % 2 == 0) expected += "Division by zero\n";
+        assert(captured[t] == expected);
+        assert(traps[t] == (n % 2 == 0 ? VMTrap::DIVISION_BY_ZERO : VMTrap::NONE));
+        assert(counts[t] == 4 + (long long)n * 15 + 4 + (n % 2 == 0 ? 3 : 4));
+    }
+    cout << "   [Check] " << threads << " VMs on separate threads kept their own output and traps." << endl;
+}
+
+void testTimeSlices() {
+    VM whole(nestedLoopProgram);
+    whole.setJitThreshold(-1);
+    whole.run();
+
+    // Fused groups may run a few instructions past the budget
+    VM sliced(nestedLoopProgram);
+    int slices = 0;
+    for (long long before = 0; sliced.runSlice(10); before = sliced.getInstructionCount()) {
+        assert(sliced.getInstructionCount() - before <= 10 + 3);
+        slices++;
+    }
+    assert(slices >= 10);
+    assert(!sliced.runSlice(10));
+    assert(topInt(sliced) == topInt(whole));
+    assert(sliced.getInstructionCount() == whole.getInstructionCount());
+    assert(sliced.getPC() == whole.getPC());
+
+    VM trapped({OP_PUSH, 1, OP_PUSH, 0, OP_DIV, OP_HALT});
+    while (trapped.runSlice(1)) {}
+    assert(trapped.getTrap() == VMTrap::DIVISION_BY_ZERO && trapped.getInstructionCount() == 3);
+    cout << "   [Check] " << slices + 1 << " slices of 10 reach the same state as one run." << endl;
+}
+
+void testForkCheckpoint() {
+    // Prints 0..9
+    const vector<int32_t> program = {
+        OP_PUSH, 0, OP_STORE, 0,
+        OP_LOAD, 0, OP_PUSH, 10, OP_CMP, OP_JZ, 23,
+        OP_LOAD, 0, OP_PRINT, OP_LOAD, 0, OP_PUSH, 1, OP_ADD, OP_STORE, 0, OP_JMP, 4,
+        OP_HALT};
+    string parentOut, childOut, whole;
+    VM reference(program);
+    reference.setOutputCapture(&whole);
+    reference.setJitThreshold(-1);
+    reference.run();
+
+    auto parent = make_unique<VM>(program);
+    parent->setOutputCapture(&parentOut);
+    // Three iterations in, at the loop head with an empty stack
+    while (parent->getInstructionCount() < 40 || parent->getPC() != 4) parent->executeNext();
+    // A long list below the program's values, plus garbage
+    const int pairs = 100000;
+    Object* list = nullptr;
+    for (int i = 0; i < pairs; i++) list = parent->allocatePair(nullptr, list);
+    for (int i = 0; i < 10; i++) parent->allocatePair(nullptr, nullptr);
+    parent->pushStack(OBJ_VAL(list));
+
+    unique_ptr<VM> child = parent->fork();
+    child->setOutputCapture(&childOut);
+    assert(child->getPC() == parent->getPC());
+    assert(child->getInstructionCount() == parent->getInstructionCount());
+    assert(child->getStack().size() == parent->getStack().size());
+    assert(child->getSharedObjectCount() == pairs + 10 && parent->getSharedObjectCount() == pairs + 10);
+    // Shared objects are never collected; private ones are
+    assert(parent->gc().objectsFreed == 0);
+    parent->allocatePair(list, nullptr);
+    assert(parent->gc().objectsFreed == 1);
+    assert(child->gc().objectsFreed == 0 && child->getObjectCount() == pairs + 10);
+
+    // Both finish the run on their own; the shared heap outlives the parent
+    unique_ptr<VM> again = child->fork();
+    string againOut;
+    again->setOutputCapture(&againOut);
+    parent->run();
+    assert(parentOut == whole);
+    parent.reset();
+    child->run();
+    again->run();
+    assert(child->getSharedObjectCount() == pairs + 10);
+    // The child prints what the parent printed after the fork
+    assert(!childOut.empty() && childOut.size() < whole.size() && childOut == againOut);
+    assert(whole.compare(whole.size() - childOut.size(), childOut.size(), childOut) == 0);
+    assert(child->getInstructionCount() == reference.getInstructionCount());
+    assert(again->getInstructionCount() == reference.getInstructionCount());
+    cout << "   [Check] Forked over " << pairs << " shared pairs; child and its fork print the same "
+         << childOut.size() << " bytes." << endl;
+}
+
+void testMappedBytecode() {
+    char path[] = "/tmp/test_vm_XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    const size_t bytes = nestedLoopProgram.size() * sizeof(int32_t);
+    assert(write(fd, nestedLoopProgram.data(), bytes) == (ssize_t)bytes);
+    close(fd);
+
+    auto image = make_shared<MappedBytecode>();
+    string error;
+    assert(image->open(path, error) && image->isMapped());
+    assert(image->view().size() == nestedLoopProgram.size());
+    VM copied(nestedLoopProgram);
+    copied.run();
+    auto mapped = make_unique<VM>(image->view(), image);
+    mapped->executeNext();
+    // The fork keeps the mapping alive once the VM and the image handle go
+    unique_ptr<VM> child = mapped->fork();
+    mapped.reset();
+    image.reset();
+    unlink(path);
+    child->run();
+    assert(topInt(*child) == topInt(copied));
+    assert(child->getInstructionCount() == copied.getInstructionCount());
+
+    MappedBytecode missing;
+    assert(!missing.open(path, error) && !error.empty());
+    cout << "   [Check] Mapped program ran in place: " << topInt(*child) << " after "
+         << child->getInstructionCount() << " instructions." << endl;
+}
+
+void testBytecodeContainer() {
+    char path[] = "/tmp/test_vm_XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+
+    BytecodeFile file;
+    file.code = nestedLoopProgram;
+    file.lines.assign(nestedLoopProgram.size(), 3);
+    file.symbols = {"i", "j", "sum"};
+    string error;
+    assert(writeBytecodeFile(path, file, error));
+    BytecodeFile read;
+    assert(readBytecodeFile(path, read, error));
+    assert(!read.legacy && read.code == file.code && read.lines == file.lines && read.symbols == file.symbols);
+
+    // The code section starts aligned, and runs in place from the mapping
+    MappedBytecode mapped;
+    assert(mapped.open(path, error) && !mapped.getImage().isLegacy());
+    assert((uintptr_t)mapped.view().data() % SECTION_ALIGN == 0);
+    assert(equal(mapped.view().begin(), mapped.view().end(), nestedLoopProgram.begin()));
+    VM vm(mapped.view(), nullptr);
+    vm.run();
+    VM copied(nestedLoopProgram);
+    copied.run();
+    assert(topInt(vm) == topInt(copied));
+
+    // A corrupt optional section fails a full read, not a code-only one
+    FILE* f = fopen(path, "r+b");
+    assert(f);
+    // The symbols fit in the last aligned block
+    fseek(f, -(long)SECTION_ALIGN, SEEK_END);
+    fputc('k', f);
+    fclose(f);
+    assert(!readBytecodeFile(path, read, error));
+    assert(error.find("checksum mismatch") != string::npos);
+    cout << "   [Check] Corrupt section rejected: " << error << endl;
+    assert(readBytecodeFile(path, read, error, sectionBit(Section::CODE)));
+    assert(read.code == file.code && read.lines.empty());
+
+    // A file without the magic is raw code
+    file.legacy = true;
+    assert(writeBytecodeFile(path, file, error));
+    assert(readBytecodeFile(path, read, error) && read.legacy && read.code == file.code);
+    unlink(path);
+    cout << "   [Check] Container and raw files read back " << read.code.size() << " words." << endl;
+}
+
+int main() {
+    cout << "Starting VM Execution Test Suite (" << VM::dispatchMode() << " dispatch)..." << endl;
+
+    runTest("Value Encoding", testValueEncoding);
+    runTest("Arithmetic", testArithmetic);
+    runTest("Nested Loop", testNestedLoop);
+    runTest("Nested Call", testNestedCall);
+    runTest("Misaligned Jump", testMisalignedJump);
+    runTest("Division By Zero", testDivisionByZero);
+    runTest("Invalid Opcode", testInvalidOpcode);
+    runTest("Verifier Diagnostics", testVerifierDiagnostics);
+    runTest("Single Step", testSingleStep);
+    runTest("Breakpoint Stop", testBreakpointStop);
+    runTest("Fused Group Stepping", testFusedGroupStepping);
+    runTest("Continue Past Breakpoint", testContinuePastBreakpoint);
+    runTest("Step Onto Breakpoint", testStepOntoBreakpoint);
+    runTest("Stack Overflow Trap", testStackOverflowTrap);
+    runTest("Stack Underflow Trap", testStackUnderflowTrap);
+    runTest("Static Stack Bound", testStaticStackBound);
+    runTest("Stack Growth", testStackGrowth);
+    runTest("Call Depth Trap", testCallDepthTrap);
+    runTest("Register Tier Loop", testRegisterTierLoop);
+    runTest("Register Tier Stack Temps", testRegisterTierStackTemps);
+    runTest("Register Tier Fallback", testRegisterTierFallback);
+    runTest("Register Tier Division By Zero", testRegisterTierDivisionByZero);
+    runTest("Register Tier Trap Stack", testRegisterTierTrapStack);
+    runTest("JIT Nested Loop", testJitNestedLoop);
+    runTest("JIT Interpreter Exits", testJitInterpreterExits);
+    runTest("JIT Traps", testJitTraps);
+    runTest("Traced Loop", testTracedLoop);
+    runTest("Trace Side Exit", testTraceSideExit);
+    runTest("Trace Division By Zero", testTraceDivisionByZero);
+    runTest("Closure Nested Loop", testClosureNestedLoop);
+    runTest("Closure Calls And Traps", testClosureCallsAndTraps);
+    runTest("AOT Nested Loop", testAotNestedLoop);
+    runTest("AOT Calls And Traps", testAotCallsAndTraps);
+    runTest("Profiler", testProfiler);
+    runTest("Sampler Folding", testSamplerFolding);
+    runTest("Sampled Run", testSampledRun);
+    runTest("Sampled Tiers", testSampledTiers);
+    runTest("Buffered Output", testBufferedOutput);
+    runTest("Concurrent VMs", testConcurrentVMs);
+    runTest("Time Slices", testTimeSlices);
+    runTest("Fork Checkpoint", testForkCheckpoint);
+    runTest("Mapped Bytecode", testMappedBytecode);
+    runTest("Bytecode Container", testBytecodeContainer);
+    if (!aotCache.empty()) system(("rm -rf " + aotCache).c_str());
+
+    cout << "\n--------------------------------------------------" << endl;
+    cout << "SUMMARY: All VM Execution Tests Passed." << endl;
+    cout << "--------------------------------------------------" << endl;
+    return 0;
+}
@@ -1,32 +1,54 @@
 #include <iostream>
 #include <fstream>
+#include <string>
+#include <memory>
 #include "VirtualMachine.h"
 
 using namespace std;
 
 int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        cerr << "Usage: ./vm program.byc\n";
-        return 1;
+    string bytecodeFile, foldedFile;
+    bool lineOutput = false;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--sample" && i + 1 < argc) foldedFile = argv[++i];
+        else if (arg == "--line") lineOutput = true;
+        else bytecodeFile = arg;
     }
-
-    ifstream in(argv[1], ios::binary);
-    if (!in) {
-        cerr << "Cannot open bytecode file\n";
+    if (bytecodeFile.empty()) {
+        cerr << "Usage: ./vm program.byc [--sample out.folded] [--line]\n";
         return 1;
     }
 
-    in.seekg(0, ios::end);
-    size_t size = in.tellg();
-    in.seekg(0, ios::beg);
-
-    vector<int32_t> bytecode(size / sizeof(int32_t));
-    in.read(reinterpret_cast<char*>(bytecode.data()), size);
-    in.close();
+    // Mapped and run in place; a file that cannot be mapped (a pipe, say)
+    // is read into memory instead. Containers and raw files both load.
+    auto image = make_shared<MappedBytecode>();
+    string error;
+    unique_ptr<VM> vm;
+    if (image->open(bytecodeFile, error)) {
+        vm = make_unique<VM>(image->view(), image);
+    } else {
+        BytecodeFile file;
+        if (image->isMapped() || !readBytecodeFile(bytecodeFile, file, error, sectionBit(Section::CODE))) {
+            cerr << "Cannot load bytecode file: " << error << "\n";
+            return 1;
+        }
+        vm = make_unique<VM>(file.code);
+    }
 
-    VM vm(bytecode);
-    vm.run();
-    vm.printFinalStack();
-    vm.printStats();
+    vm->setLineBuffered(lineOutput);
+    if (!foldedFile.empty()) vm->enableSampling();
+    vm->run();
+    vm->printFinalStack();
+    vm->printStats();
+    if (!foldedFile.empty()) {
+        ofstream out(foldedFile);
+        if (!out) {
+            cerr << "Cannot write " << foldedFile << "\n";
+            return 1;
+        }
+        vm->writeFoldedStacks(out);
+        cout << vm->getSampleCount() << " samples written to " << foldedFile << "\n";
+    }
     return 0;
 }
@@ -1,13 +1,16 @@
 #ifndef OBJECT_H
 #define OBJECT_H
 
-enum ObjectType {
+#include <cstdint>
+
+enum ObjectType : uint8_t {
     OBJ_PAIR 
 };
 
 struct Object {
     ObjectType type;
     bool marked;       
+    uint32_t heap;      // id of the VM heap that allocated it
     struct Object* next; 
 };
 
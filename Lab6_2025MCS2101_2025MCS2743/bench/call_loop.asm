@@ -0,0 +1,23 @@
+# Call-heavy benchmark: 500000 calls to a small leaf function
+
+PUSH 0
+STORE 0
+
+LOOP:
+LOAD 0
+PUSH 500000
+CMP
+JZ END
+CALL F
+JMP LOOP
+
+F:
+LOAD 0
+PUSH 1
+ADD
+STORE 0
+RET
+
+END:
+LOAD 0
+HALT
@@ -0,0 +1,54 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <string>
+#include "Assembler.h"
+#include "VirtualMachine.h"
+
+using namespace std;
+
+static const int REPEATS = 5;
+
+// Best-of-REPEATS wall time for one run; count receives dispatched instructions
+static double timeRun(const vector<int32_t>& bytecode, bool closures, long long& count) {
+    double bestMs = 0;
+    for (int r = 0; r < REPEATS; r++) {
+        VM vm(bytecode);
+        vm.setJitThreshold(-1);
+        if (closures) vm.enableClosureTier();
+        auto start = chrono::steady_clock::now();
+        vm.run();
+        auto stop = chrono::steady_clock::now();
+        double ms = chrono::duration<double, milli>(stop - start).count();
+        if (r == 0 || ms < bestMs) bestMs = ms;
+        count = vm.getInstructionCount();
+    }
+    return bestMs;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        cerr << "Usage: ./dispatch_bench program.asm...\n";
+        return 1;
+    }
+
+    cout << "Dispatch: " << VM::dispatchMode() << " vs closures" << endl;
+    cout << left << setw(28) << "workload" << right << setw(14) << "instructions"
+         << setw(12) << "best ms" << setw(12) << "ns/instr" << setw(10) << "MIPS"
+         << setw(13) << "closure ms" << setw(10) << "MIPS" << endl;
+
+    for (int i = 1; i < argc; i++) {
+        vector<int32_t> bytecode = assemble(argv[i]);
+        long long count = 0, closureCount = 0;
+        double bestMs = timeRun(bytecode, false, count);
+        double closureMs = timeRun(bytecode, true, closureCount);
+        cout << left << setw(28) << argv[i] << right << setw(14) << count
+             << setw(12) << fixed << setprecision(2) << bestMs
+             << setw(12) << setprecision(2) << (bestMs * 1e6 / count)
+             << setw(10) << setprecision(1) << (count / (bestMs * 1e3))
+             << setw(13) << setprecision(2) << closureMs
+             << setw(10) << setprecision(1) << (closureCount / (closureMs * 1e3)) << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,45 @@
+# Nested loop benchmark: x += 1 for 1000 x 1000 iterations
+
+PUSH 0
+STORE 0
+
+PUSH 0
+STORE 1
+
+OUTER:
+LOAD 1
+PUSH 1000
+CMP
+JZ DONE
+
+PUSH 0
+STORE 2
+
+INNER:
+LOAD 2
+PUSH 1000
+CMP
+JZ NEXT
+
+LOAD 0
+PUSH 1
+ADD
+STORE 0
+
+LOAD 2
+PUSH 1
+ADD
+STORE 2
+
+JMP INNER
+
+NEXT:
+LOAD 1
+PUSH 1
+ADD
+STORE 1
+JMP OUTER
+
+DONE:
+LOAD 0
+HALT
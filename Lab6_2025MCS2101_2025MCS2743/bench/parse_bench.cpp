@@ -0,0 +1,122 @@
+#include <iostream>
+#include <algorithm>
+#include <iomanip>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <string>
+#include "parse.h"
+
+using namespace std;
+
+static const int REPEATS = 5;
+static const int PROGRAMS = 500;
+
+// A loop over `vars` variables, different for every i so nothing is shared
+static string makeProgram(int i) {
+    const int vars = 5 + i % 40;
+    string src;
+    for (int v = 0; v < vars; v++) src += "var v" + to_string(v) + " = " + to_string(i + v) + ";\n";
+    src += "var n = 0;\nwhile (n < 10) {\n";
+    for (int v = 0; v < vars; v++) {
+        src += "    v" + to_string(v) + " = v" + to_string(v) + " * 3 + n - " + to_string(v) + ";\n";
+        src += "    if (v" + to_string(v) + " > 1000) { v" + to_string(v) + " = 0; }\n";
+    }
+    src += "    n = n + 1;\n}\nprint v0;\n";
+    return src;
+}
+
+static bool parseInMemory(const string& src) {
+    ASTNode* ast;
+    char error[256];
+    if (parse_source(src.data(), (int)src.size(), &ast, error, sizeof(error)) != 0) return false;
+    free_ast(ast);
+    return true;
+}
+
+// What submit used to do: write the source out and scan it back in
+static bool parseViaTempFile(const string& src) {
+    {
+        ofstream temp("/tmp/parse_input.txt");
+        temp << src;
+    }
+    ifstream in("/tmp/parse_input.txt");
+    stringstream text;
+    text << in.rdbuf();
+    return parseInMemory(text.str());
+}
+
+// Best-of-REPEATS wall time for parsing the whole batch
+static double timeBatch(const vector<string>& sources, bool (*parse)(const string&)) {
+    double bestMs = 0;
+    for (int r = 0; r < REPEATS; r++) {
+        auto start = chrono::steady_clock::now();
+        for (const string& src : sources) {
+            if (!parse(src)) {
+                cerr << "parse failed\n";
+                exit(1);
+            }
+        }
+        auto stop = chrono::steady_clock::now();
+        double ms = chrono::duration<double, milli>(stop - start).count();
+        if (r == 0 || ms < bestMs) bestMs = ms;
+    }
+    return bestMs;
+}
+
+// The batch split across threads, each parsing with its own context
+static double timeParallel(const vector<string>& sources, unsigned threads) {
+    double bestMs = 0;
+    for (int r = 0; r < REPEATS; r++) {
+        atomic<size_t> next(0);
+        atomic<bool> failed(false);
+        auto start = chrono::steady_clock::now();
+        vector<thread> workers;
+        for (unsigned t = 0; t < threads; t++) {
+            workers.emplace_back([&] {
+                for (size_t i; (i = next++) < sources.size();) {
+                    if (!parseInMemory(sources[i])) failed = true;
+                }
+            });
+        }
+        for (thread& w : workers) w.join();
+        auto stop = chrono::steady_clock::now();
+        if (failed) {
+            cerr << "parse failed\n";
+            exit(1);
+        }
+        double ms = chrono::duration<double, milli>(stop - start).count();
+        if (r == 0 || ms < bestMs) bestMs = ms;
+    }
+    return bestMs;
+}
+
+int main() {
+    vector<string> sources;
+    size_t bytes = 0;
+    for (int i = 0; i < PROGRAMS; i++) {
+        sources.push_back(makeProgram(i));
+        bytes += sources.back().size();
+    }
+    const unsigned threads = max(2u, thread::hardware_concurrency());
+
+    cout << "Bulk submit parsing: " << PROGRAMS << " programs, " << bytes / 1024 << " KB of source" << endl;
+    cout << left << setw(24) << "input" << right << setw(12) << "batch ms" << setw(14) << "us/program" << endl;
+    double fileMs = timeBatch(sources, parseViaTempFile);
+    double memoryMs = timeBatch(sources, parseInMemory);
+    double parallelMs = timeParallel(sources, threads);
+    remove("/tmp/parse_input.txt");
+    cout << fixed << setprecision(2);
+    cout << left << setw(24) << "/tmp round trip" << right << setw(12) << fileMs << setw(14) << fileMs * 1000 / PROGRAMS << endl;
+    cout << left << setw(24) << "in memory" << right << setw(12) << memoryMs << setw(14) << memoryMs * 1000 / PROGRAMS << endl;
+    cout << left << setw(24) << ("in memory, " + to_string(threads) + " threads") << right << setw(12) << parallelMs
+         << setw(14) << parallelMs * 1000 / PROGRAMS << endl;
+    cout << "Speedup: " << fileMs / memoryMs << "x in memory, " << memoryMs / parallelMs << "x on "
+         << threads << " threads (" << thread::hardware_concurrency() << " cores)" << endl;
+    return 0;
+}
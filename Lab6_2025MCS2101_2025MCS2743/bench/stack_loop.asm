@@ -0,0 +1,15 @@
+# Stack-only loop benchmark: count to 3000000 in steps of 1
+
+PUSH 0
+
+LOOP:
+DUP
+PUSH 3000000
+CMP
+JZ END
+PUSH 1
+ADD
+JMP LOOP
+
+END:
+HALT
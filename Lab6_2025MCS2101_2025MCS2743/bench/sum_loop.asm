@@ -0,0 +1,29 @@
+# IRGenerator-shaped loop: s = s + i * 3 for i below 2000000, leaving s on the stack
+
+PUSH 0
+STORE 0
+PUSH 0
+STORE 1
+
+LOOP:
+LOAD 1
+PUSH 2000000
+CMP
+JZ END
+
+LOAD 0
+LOAD 1
+PUSH 3
+MUL
+ADD
+STORE 0
+
+LOAD 1
+PUSH 1
+ADD
+STORE 1
+JMP LOOP
+
+END:
+LOAD 0
+HALT
@@ -0,0 +1,67 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <string>
+#include "Assembler.h"
+#include "VirtualMachine.h"
+
+using namespace std;
+
+static const int REPEATS = 5;
+
+enum Tier { STACK, REGISTER, JIT, TRACE, AOT };
+
+// Best-of-REPEATS wall time for one run; count receives dispatched instructions
+static double timeRun(const vector<int32_t>& bytecode, Tier tier, long long& count) {
+    double bestMs = 0;
+    for (int r = 0; r < REPEATS; r++) {
+        VM vm(bytecode);
+        string reason;
+        vm.setJitThreshold(tier == JIT ? 0 : -1);
+        if (tier == REGISTER) vm.enableRegisterTier(reason);
+        if (tier == TRACE) vm.enableTracing();
+        if (tier == AOT && !vm.enableAot(reason)) return -1;
+        auto start = chrono::steady_clock::now();
+        vm.run();
+        auto stop = chrono::steady_clock::now();
+        double ms = chrono::duration<double, milli>(stop - start).count();
+        if (r == 0 || ms < bestMs) bestMs = ms;
+        count = vm.getInstructionCount();
+    }
+    return bestMs;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        cerr << "Usage: ./tier_bench program.asm...\n";
+        return 1;
+    }
+
+    cout << "Stack VM vs register tier vs JIT vs tracing JIT vs AOT (" << VM::dispatchMode() << " dispatch)" << endl;
+    cout << left << setw(24) << "workload" << right << setw(12) << "stack ins" << setw(10) << "stack ms"
+         << setw(9) << "jit ms" << setw(10) << "trace ms" << setw(9) << "aot ms" << setw(12) << "reg ins" << setw(9) << "ratio" << setw(9) << "reg ms" << endl;
+
+    for (int i = 1; i < argc; i++) {
+        vector<int32_t> bytecode = assemble(argv[i]);
+        long long stackCount = 0, jitCount = 0, traceCount = 0, aotCount = 0, regCount = 0;
+        double stackMs = timeRun(bytecode, STACK, stackCount);
+        double jitMs = timeRun(bytecode, JIT, jitCount);
+        double traceMs = timeRun(bytecode, TRACE, traceCount);
+        double aotMs = timeRun(bytecode, AOT, aotCount);
+        cout << left << setw(24) << argv[i] << right << setw(12) << stackCount
+             << setw(10) << fixed << setprecision(2) << stackMs << setw(9) << jitMs << setw(10) << traceMs
+             << setw(9) << aotMs;
+
+        VM probe(bytecode);
+        string reason;
+        if (!probe.enableRegisterTier(reason)) {
+            cout << "  register tier: " << reason << endl;
+            continue;
+        }
+        double regMs = timeRun(bytecode, REGISTER, regCount);
+        cout << setw(12) << regCount << setw(8) << setprecision(2) << (double)stackCount / regCount << "x"
+             << setw(9) << setprecision(2) << regMs << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,97 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <string>
+#include "Assembler.h"
+#include "VirtualMachine.h"
+#include "Instruction.h"
+
+using namespace std;
+
+static const int REPEATS = 5;
+static const int GC_ROUNDS = 20000;
+
+// Best-of-REPEATS wall time for one interpreted run; count receives
+// dispatched instructions
+static double timeRun(const vector<int32_t>& bytecode, long long& count) {
+    double bestMs = 0;
+    for (int r = 0; r < REPEATS; r++) {
+        VM vm(bytecode);
+        vm.setJitThreshold(-1);
+        auto start = chrono::steady_clock::now();
+        vm.run();
+        auto stop = chrono::steady_clock::now();
+        double ms = chrono::duration<double, milli>(stop - start).count();
+        if (r == 0 || ms < bestMs) bestMs = ms;
+        count = vm.getInstructionCount();
+    }
+    return bestMs;
+}
+
+// Builds `depth` values on the stack and folds them with ADD, `rounds` times
+static vector<int32_t> deepStackProgram(int depth, int rounds) {
+    vector<int32_t> p = {OP_PUSH, 0, OP_STORE, 0};
+    int loop = (int)p.size();
+    p.insert(p.end(), {OP_LOAD, 0, OP_PUSH, rounds, OP_CMP, OP_JZ, 0});
+    size_t exitAt = p.size() - 1;
+    for (int i = 0; i < depth; i++) p.insert(p.end(), {OP_PUSH, i});
+    for (int i = 1; i < depth; i++) p.push_back(OP_ADD);
+    p.insert(p.end(), {OP_POP, OP_LOAD, 0, OP_PUSH, 1, OP_ADD, OP_STORE, 0, OP_JMP, loop});
+    p[exitAt] = (int32_t)p.size();
+    p.push_back(OP_HALT);
+    return p;
+}
+
+// Adds 1 to each of the 1024 memory slots, `rounds` times
+static vector<int32_t> memorySweepProgram(int rounds) {
+    vector<int32_t> p = {OP_PUSH, 0, OP_STORE, 1023};
+    int loop = (int)p.size();
+    p.insert(p.end(), {OP_LOAD, 1023, OP_PUSH, rounds, OP_CMP, OP_JZ, 0});
+    size_t exitAt = p.size() - 1;
+    for (int slot = 0; slot < 1023; slot++) {
+        p.insert(p.end(), {OP_LOAD, slot, OP_PUSH, 1, OP_ADD, OP_STORE, slot});
+    }
+    p.insert(p.end(), {OP_LOAD, 1023, OP_PUSH, 1, OP_ADD, OP_STORE, 1023, OP_JMP, loop});
+    p[exitAt] = (int32_t)p.size();
+    p.push_back(OP_HALT);
+    return p;
+}
+
+static void report(const string& name, const vector<int32_t>& bytecode) {
+    long long count = 0;
+    double ms = timeRun(bytecode, count);
+    cout << left << setw(28) << name << right << setw(14) << count
+         << setw(12) << fixed << setprecision(2) << ms
+         << setw(12) << setprecision(2) << (ms * 1e6 / count) << endl;
+}
+
+int main(int argc, char* argv[]) {
+    cout << "Value layout: " << (VM_TAGGED_VALUES ? "tagged" : "wide") << " (" << sizeof(Value)
+         << " bytes, " << VM::DEFAULT_STACK_LIMIT * sizeof(Value) / 1024 << " KiB stack, "
+         << 1024 * sizeof(Value) / 1024 << " KiB memory)" << endl;
+    cout << left << setw(28) << "workload" << right << setw(14) << "instructions"
+         << setw(12) << "best ms" << setw(12) << "ns/instr" << endl;
+
+    report("deep stack (3000 values)", deepStackProgram(3000, 500));
+    report("memory sweep (1024 slots)", memorySweepProgram(1000));
+    for (int i = 1; i < argc; i++) report(argv[i], assemble(argv[i]));
+
+    // Root scanning: a full stack of integers under one live pair, and memory
+    VM vm({OP_HALT});
+    for (size_t i = 1; i < VM::DEFAULT_STACK_LIMIT; i++) vm.pushStack(INT_VAL((int32_t)i));
+    vm.pushStack(OBJ_VAL(vm.allocatePair(nullptr, nullptr)));
+    const size_t roots = vm.getStack().size() + 1024;
+    double bestMs = 0;
+    for (int r = 0; r < REPEATS; r++) {
+        auto start = chrono::steady_clock::now();
+        for (int k = 0; k < GC_ROUNDS; k++) vm.gc();
+        auto stop = chrono::steady_clock::now();
+        double ms = chrono::duration<double, milli>(stop - start).count();
+        if (r == 0 || ms < bestMs) bestMs = ms;
+    }
+    cout << left << setw(28) << "gc root scan" << right << setw(14) << roots * GC_ROUNDS
+         << setw(12) << fixed << setprecision(2) << bestMs
+         << setw(12) << setprecision(2) << (bestMs * 1e6 / (roots * GC_ROUNDS)) << "  per root" << endl;
+    return 0;
+}